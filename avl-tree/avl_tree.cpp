@@ -1,37 +1,102 @@
 #include "avl_tree.h"
+#include "snapshot_format.h"
+#include "instrumentation/lock_trace.h"
+#include "trace-replay/trace.h"
 #include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
+#include <future>
+#include <mutex>
+#include <numeric>
+
+namespace {
+
+// Номера запросов в порядке возрастания их значений
+std::vector<int> SortedOrder(const std::vector<int>& queries) {
+  std::vector<int> order(queries.size());
+  std::iota(order.begin(), order.end(), 0);
+  std::sort(order.begin(), order.end(), [&queries](int a, int b) { return queries[a] < queries[b]; });
+  return order;
+}
+
+// Загрузка узла в кэш, пока обходится другая ветвь
+inline void Prefetch(const void* p) {
+#if defined(__GNUC__)
+  __builtin_prefetch(p);
+#endif
+}
+
+}
+
+AVLtree::~AVLtree() {
+  Clear(head);
+}
 
 void AVLtree::Insert(const int key) {
+  trace::Record(trace::Kind::avl_tree, this, trace::Op::add, key);
+  auto time0 = lock_trace::Begin();
   std::lock_guard<std::shared_mutex> lock(mutex);
   auto time1 = std::chrono::steady_clock::now();
   auto th_id = std::this_thread::get_id();
   head = Insert(head, key);
   auto time2 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time2 - time1);
+  lock_trace::Record(this, "AVLtree", "Insert", true, time0, time1, time2);
+  if (metrics::Enabled()) {
+    stats.Record(time0, time1, time2, Size(head), Height(head));
+  }
 }
 
-void AVLtree::Remove(const int key) {
+bool AVLtree::Remove(const int key) {
+  trace::Record(trace::Kind::avl_tree, this, trace::Op::remove, key);
+  auto time0 = lock_trace::Begin();
   std::lock_guard<std::shared_mutex> lock(mutex);
   auto time1 = std::chrono::steady_clock::now();
   auto th_id = std::this_thread::get_id();
-  if (FindByKey(head, key)) {
+  bool found = FindByKey(head, key) != nullptr;
+  if (found) {
     head = Remove(head, key);
   }
   auto time2 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time2 - time1);
+  lock_trace::Record(this, "AVLtree", "Remove", true, time0, time1, time2);
+  if (metrics::Enabled()) {
+    stats.Record(time0, time1, time2, Size(head), Height(head));
+  }
+  return found;
+}
+
+int AVLtree::Size() {
+  auto time0 = lock_trace::Begin();
+  std::shared_lock<std::shared_mutex> lock(mutex);
+  auto time1 = std::chrono::steady_clock::now();
+  auto th_id = std::this_thread::get_id();
+  int res = Size(head);
+  auto time2 = std::chrono::steady_clock::now();
+  work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time2 - time1);
+  lock_trace::Record(this, "AVLtree", "Size", false, time0, time1, time2);
+  stats.Record(time0, time1, time2);
+  return res;
 }
 
 bool AVLtree::FindByKey(const int key) {
+  trace::Record(trace::Kind::avl_tree, this, trace::Op::read, key);
+  auto time0 = lock_trace::Begin();
   std::shared_lock<std::shared_mutex> lock(mutex);
   auto time1 = std::chrono::steady_clock::now();
   auto th_id = std::this_thread::get_id();
   node* res = FindByKey(head, key);
   auto time2 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time2 - time1);
+  lock_trace::Record(this, "AVLtree", "FindByKey", false, time0, time1, time2);
+  stats.Record(time0, time1, time2);
   return res == nullptr ? false : true;
 }
 
 bool AVLtree::FindByRank(const int rank, int& val) {
+  trace::Record(trace::Kind::avl_tree, this, trace::Op::rank, rank);
+  auto time0 = lock_trace::Begin();
   std::shared_lock<std::shared_mutex> lock(mutex);
   auto time1 = std::chrono::steady_clock::now();
   auto th_id = std::this_thread::get_id();
@@ -41,16 +106,473 @@ bool AVLtree::FindByRank(const int rank, int& val) {
   }
   auto time2 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time2 - time1);
+  lock_trace::Record(this, "AVLtree", "FindByRank", false, time0, time1, time2);
+  stats.Record(time0, time1, time2);
   return res == nullptr ? false : true;
 }
 
+void AVLtree::FindByRankBatch(const std::vector<int>& ranks, std::vector<int>& vals, std::vector<bool>& found) {
+  if (trace::Enabled()) {
+    for (int rank : ranks) {
+      trace::Record(trace::Kind::avl_tree, this, trace::Op::rank, rank);
+    }
+  }
+  std::vector<int> order = SortedOrder(ranks);
+  vals.assign(ranks.size(), 0);
+  found.assign(ranks.size(), false);
+  auto time0 = lock_trace::Begin();
+  std::shared_lock<std::shared_mutex> lock(mutex);
+  auto time1 = std::chrono::steady_clock::now();
+  auto th_id = std::this_thread::get_id();
+  FindByRankBatch(head, ranks.data(), order.data(), order.data() + order.size(), 0, vals.data(), found);
+  auto time2 = std::chrono::steady_clock::now();
+  work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time2 - time1);
+  lock_trace::Record(this, "AVLtree", "FindByRankBatch", false, time0, time1, time2);
+  stats.Record(time0, time1, time2);
+}
+
+void AVLtree::FindByKeyBatch(const std::vector<int>& keys, std::vector<bool>& found) {
+  if (trace::Enabled()) {
+    for (int key : keys) {
+      trace::Record(trace::Kind::avl_tree, this, trace::Op::read, key);
+    }
+  }
+  std::vector<int> order = SortedOrder(keys);
+  found.assign(keys.size(), false);
+  auto time0 = lock_trace::Begin();
+  std::shared_lock<std::shared_mutex> lock(mutex);
+  auto time1 = std::chrono::steady_clock::now();
+  auto th_id = std::this_thread::get_id();
+  FindByKeyBatch(head, keys.data(), order.data(), order.data() + order.size(), found);
+  auto time2 = std::chrono::steady_clock::now();
+  work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time2 - time1);
+  lock_trace::Record(this, "AVLtree", "FindByKeyBatch", false, time0, time1, time2);
+  stats.Record(time0, time1, time2);
+}
+
+bool AVLtree::LowerBound(const int key, int& val) {
+  auto time0 = lock_trace::Begin();
+  std::shared_lock<std::shared_mutex> lock(mutex);
+  auto time1 = std::chrono::steady_clock::now();
+  auto th_id = std::this_thread::get_id();
+  node* res = LowerBound(head, key, false);
+  if (res != nullptr) {
+    val = res->key;
+  }
+  auto time2 = std::chrono::steady_clock::now();
+  work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time2 - time1);
+  lock_trace::Record(this, "AVLtree", "LowerBound", false, time0, time1, time2);
+  stats.Record(time0, time1, time2);
+  return res == nullptr ? false : true;
+}
+
+bool AVLtree::UpperBound(const int key, int& val) {
+  auto time0 = lock_trace::Begin();
+  std::shared_lock<std::shared_mutex> lock(mutex);
+  auto time1 = std::chrono::steady_clock::now();
+  auto th_id = std::this_thread::get_id();
+  node* res = LowerBound(head, key, true);
+  if (res != nullptr) {
+    val = res->key;
+  }
+  auto time2 = std::chrono::steady_clock::now();
+  work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time2 - time1);
+  lock_trace::Record(this, "AVLtree", "UpperBound", false, time0, time1, time2);
+  stats.Record(time0, time1, time2);
+  return res == nullptr ? false : true;
+}
+
+bool AVLtree::RankOf(const int key, int& rank) {
+  auto time0 = lock_trace::Begin();
+  std::shared_lock<std::shared_mutex> lock(mutex);
+  auto time1 = std::chrono::steady_clock::now();
+  auto th_id = std::this_thread::get_id();
+  node* res = FindByKey(head, key);
+  if (res != nullptr) {
+    rank = CountLess(head, key) + 1;
+  }
+  auto time2 = std::chrono::steady_clock::now();
+  work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time2 - time1);
+  lock_trace::Record(this, "AVLtree", "RankOf", false, time0, time1, time2);
+  stats.Record(time0, time1, time2);
+  return res == nullptr ? false : true;
+}
+
+int AVLtree::CountInRange(const int lo, const int hi) {
+  auto time0 = lock_trace::Begin();
+  std::shared_lock<std::shared_mutex> lock(mutex);
+  auto time1 = std::chrono::steady_clock::now();
+  auto th_id = std::this_thread::get_id();
+  int res = lo < hi ? CountLess(head, hi) - CountLess(head, lo) : 0;
+  auto time2 = std::chrono::steady_clock::now();
+  work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time2 - time1);
+  lock_trace::Record(this, "AVLtree", "CountInRange", false, time0, time1, time2);
+  stats.Record(time0, time1, time2);
+  return res;
+}
+
+void AVLtree::VisitRange(const int lo, const int hi, const std::function<void(int)>& visitor) {
+  auto time0 = lock_trace::Begin();
+  std::shared_lock<std::shared_mutex> lock(mutex);
+  auto time1 = std::chrono::steady_clock::now();
+  auto th_id = std::this_thread::get_id();
+  VisitRange(head, lo, hi, visitor);
+  auto time2 = std::chrono::steady_clock::now();
+  work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time2 - time1);
+  lock_trace::Record(this, "AVLtree", "VisitRange", false, time0, time1, time2);
+  stats.Record(time0, time1, time2);
+}
+
+void AVLtree::BuildFromSorted(const std::vector<int>& keys) {
+  std::vector<int> sorted;
+  const std::vector<int>* src = &keys;
+  if (!std::is_sorted(keys.begin(), keys.end())) {
+    sorted = keys;
+    std::sort(sorted.begin(), sorted.end());
+    src = &sorted;
+  }
+  std::vector<node*> nodes(src->size());
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    nodes[i] = new node((*src)[i]);
+  }
+  node* root = Build(nodes.data(), static_cast<int>(nodes.size()));
+  {
+    auto time0 = lock_trace::Begin();
+    std::lock_guard<std::shared_mutex> lock(mutex);
+    auto time1 = std::chrono::steady_clock::now();
+    auto th_id = std::this_thread::get_id();
+    std::swap(head, root);
+    auto time2 = std::chrono::steady_clock::now();
+    work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time2 - time1);
+    lock_trace::Record(this, "AVLtree", "BuildFromSorted", true, time0, time1, time2);
+    if (metrics::Enabled()) {
+      stats.Record(time0, time1, time2, Size(head), Height(head));
+    }
+  }
+  // Старое дерево освобождается уже без блокировки
+  Clear(root);
+}
+
+bool AVLtree::SaveSnapshot(const std::string& path, const bool delta) {
+  FILE* out = std::fopen(path.c_str(), "wb");
+  if (!out) {
+    return false;
+  }
+  avl_snapshot::Writer writer(out, delta);
+  {
+    auto time0 = lock_trace::Begin();
+    std::shared_lock<std::shared_mutex> lock(mutex);
+    auto time1 = std::chrono::steady_clock::now();
+    auto th_id = std::this_thread::get_id();
+    writer.Header(Size(head));
+    // Обход по возрастанию без рекурсии: высота дерева мала, стек короткий
+    std::vector<node*> path_stack;
+    for (node* p = head; p || !path_stack.empty();) {
+      if (p) {
+        path_stack.push_back(p);
+        p = p->left;
+        continue;
+      }
+      p = path_stack.back();
+      path_stack.pop_back();
+      writer.Key(p->key);
+      p = p->right;
+    }
+    auto time2 = std::chrono::steady_clock::now();
+    work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time2 - time1);
+    lock_trace::Record(this, "AVLtree", "SaveSnapshot", false, time0, time1, time2);
+    stats.Record(time0, time1, time2);
+  }
+  bool ok = writer.Finish();
+  ok = std::fclose(out) == 0 && ok;
+  return ok;
+}
+
+bool AVLtree::LoadSnapshot(const std::string& path) {
+  FILE* in = std::fopen(path.c_str(), "rb");
+  if (!in) {
+    return false;
+  }
+  // Число ключей из заголовка сверяется с размером файла до выделения памяти
+  uint64_t file_size = 0;
+  if (std::fseek(in, 0, SEEK_END) == 0) {
+    long end = std::ftell(in);
+    file_size = end > 0 ? static_cast<uint64_t>(end) : 0;
+  }
+  std::rewind(in);
+  avl_snapshot::Reader reader(in);
+  char magic[sizeof(avl_snapshot::magic)];
+  unsigned char c = 0;
+  bool ok = true;
+  for (size_t i = 0; ok && i < sizeof(magic); ++i) {
+    ok = reader.Get(c);
+    magic[i] = static_cast<char>(c);
+  }
+  uint64_t flags = 0, count = 0;
+  ok = ok && std::equal(magic, magic + sizeof(magic), avl_snapshot::magic) && reader.GetFixed(flags, 4) &&
+       flags <= avl_snapshot::delta_flag && reader.GetFixed(count, 8) && count <= static_cast<uint64_t>(INT_MAX) &&
+       count <= avl_snapshot::MaxKeys(file_size, flags);
+  std::vector<node*> nodes;
+  if (ok) {
+    nodes.reserve(count);
+  }
+  uint64_t checksum = avl_snapshot::checksum_basis;
+  uint32_t prev = 0;
+  for (uint64_t i = 0; ok && i < count; ++i) {
+    uint32_t u = 0;
+    if (flags & avl_snapshot::delta_flag) {
+      uint32_t diff = 0;
+      ok = reader.GetVarint(diff) && diff <= ~prev;
+      u = prev + diff;
+    }
+    else {
+      uint64_t v = 0;
+      ok = reader.GetFixed(v, 4) && v >= prev;
+      u = static_cast<uint32_t>(v);
+    }
+    prev = u;
+    checksum = avl_snapshot::Checksum(checksum, u);
+    nodes.push_back(new node(static_cast<int>(u ^ 0x80000000u)));
+  }
+  uint64_t stored = 0;
+  ok = ok && reader.GetFixed(stored, 8) && stored == checksum && !reader.Get(c);
+  std::fclose(in);
+  if (!ok) {
+    for (node* p : nodes) {
+      delete p;
+    }
+    return false;
+  }
+  node* root = Build(nodes.data(), static_cast<int>(nodes.size()));
+  {
+    auto time0 = lock_trace::Begin();
+    std::lock_guard<std::shared_mutex> lock(mutex);
+    auto time1 = std::chrono::steady_clock::now();
+    auto th_id = std::this_thread::get_id();
+    std::swap(head, root);
+    auto time2 = std::chrono::steady_clock::now();
+    work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time2 - time1);
+    lock_trace::Record(this, "AVLtree", "LoadSnapshot", true, time0, time1, time2);
+    if (metrics::Enabled()) {
+      stats.Record(time0, time1, time2, Size(head), Height(head));
+    }
+  }
+  Clear(root);
+  return true;
+}
+
+void AVLtree::InsertBatch(std::vector<int> keys) {
+  if (trace::Enabled()) {
+    for (int key : keys) {
+      trace::Record(trace::Kind::avl_tree, this, trace::Op::add, key);
+    }
+  }
+  std::sort(keys.begin(), keys.end());
+  auto time0 = lock_trace::Begin();
+  std::lock_guard<std::shared_mutex> lock(mutex);
+  auto time1 = std::chrono::steady_clock::now();
+  auto th_id = std::this_thread::get_id();
+  if (!PreferRebuild(Size(head), keys.size())) {
+    for (int key : keys) {
+      head = Insert(head, key);
+    }
+  }
+  else {
+    std::vector<node*> nodes;
+    Flatten(head, nodes);
+    // Слияние существующих узлов с новыми; равные ключи вставляются после старых, как в Insert
+    std::vector<node*> merged;
+    merged.reserve(nodes.size() + keys.size());
+    size_t i = 0;
+    for (int key : keys) {
+      while (i < nodes.size() && nodes[i]->key <= key) {
+        merged.push_back(nodes[i++]);
+      }
+      merged.push_back(new node(key));
+    }
+    merged.insert(merged.end(), nodes.begin() + i, nodes.end());
+    head = Build(merged.data(), static_cast<int>(merged.size()));
+  }
+  auto time2 = std::chrono::steady_clock::now();
+  work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time2 - time1);
+  lock_trace::Record(this, "AVLtree", "InsertBatch", true, time0, time1, time2);
+  if (metrics::Enabled()) {
+    stats.Record(time0, time1, time2, Size(head), Height(head));
+  }
+}
+
+void AVLtree::RemoveBatch(std::vector<int> keys) {
+  if (trace::Enabled()) {
+    for (int key : keys) {
+      trace::Record(trace::Kind::avl_tree, this, trace::Op::remove, key);
+    }
+  }
+  std::sort(keys.begin(), keys.end());
+  auto time0 = lock_trace::Begin();
+  std::lock_guard<std::shared_mutex> lock(mutex);
+  auto time1 = std::chrono::steady_clock::now();
+  auto th_id = std::this_thread::get_id();
+  if (!PreferRebuild(Size(head), keys.size())) {
+    for (int key : keys) {
+      if (FindByKey(head, key)) {
+        head = Remove(head, key);
+      }
+    }
+  }
+  else {
+    std::vector<node*> nodes;
+    Flatten(head, nodes);
+    // Каждый ключ набора удаляет не более одного узла, как Remove
+    std::vector<node*> kept;
+    kept.reserve(nodes.size());
+    size_t j = 0;
+    for (node* p : nodes) {
+      while (j < keys.size() && keys[j] < p->key) {
+        ++j;
+      }
+      if (j < keys.size() && keys[j] == p->key) {
+        ++j;
+        delete p;
+      }
+      else {
+        kept.push_back(p);
+      }
+    }
+    head = Build(kept.data(), static_cast<int>(kept.size()));
+  }
+  auto time2 = std::chrono::steady_clock::now();
+  work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time2 - time1);
+  lock_trace::Record(this, "AVLtree", "RemoveBatch", true, time0, time1, time2);
+  if (metrics::Enabled()) {
+    stats.Record(time0, time1, time2, Size(head), Height(head));
+  }
+}
+
+void AVLtree::Split(const int key, AVLtree& right) {
+  if (this == &right) {
+    return;
+  }
+  auto time0 = lock_trace::Begin();
+  std::scoped_lock lock(mutex, right.mutex);
+  auto time1 = std::chrono::steady_clock::now();
+  auto th_id = std::this_thread::get_id();
+  node* old_right = right.head;
+  node* left = nullptr;
+  int size_left = 0;
+  Split(head, key, false, left, right.head, size_left);
+  head = left;
+  auto time2 = std::chrono::steady_clock::now();
+  work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time2 - time1);
+  lock_trace::Record(this, "AVLtree", "Split", true, time0, time1, time2);
+  if (metrics::Enabled()) {
+    stats.Record(time0, time1, time2, Size(head), Height(head));
+    right.stats.Gauge(Size(right.head), Height(right.head));
+  }
+  Clear(old_right);
+}
+
+void AVLtree::Join(AVLtree& right) {
+  if (this == &right) {
+    return;
+  }
+  auto time0 = lock_trace::Begin();
+  std::scoped_lock lock(mutex, right.mutex);
+  auto time1 = std::chrono::steady_clock::now();
+  auto th_id = std::this_thread::get_id();
+  node* max_node = head;
+  while (max_node && max_node->right) {
+    max_node = max_node->right;
+  }
+  node* min_node = right.head ? FindMin(right.head) : nullptr;
+  int size = 0;
+  if (!max_node || !min_node || max_node->key < min_node->key) {
+    head = Join2(head, right.head, Size(head));
+  }
+  else {
+    head = Union(head, Size(head), right.head, Size(right.head), size, 0);
+  }
+  right.head = nullptr;
+  auto time2 = std::chrono::steady_clock::now();
+  work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time2 - time1);
+  lock_trace::Record(this, "AVLtree", "Join", true, time0, time1, time2);
+  if (metrics::Enabled()) {
+    stats.Record(time0, time1, time2, Size(head), Height(head));
+    right.stats.Gauge(Size(right.head), Height(right.head));
+  }
+}
+
+void AVLtree::Union(AVLtree& other) {
+  if (this == &other) {
+    return;
+  }
+  auto time0 = lock_trace::Begin();
+  std::scoped_lock lock(mutex, other.mutex);
+  auto time1 = std::chrono::steady_clock::now();
+  auto th_id = std::this_thread::get_id();
+  int size = 0;
+  head = Union(head, Size(head), other.head, Size(other.head), size, 0);
+  other.head = nullptr;
+  auto time2 = std::chrono::steady_clock::now();
+  work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time2 - time1);
+  lock_trace::Record(this, "AVLtree", "Union", true, time0, time1, time2);
+  if (metrics::Enabled()) {
+    stats.Record(time0, time1, time2, Size(head), Height(head));
+    other.stats.Gauge(Size(other.head), Height(other.head));
+  }
+}
+
+void AVLtree::Difference(const AVLtree& other) {
+  node* removed = nullptr;
+  if (this == &other) {
+    std::lock_guard<std::shared_mutex> lock(mutex);
+    std::swap(head, removed);
+  }
+  else {
+    std::unique_lock<std::shared_mutex> lock(mutex, std::defer_lock);
+    std::shared_lock<std::shared_mutex> lock_other(other.mutex, std::defer_lock);
+    auto time0 = lock_trace::Begin();
+    std::lock(lock, lock_other);
+    auto time1 = std::chrono::steady_clock::now();
+    auto th_id = std::this_thread::get_id();
+    int size = 0;
+    head = Difference(head, Size(head), other.head, Size(other.head), size, 0);
+    auto time2 = std::chrono::steady_clock::now();
+    work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time2 - time1);
+    lock_trace::Record(this, "AVLtree", "Difference", true, time0, time1, time2);
+    if (metrics::Enabled()) {
+      stats.Record(time0, time1, time2, Size(head), Height(head));
+    }
+  }
+  Clear(removed);
+}
+
+void AVLtree::Intersection(const AVLtree& other) {
+  if (this == &other) {
+    return;
+  }
+  std::unique_lock<std::shared_mutex> lock(mutex, std::defer_lock);
+  std::shared_lock<std::shared_mutex> lock_other(other.mutex, std::defer_lock);
+  auto time0 = lock_trace::Begin();
+  std::lock(lock, lock_other);
+  auto time1 = std::chrono::steady_clock::now();
+  auto th_id = std::this_thread::get_id();
+  int size = 0;
+  head = Intersection(head, Size(head), other.head, Size(other.head), size, 0);
+  auto time2 = std::chrono::steady_clock::now();
+  work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time2 - time1);
+  lock_trace::Record(this, "AVLtree", "Intersection", true, time0, time1, time2);
+  if (metrics::Enabled()) {
+    stats.Record(time0, time1, time2, Size(head), Height(head));
+  }
+}
+
 void AVLtree::FixHeight(node* p) {
   unsigned char hleft = Height(p->left);
   unsigned char hright = Height(p->right);
   p->height = std::max(hleft, hright) + 1;
 }
 
-//    p
+// Правый поворот вокруг p
 AVLtree::node* AVLtree::RotateRight(node* p) {
   node* q = p->left;
   p->left = q->right;
@@ -71,7 +593,7 @@ AVLtree::node* AVLtree::RotateLeft(node* p) {
   return q;
 }
 
-//   p
+// Балансировка узла p
 AVLtree::node* AVLtree::Balance(node* p) {
   FixHeight(p);
   if (BFactor(p) == 2) {
@@ -89,7 +611,7 @@ AVLtree::node* AVLtree::Balance(node* p) {
   return p;
 }
 
-//   key     p
+// Вставка ключа key в дерево с корнем p
 AVLtree::node* AVLtree::Insert(node* p, int key) {
   if (!p) {
     return new node(key);
@@ -104,12 +626,12 @@ AVLtree::node* AVLtree::Insert(node* p, int key) {
   return Balance(p);
 }
 
-//        p
+// Поиск узла с минимальным ключом в дереве p
 AVLtree::node* AVLtree::FindMin(node* p) {
   return p->left ? FindMin(p->left) : p;
 }
 
-//        p
+// Удалеие узла с минимальным ключом из дерева p
 AVLtree::node* AVLtree::RemoveMin(node* p) {
   if (p->left == nullptr) {
     return p->right;
@@ -119,7 +641,7 @@ AVLtree::node* AVLtree::RemoveMin(node* p) {
   return Balance(p);
 }
 
-//   key   p
+// Удаление ключа key из дерева p
 AVLtree::node* AVLtree::Remove(node* p, const int key) {
   if (!p) {
     return nullptr;
@@ -150,7 +672,7 @@ AVLtree::node* AVLtree::Remove(node* p, const int key) {
   return Balance(p);
 }
 
-//  k-    p
+// Поиск k-го элемента в дереве p
 AVLtree::node* AVLtree::FindByRank(node* p, const int k) {
   if (!p) {
     return nullptr;
@@ -164,7 +686,7 @@ AVLtree::node* AVLtree::FindByRank(node* p, const int k) {
   return FindByRank(p->right, k - p->rank);
 }
 
-//   key   p
+// Поиск ключа key в дереве p
 AVLtree::node* AVLtree::FindByKey(node* p, const int key) {
   if (!p || p->key == key) {
     return p;
@@ -172,5 +694,351 @@ AVLtree::node* AVLtree::FindByKey(node* p, const int key) {
   if (key < p->key) {
     return FindByKey(p->left, key);
   }
-  return FindByRank(p->right, key);
+  return FindByKey(p->right, key);
+}
+
+// Ответы на запросы order[first, last), упорядоченные по ranks; offset - число узлов левее p.
+// Спуск продолжается циклом, а рекурсия нужна, только когда запросы расходятся в обе ветви
+void AVLtree::FindByRankBatch(node* p, const int* ranks, int* first, int* last, int offset,
+                              int* vals, std::vector<bool>& found) {
+  while (p && first != last) {
+    int rank = offset + p->rank;
+    int* mid = std::lower_bound(first, last, rank, [ranks](int i, int r) { return ranks[i] < r; });
+    int* high = mid;
+    for (; high != last && ranks[*high] == rank; ++high) {
+      vals[*high] = p->key;
+      found[*high] = true;
+    }
+    if (mid != first && high != last) {
+      Prefetch(p->right);
+      FindByRankBatch(p->left, ranks, first, mid, offset, vals, found);
+    }
+    if (high == last) {
+      p = p->left;
+      last = mid;
+    }
+    else {
+      p = p->right;
+      offset = rank;
+      first = high;
+    }
+  }
+}
+
+// Ответы на запросы order[first, last), упорядоченные по keys
+void AVLtree::FindByKeyBatch(node* p, const int* keys, int* first, int* last, std::vector<bool>& found) {
+  while (p && first != last) {
+    int key = p->key;
+    int* mid = std::lower_bound(first, last, key, [keys](int i, int k) { return keys[i] < k; });
+    int* high = mid;
+    for (; high != last && keys[*high] == key; ++high) {
+      found[*high] = true;
+    }
+    if (mid != first && high != last) {
+      Prefetch(p->right);
+      FindByKeyBatch(p->left, keys, first, mid, found);
+    }
+    if (high == last) {
+      p = p->left;
+      last = mid;
+    }
+    else {
+      p = p->right;
+      first = high;
+    }
+  }
+}
+
+// Первый узел с ключом не меньше (strict: больше) key в дереве p
+AVLtree::node* AVLtree::LowerBound(node* p, const int key, bool strict) {
+  node* res = nullptr;
+  while (p) {
+    if (key < p->key || (!strict && key == p->key)) {
+      res = p;
+      p = p->left;
+    }
+    else {
+      p = p->right;
+    }
+  }
+  return res;
+}
+
+// Количество ключей, меньших key, в дереве p
+int AVLtree::CountLess(node* p, const int key) {
+  int count = 0;
+  while (p) {
+    if (p->key < key) {
+      count += p->rank;
+      p = p->right;
+    }
+    else {
+      p = p->left;
+    }
+  }
+  return count;
+}
+
+// Обход ключей из [lo, hi) в дереве p
+void AVLtree::VisitRange(node* p, const int lo, const int hi, const std::function<void(int)>& visitor) {
+  if (!p) {
+    return;
+  }
+  if (lo <= p->key) {
+    VisitRange(p->left, lo, hi, visitor);
+  }
+  if (lo <= p->key && p->key < hi) {
+    visitor(p->key);
+  }
+  if (p->key < hi) {
+    VisitRange(p->right, lo, hi, visitor);
+  }
+}
+
+// Число узлов в дереве p: сумма рангов вдоль правой ветви
+int AVLtree::Size(node* p) {
+  int size = 0;
+  for (; p; p = p->right) {
+    size += p->rank;
+  }
+  return size;
+}
+
+// Сбалансированное дерево из n упорядоченных узлов
+AVLtree::node* AVLtree::Build(node* const* nodes, const int n) {
+  if (n == 0) {
+    return nullptr;
+  }
+  int mid = n / 2;
+  node* p = nodes[mid];
+  p->left = Build(nodes, mid);
+  p->right = Build(nodes + mid + 1, n - mid - 1);
+  p->rank = mid + 1;
+  FixHeight(p);
+  return p;
+}
+
+// Узлы дерева p в порядке возрастания ключей
+void AVLtree::Flatten(node* p, std::vector<node*>& nodes) {
+  if (!p) {
+    return;
+  }
+  Flatten(p->left, nodes);
+  nodes.push_back(p);
+  Flatten(p->right, nodes);
+}
+
+// Удаление всех узлов дерева p
+void AVLtree::Clear(node* p) {
+  if (!p) {
+    return;
+  }
+  Clear(p->left);
+  Clear(p->right);
+  delete p;
+}
+
+// Выгоднее ли перестроить дерево из n узлов, чем изменить m ключей по одному
+bool AVLtree::PreferRebuild(const size_t n, const size_t m) {
+  size_t log_n = 1;
+  while ((size_t(1) << log_n) <= n) {
+    ++log_n;
+  }
+  return m * log_n >= n;
+}
+
+// Соединение деревьев left < k < right, size_left - число узлов left
+AVLtree::node* AVLtree::Join(node* left, node* k, node* right, const int size_left) {
+  if (Height(left) > Height(right) + 1) {
+    return JoinRight(left, k, right, size_left);
+  }
+  if (Height(right) > Height(left) + 1) {
+    return JoinLeft(right, k, left, size_left);
+  }
+  k->left = left;
+  k->right = right;
+  k->rank = size_left + 1;
+  FixHeight(k);
+  return k;
+}
+
+// Соединение по правой ветви p, если p выше right
+AVLtree::node* AVLtree::JoinRight(node* p, node* k, node* right, const int size_p) {
+  int size_c = size_p - p->rank;
+  if (Height(p->right) <= Height(right) + 1) {
+    k->left = p->right;
+    k->right = right;
+    k->rank = size_c + 1;
+    FixHeight(k);
+    p->right = k;
+  }
+  else {
+    p->right = JoinRight(p->right, k, right, size_c);
+  }
+  return Balance(p);
+}
+
+// Соединение по левой ветви p, если p выше left
+AVLtree::node* AVLtree::JoinLeft(node* p, node* k, node* left, const int size_left) {
+  p->rank += size_left + 1;
+  if (Height(p->left) <= Height(left) + 1) {
+    k->left = left;
+    k->right = p->left;
+    k->rank = size_left + 1;
+    FixHeight(k);
+    p->left = k;
+  }
+  else {
+    p->left = JoinLeft(p->left, k, left, size_left);
+  }
+  return Balance(p);
+}
+
+// Соединение деревьев left < right без разделяющего ключа
+AVLtree::node* AVLtree::Join2(node* left, node* right, const int size_left) {
+  if (!right) {
+    return left;
+  }
+  node* min_node = FindMin(right);
+  right = RemoveMin(right);
+  return Join(left, min_node, right, size_left);
+}
+
+// Разрезание дерева p: в left ключи меньше key (при inclusive - не больше key), в right остальные;
+// все повторы ключа key попадают в одну часть
+void AVLtree::Split(node* p, const int key, const bool inclusive, node*& left, node*& right, int& size_left) {
+  if (!p) {
+    left = right = nullptr;
+    size_left = 0;
+    return;
+  }
+  node* l = p->left;
+  node* r = p->right;
+  if (p->key < key || (inclusive && p->key == key)) {
+    node* mid = nullptr;
+    int size_mid = 0;
+    Split(r, key, inclusive, mid, right, size_mid);
+    size_left = p->rank + size_mid;
+    left = Join(l, p, mid, p->rank - 1);
+    return;
+  }
+  node* mid = nullptr;
+  Split(l, key, inclusive, left, mid, size_left);
+  int size_mid = p->rank - 1 - size_left;
+  right = Join(mid, p, r, size_mid);
+}
+
+// Объединение деревьев a и b, оба дерева поглощаются результатом, повторы сохраняются
+AVLtree::node* AVLtree::Union(node* a, const int size_a, node* b, const int size_b, int& size, const int depth) {
+  if (!a || !b) {
+    size = size_a + size_b;
+    return a ? a : b;
+  }
+  node* left_a = nullptr;
+  node* right_a = nullptr;
+  int size_left_a = 0;
+  Split(a, b->key, false, left_a, right_a, size_left_a);
+  int size_right_a = size_a - size_left_a;
+  node* left_b = b->left;
+  node* right_b = b->right;
+  int size_left_b = b->rank - 1;
+  int size_right_b = size_b - b->rank;
+  int size_left = 0, size_right = 0;
+  node* left = nullptr;
+  node* right = nullptr;
+  if (Fork(size_left_a, size_left_b, depth)) {
+    auto task = std::async(std::launch::async, [&] {
+      return Union(left_a, size_left_a, left_b, size_left_b, size_left, depth + 1);
+    });
+    right = Union(right_a, size_right_a, right_b, size_right_b, size_right, depth + 1);
+    left = task.get();
+  }
+  else {
+    left = Union(left_a, size_left_a, left_b, size_left_b, size_left, depth + 1);
+    right = Union(right_a, size_right_a, right_b, size_right_b, size_right, depth + 1);
+  }
+  size = size_left + 1 + size_right;
+  return Join(left, b, right, size_left);
+}
+
+// Разность a \ b: из a удаляются все копии ключей, которые есть в b; дерево b не изменяется
+AVLtree::node* AVLtree::Difference(node* a, const int size_a, node* b, const int size_b, int& size, const int depth) {
+  if (!a || !b) {
+    size = size_a;
+    return a;
+  }
+  node* left_a = nullptr;
+  node* right_a = nullptr;
+  node* equal = nullptr;
+  int size_left_a = 0;
+  int size_equal = 0;
+  Split(a, b->key, false, left_a, right_a, size_left_a);
+  Split(right_a, b->key, true, equal, right_a, size_equal);
+  int size_right_a = size_a - size_left_a - size_equal;
+  Clear(equal);
+  int size_left_b = b->rank - 1;
+  int size_right_b = size_b - b->rank;
+  int size_left = 0, size_right = 0;
+  node* left = nullptr;
+  node* right = nullptr;
+  if (Fork(size_left_a, size_left_b, depth)) {
+    auto task = std::async(std::launch::async, [&] {
+      return Difference(left_a, size_left_a, b->left, size_left_b, size_left, depth + 1);
+    });
+    right = Difference(right_a, size_right_a, b->right, size_right_b, size_right, depth + 1);
+    left = task.get();
+  }
+  else {
+    left = Difference(left_a, size_left_a, b->left, size_left_b, size_left, depth + 1);
+    right = Difference(right_a, size_right_a, b->right, size_right_b, size_right, depth + 1);
+  }
+  size = size_left + size_right;
+  return Join2(left, right, size_left);
+}
+
+// Пересечение a и b: в a остаются все копии ключей, которые есть в b; дерево b не изменяется
+AVLtree::node* AVLtree::Intersection(node* a, const int size_a, node* b, const int size_b, int& size, const int depth) {
+  if (!a || !b) {
+    Clear(a);
+    size = 0;
+    return nullptr;
+  }
+  node* left_a = nullptr;
+  node* right_a = nullptr;
+  node* equal = nullptr;
+  int size_left_a = 0;
+  int size_equal = 0;
+  Split(a, b->key, false, left_a, right_a, size_left_a);
+  Split(right_a, b->key, true, equal, right_a, size_equal);
+  int size_right_a = size_a - size_left_a - size_equal;
+  int size_left_b = b->rank - 1;
+  int size_right_b = size_b - b->rank;
+  int size_left = 0, size_right = 0;
+  node* left = nullptr;
+  node* right = nullptr;
+  if (Fork(size_left_a, size_left_b, depth)) {
+    auto task = std::async(std::launch::async, [&] {
+      return Intersection(left_a, size_left_a, b->left, size_left_b, size_left, depth + 1);
+    });
+    right = Intersection(right_a, size_right_a, b->right, size_right_b, size_right, depth + 1);
+    left = task.get();
+  }
+  else {
+    left = Intersection(left_a, size_left_a, b->left, size_left_b, size_left, depth + 1);
+    right = Intersection(right_a, size_right_a, b->right, size_right_b, size_right, depth + 1);
+  }
+  size = size_left + size_equal + size_right;
+  return Join2(Join2(left, equal, size_left), right, size_left + size_equal);
+}
+
+// Стоит ли выполнять ветви рекурсии параллельно
+bool AVLtree::Fork(const int size_a, const int size_b, const int depth) {
+  static const int max_depth = [] {
+    int depth = 0;
+    for (unsigned threads = std::max(1u, std::thread::hardware_concurrency()); threads > 1; threads /= 2) {
+      ++depth;
+    }
+    return depth + 1;
+  }();
+  return depth < max_depth && size_a + size_b >= 1 << 14;
 }
@@ -2,17 +2,74 @@
 #define AVL_TREE
 #include <shared_mutex>
 #include <chrono>
+#include <functional>
 #include <map>
+#include <string>
+#include <vector>
+#include <thread>
+
+#include "common/cache_line.h"
+#include "instrumentation/metrics.h"
 
 class AVLtree {
 public:
+  AVLtree() = default;
+  ~AVLtree();
 
   void Insert(const int key);
-  void Remove(const int key);
+  bool Remove(const int key);
   bool FindByKey(const int key);
   bool FindByRank(const int rank, int& val);
+  int Size();
+
+  // Набор запросов под одной блокировкой на чтение: запросы сортируются
+  // и делятся в каждом узле при одном общем спуске от корня.
+  // vals[i] - элемент с рангом ranks[i], found[i] - найден ли он
+  void FindByRankBatch(const std::vector<int>& ranks, std::vector<int>& vals, std::vector<bool>& found);
+  // found[i] - есть ли в дереве ключ keys[i]
+  void FindByKeyBatch(const std::vector<int>& keys, std::vector<bool>& found);
+
+  // Первый элемент, не меньший key
+  bool LowerBound(const int key, int& val);
+  // Первый элемент, больший key
+  bool UpperBound(const int key, int& val);
+  // Порядковый номер элемента key (с 1)
+  bool RankOf(const int key, int& rank);
+  // Количество элементов из [lo, hi)
+  int CountInRange(const int lo, const int hi);
+  // Обход элементов из [lo, hi) по возрастанию под одной блокировкой на чтение
+  void VisitRange(const int lo, const int hi, const std::function<void(int)>& visitor);
+
+  // Построение сбалансированного дерева из отсортированных ключей за O(n)
+  void BuildFromSorted(const std::vector<int>& keys);
+  // Вставка и удаление набора ключей под одной блокировкой на запись
+  void InsertBatch(std::vector<int> keys);
+  void RemoveBatch(std::vector<int> keys);
 
-  std::map<std::thread::id, std::chrono::nanoseconds> work;
+  // Операции над деревьями как над мультимножествами ключей
+  // Разрезание: ключи, не меньшие key, со всеми повторами переносятся в right
+  // (прежнее содержимое right удаляется)
+  void Split(const int key, AVLtree& right);
+  // Присоединение right; если ключи пересекаются, выполняется Union
+  void Join(AVLtree& right);
+  // Объединение с other, узлы other переносятся в дерево, other становится пустым;
+  // повторы сохраняются: число копий ключа - сумма копий в обоих деревьях
+  void Union(AVLtree& other);
+  // Удаление всех копий ключей, содержащихся в other, сколько бы раз они там ни встречались
+  void Difference(const AVLtree& other);
+  // Оставить только ключи, содержащиеся в other, со всеми их копиями в дереве
+  void Intersection(const AVLtree& other);
+
+  // Запись ключей в файл по возрастанию под блокировкой на чтение;
+  // delta - хранить разности соседних ключей в varint вместо 4 байт на ключ
+  bool SaveSnapshot(const std::string& path, const bool delta = true);
+  // Загрузка снимка с проверкой контрольной суммы и построением дерева за O(n);
+  // при любой ошибке дерево не меняется
+  bool LoadSnapshot(const std::string& path);
+
+  // Статистика, корень и блокировка разнесены по разным строкам кэша
+  alignas(cache_line_size) std::map<std::thread::id, std::chrono::nanoseconds> work;
+  metrics::LockStats stats{"AVLtree"};
 
 private:
   struct node {
@@ -28,32 +85,73 @@ private:
   static unsigned char Height(node* p) { return p ? p->height : 0; }
   static int BFactor(node* p) { return Height(p->right) - Height(p->left); }
   static int Rank(node* p) { return p ? p->rank : 0; }
+  // Число узлов в дереве p
+  static int Size(node* p);
   static void FixHeight(node* p);
 
-  //    p
+  // Правый поворот вокруг p
   static node* RotateRight(node* p);
-  //    p
+  // Левый поворот вокруг p
   static node* RotateLeft(node* p);
-  //   p
+  // Балансировка узла p
   static node* Balance(node* p);
 
-  //   key     p
+  // Вставка ключа key в дерево с корнем p
   static node* Insert(node* p, const int key);
   
-  //        p
+  // Поиск узла с минимальным ключом в дереве p
   static node* FindMin(node* p);
-  //        p
+  // Удалеие узла с минимальным ключом из дерева p
   static node* RemoveMin(node* p);
-  //   key   p
+  // Удаление ключа key из дерева p
   static node* Remove(node* p, const int key);
   
-  //   key   p
+  // Поиск ключа key в дереве p
   static node* FindByKey(node* p, const int key);
-  //  k-    p
+  // Поиск k-го элемента в дереве p
   static node* FindByRank(node* p, const int k);
+  // Ответы на запросы order[first, last), упорядоченные по ranks; offset - число узлов левее p
+  static void FindByRankBatch(node* p, const int* ranks, int* first, int* last, int offset,
+                              int* vals, std::vector<bool>& found);
+  // Ответы на запросы order[first, last), упорядоченные по keys
+  static void FindByKeyBatch(node* p, const int* keys, int* first, int* last, std::vector<bool>& found);
+  // Первый узел с ключом не меньше (strict: больше) key в дереве p
+  static node* LowerBound(node* p, const int key, bool strict);
+  // Количество ключей, меньших key, в дереве p
+  static int CountLess(node* p, const int key);
+  // Обход ключей из [lo, hi) в дереве p
+  static void VisitRange(node* p, const int lo, const int hi, const std::function<void(int)>& visitor);
+
+  // Сбалансированное дерево из n упорядоченных узлов
+  static node* Build(node* const* nodes, const int n);
+  // Узлы дерева p в порядке возрастания ключей
+  static void Flatten(node* p, std::vector<node*>& nodes);
+  // Удаление всех узлов дерева p
+  static void Clear(node* p);
+  // Соединение деревьев left < k < right, size_left - число узлов left
+  static node* Join(node* left, node* k, node* right, const int size_left);
+  // Соединение по правой ветви left, если left выше right
+  static node* JoinRight(node* p, node* k, node* right, const int size_p);
+  // Соединение по левой ветви right, если right выше left
+  static node* JoinLeft(node* p, node* k, node* left, const int size_left);
+  // Соединение деревьев left < right без разделяющего ключа
+  static node* Join2(node* left, node* right, const int size_left);
+  // Разрезание дерева p: в left ключи меньше key (при inclusive - не больше key), в right остальные
+  static void Split(node* p, const int key, const bool inclusive, node*& left, node*& right, int& size_left);
+  // Объединение деревьев a и b, оба дерева поглощаются результатом, повторы сохраняются
+  static node* Union(node* a, const int size_a, node* b, const int size_b, int& size, const int depth);
+  // Разность a \ b: из a удаляются все копии ключей, которые есть в b; дерево b не изменяется
+  static node* Difference(node* a, const int size_a, node* b, const int size_b, int& size, const int depth);
+  // Пересечение a и b: в a остаются все копии ключей, которые есть в b; дерево b не изменяется
+  static node* Intersection(node* a, const int size_a, node* b, const int size_b, int& size, const int depth);
+  // Стоит ли выполнять ветви рекурсии параллельно
+  static bool Fork(const int size_a, const int size_b, const int depth);
+
+  // Выгоднее ли перестроить дерево из n узлов, чем изменить m ключей по одному
+  static bool PreferRebuild(const size_t n, const size_t m);
 
-  node* head;
-  mutable std::shared_mutex mutex;
+  alignas(cache_line_size) node* head = nullptr;
+  alignas(cache_line_size) mutable std::shared_mutex mutex;
 };
 
 #endif // !AVL_TREE
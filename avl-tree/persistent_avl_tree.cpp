@@ -0,0 +1,234 @@
+#include "persistent_avl_tree.h"
+#include "snapshot_format.h"
+#include <algorithm>
+#include <cstdio>
+
+namespace {
+
+// Сколько замененных версий копится до ожидания эпохи
+const size_t retire_batch = 64;
+
+}
+
+PersistentAVLtree::node::node(int k, node_ptr l, node_ptr r, int rk)
+  :key(k), rank(rk), left(std::move(l)), right(std::move(r)) {
+  height = std::max(Height(left), Height(right)) + 1;
+}
+
+PersistentAVLtree::PersistentAVLtree()
+  :current(new version{ nullptr, 0 }) {}
+
+PersistentAVLtree::~PersistentAVLtree() {
+  for (const version* v : retired) {
+    delete v;
+  }
+  delete current.load();
+}
+
+void PersistentAVLtree::Insert(const int key) {
+  std::lock_guard<std::mutex> lock(writer_mutex);
+  auto time1 = std::chrono::steady_clock::now();
+  auto th_id = std::this_thread::get_id();
+  Publish(Insert(current.load()->root, key));
+  auto time2 = std::chrono::steady_clock::now();
+  work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time2 - time1);
+}
+
+void PersistentAVLtree::Remove(const int key) {
+  std::lock_guard<std::mutex> lock(writer_mutex);
+  auto time1 = std::chrono::steady_clock::now();
+  auto th_id = std::this_thread::get_id();
+  node_ptr root = current.load()->root;
+  if (FindByKey(root.get(), key)) {
+    Publish(Remove(root, key));
+  }
+  auto time2 = std::chrono::steady_clock::now();
+  work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time2 - time1);
+}
+
+// Одиночные запросы не копируют корень: версия жива, пока открыт участок чтения
+bool PersistentAVLtree::FindByKey(const int key) const {
+  EpochDomain::Guard guard(epoch);
+  return FindByKey(current.load()->root.get(), key) != nullptr;
+}
+
+bool PersistentAVLtree::FindByRank(const int rank, int& val) const {
+  EpochDomain::Guard guard(epoch);
+  const node* res = FindByRank(current.load()->root.get(), rank);
+  if (res != nullptr) {
+    val = res->key;
+  }
+  return res != nullptr;
+}
+
+PersistentAVLtree::Snapshot PersistentAVLtree::GetSnapshot() const {
+  EpochDomain::Guard guard(epoch);
+  const version* v = current.load();
+  return Snapshot(v->root, v->number);
+}
+
+bool PersistentAVLtree::Snapshot::FindByKey(const int key) const {
+  return PersistentAVLtree::FindByKey(root.get(), key) != nullptr;
+}
+
+bool PersistentAVLtree::Snapshot::FindByRank(const int rank, int& val) const {
+  const node* res = PersistentAVLtree::FindByRank(root.get(), rank);
+  if (res != nullptr) {
+    val = res->key;
+  }
+  return res != nullptr;
+}
+
+// rank узла - размер левого поддерева плюс один, поэтому размер дерева - сумма по правой ветви
+int PersistentAVLtree::Snapshot::Size() const {
+  int res = 0;
+  for (const node* p = root.get(); p; p = p->right.get()) {
+    res += p->rank;
+  }
+  return res;
+}
+
+bool PersistentAVLtree::Snapshot::Save(const std::string& path, const bool delta) const {
+  FILE* out = std::fopen(path.c_str(), "wb");
+  if (!out) {
+    return false;
+  }
+  avl_snapshot::Writer writer(out, delta);
+  writer.Header(Size());
+  std::vector<const node*> path_stack;
+  for (const node* p = root.get(); p || !path_stack.empty();) {
+    if (p) {
+      path_stack.push_back(p);
+      p = p->left.get();
+      continue;
+    }
+    p = path_stack.back();
+    path_stack.pop_back();
+    writer.Key(p->key);
+    p = p->right.get();
+  }
+  bool ok = writer.Finish();
+  ok = std::fclose(out) == 0 && ok;
+  return ok;
+}
+
+// Вызывается только под writer_mutex
+void PersistentAVLtree::Publish(node_ptr root) {
+  const version* old = current.load(std::memory_order_relaxed);
+  current.store(new version{ std::move(root), old->number + 1 });
+  retired.push_back(old);
+  if (retired.size() >= retire_batch) {
+    epoch.Synchronize();
+    for (const version* v : retired) {
+      delete v;
+    }
+    retired.clear();
+  }
+}
+
+// Правый поворот вокруг p
+PersistentAVLtree::node_ptr PersistentAVLtree::RotateRight(const node_ptr& p) {
+  const node_ptr& q = p->left;
+  node_ptr new_p = std::make_shared<const node>(p->key, q->right, p->right, p->rank - q->rank);
+  return std::make_shared<const node>(q->key, q->left, std::move(new_p), q->rank);
+}
+
+// Левый поворот вокруг узла (key, left, right, rank)
+PersistentAVLtree::node_ptr PersistentAVLtree::RotateLeft(int key, const node_ptr& left,
+                                                          const node_ptr& right, int rank) {
+  node_ptr new_p = std::make_shared<const node>(key, left, right->left, rank);
+  return std::make_shared<const node>(right->key, std::move(new_p), right->right, right->rank + rank);
+}
+
+PersistentAVLtree::node_ptr PersistentAVLtree::RotateLeft(const node_ptr& p) {
+  return RotateLeft(p->key, p->left, p->right, p->rank);
+}
+
+// Новый сбалансированный узел из ключа и поддеревьев
+PersistentAVLtree::node_ptr PersistentAVLtree::Balance(int key, node_ptr left, node_ptr right, int rank) {
+  int bfactor = Height(right) - Height(left);
+  if (bfactor == 2) {
+    if (BFactor(right) < 0) {
+      right = RotateRight(right);
+    }
+    return RotateLeft(key, left, right, rank);
+  }
+  if (bfactor == -2) {
+    if (BFactor(left) > 0) {
+      left = RotateLeft(left);
+    }
+    // Правый поворот без промежуточной копии узла p
+    node_ptr new_p = std::make_shared<const node>(key, left->right, std::move(right), rank - left->rank);
+    return std::make_shared<const node>(left->key, left->left, std::move(new_p), left->rank);
+  }
+  return std::make_shared<const node>(key, std::move(left), std::move(right), rank);
+}
+
+// Вставка ключа key в дерево с корнем p
+PersistentAVLtree::node_ptr PersistentAVLtree::Insert(const node_ptr& p, const int key) {
+  if (!p) {
+    return std::make_shared<const node>(key, nullptr, nullptr, 1);
+  }
+  if (key < p->key) {
+    return Balance(p->key, Insert(p->left, key), p->right, p->rank + 1);
+  }
+  return Balance(p->key, p->left, Insert(p->right, key), p->rank);
+}
+
+// Поиск узла с минимальным ключом в дереве p
+const PersistentAVLtree::node* PersistentAVLtree::FindMin(const node* p) {
+  return p->left ? FindMin(p->left.get()) : p;
+}
+
+// Удаление узла с минимальным ключом из дерева p
+PersistentAVLtree::node_ptr PersistentAVLtree::RemoveMin(const node_ptr& p) {
+  if (p->left == nullptr) {
+    return p->right;
+  }
+  return Balance(p->key, RemoveMin(p->left), p->right, p->rank - 1);
+}
+
+// Удаление ключа key из дерева p
+PersistentAVLtree::node_ptr PersistentAVLtree::Remove(const node_ptr& p, const int key) {
+  if (!p) {
+    return nullptr;
+  }
+  if (key < p->key) {
+    return Balance(p->key, Remove(p->left, key), p->right, p->rank - 1);
+  }
+  if (key > p->key) {
+    return Balance(p->key, p->left, Remove(p->right, key), p->rank);
+  }
+  // key == p->key
+  if (!p->right) {
+    return p->left;
+  }
+  const node* min_node = FindMin(p->right.get());
+  return Balance(min_node->key, p->left, RemoveMin(p->right), p->rank);
+}
+
+// Поиск k-го элемента в дереве p
+const PersistentAVLtree::node* PersistentAVLtree::FindByRank(const node* p, const int rank) {
+  int k = rank;
+  while (p) {
+    if (k == p->rank) {
+      return p;
+    }
+    if (k < p->rank) {
+      p = p->left.get();
+    }
+    else {
+      k -= p->rank;
+      p = p->right.get();
+    }
+  }
+  return nullptr;
+}
+
+// Поиск ключа key в дереве p
+const PersistentAVLtree::node* PersistentAVLtree::FindByKey(const node* p, const int key) {
+  while (p && p->key != key) {
+    p = key < p->key ? p->left.get() : p->right.get();
+  }
+  return p;
+}
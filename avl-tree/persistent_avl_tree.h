@@ -0,0 +1,110 @@
+#ifndef PERSISTENT_AVL_TREE
+#define PERSISTENT_AVL_TREE
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "common/epoch.h"
+
+// AVL-дерево с копированием пути: Insert/Remove создают новые O(log n) узлов
+// и атомарно публикуют новую версию - обычный указатель на корень и номер.
+// Читатели берут версию без блокировок, отмечаясь только в счетчике эпохи.
+// Прежние версии освобождаются пачками после ожидания эпохи, а узлы -
+// подсчетом ссылок, когда их больше не видит ни одна версия или снимок.
+class PersistentAVLtree {
+private:
+  struct node;
+  using node_ptr = std::shared_ptr<const node>;
+
+public:
+  class Snapshot {
+  public:
+    bool FindByKey(const int key) const;
+    bool FindByRank(const int rank, int& val) const;
+    int Size() const;
+    uint64_t Version() const { return version; }
+    // Запись снимка в формате AVLtree::SaveSnapshot; версия неизменна, поэтому
+    // писатели не ждут, а файл согласован. Загружается AVLtree::LoadSnapshot
+    bool Save(const std::string& path, const bool delta = true) const;
+
+  private:
+    friend class PersistentAVLtree;
+    Snapshot(node_ptr r, uint64_t v) : root(std::move(r)), version(v) {}
+
+    node_ptr root;
+    uint64_t version;
+  };
+
+  PersistentAVLtree();
+  ~PersistentAVLtree();
+  PersistentAVLtree(const PersistentAVLtree&) = delete;
+  PersistentAVLtree& operator=(const PersistentAVLtree&) = delete;
+
+  void Insert(const int key);
+  void Remove(const int key);
+  bool FindByKey(const int key) const;
+  bool FindByRank(const int rank, int& val) const;
+  // Согласованный снимок текущей версии дерева
+  Snapshot GetSnapshot() const;
+
+  // Время работы писателей; читатели блокировок не берут и сюда не пишут
+  std::map<std::thread::id, std::chrono::nanoseconds> work;
+
+private:
+  struct node {
+    int key;
+    int rank;
+    unsigned char height;
+    node_ptr left;
+    node_ptr right;
+    node(int k, node_ptr l, node_ptr r, int rk);
+  };
+
+  struct version {
+    node_ptr root;
+    uint64_t number;
+  };
+
+  static unsigned char Height(const node_ptr& p) { return p ? p->height : 0; }
+  static int BFactor(const node_ptr& p) { return Height(p->right) - Height(p->left); }
+
+  // Правый поворот вокруг p
+  static node_ptr RotateRight(const node_ptr& p);
+  // Левый поворот вокруг узла (key, left, right, rank)
+  static node_ptr RotateLeft(int key, const node_ptr& left, const node_ptr& right, int rank);
+  static node_ptr RotateLeft(const node_ptr& p);
+  // Новый сбалансированный узел из ключа и поддеревьев
+  static node_ptr Balance(int key, node_ptr left, node_ptr right, int rank);
+
+  // Вставка ключа key в дерево с корнем p
+  static node_ptr Insert(const node_ptr& p, const int key);
+
+  // Поиск узла с минимальным ключом в дереве p
+  static const node* FindMin(const node* p);
+  // Удаление узла с минимальным ключом из дерева p
+  static node_ptr RemoveMin(const node_ptr& p);
+  // Удаление ключа key из дерева p
+  static node_ptr Remove(const node_ptr& p, const int key);
+
+  // Поиск ключа key в дереве p
+  static const node* FindByKey(const node* p, const int key);
+  // Поиск k-го элемента в дереве p
+  static const node* FindByRank(const node* p, const int rank);
+
+  // Вызывается только под writer_mutex
+  void Publish(node_ptr root);
+
+  std::atomic<const version*> current;
+  // Замененные версии, которые еще могут читать
+  std::vector<const version*> retired;
+  mutable EpochDomain epoch;
+  std::mutex writer_mutex;
+};
+
+#endif // !PERSISTENT_AVL_TREE
@@ -0,0 +1,146 @@
+#include "sharded_avl_tree.h"
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <mutex>
+
+ShardedAVLtree::ShardedAVLtree(const int shard_count)
+  :counts(new std::atomic<int>[std::max(shard_count, 1)]),
+   fenwick(new std::atomic<int>[std::max(shard_count, 1) + 1]), size(0) {
+  int n = std::max(shard_count, 1);
+  for (int i = 0; i < n; ++i) {
+    shards.emplace_back(new AVLtree);
+    counts[i] = 0;
+  }
+  for (int i = 0; i <= n; ++i) {
+    fenwick[i] = 0;
+  }
+  // Пока данных нет, диапазон int делится поровну
+  int64_t step = ((int64_t)INT_MAX - INT_MIN + 1) / n;
+  for (int i = 1; i < n; ++i) {
+    bounds.push_back(static_cast<int>(INT_MIN + step * i));
+  }
+}
+
+void ShardedAVLtree::Insert(const int key) {
+  int shard = 0;
+  {
+    std::shared_lock<std::shared_mutex> lock(routing_mutex);
+    shard = ShardOf(key);
+    shards[shard]->Insert(key);
+    AddSize(shard, 1);
+  }
+  if (Skewed(shard)) {
+    std::unique_lock<std::shared_mutex> lock(routing_mutex, std::try_to_lock);
+    if (lock.owns_lock() && Skewed(shard)) {
+      RebalanceLocked();
+    }
+  }
+}
+
+bool ShardedAVLtree::Remove(const int key) {
+  std::shared_lock<std::shared_mutex> lock(routing_mutex);
+  int shard = ShardOf(key);
+  bool removed = shards[shard]->Remove(key);
+  if (removed) {
+    AddSize(shard, -1);
+  }
+  return removed;
+}
+
+bool ShardedAVLtree::FindByKey(const int key) {
+  std::shared_lock<std::shared_mutex> lock(routing_mutex);
+  return shards[ShardOf(key)]->FindByKey(key);
+}
+
+bool ShardedAVLtree::FindByRank(const int rank, int& val) {
+  std::shared_lock<std::shared_mutex> lock(routing_mutex);
+  int local = rank;
+  int shard = ShardByRank(local);
+  if (shard < 0) {
+    return false;
+  }
+  return shards[shard]->FindByRank(local, val);
+}
+
+void ShardedAVLtree::Rebalance() {
+  std::lock_guard<std::shared_mutex> lock(routing_mutex);
+  RebalanceLocked();
+}
+
+// Вызывается под исключительной блокировкой routing_mutex
+void ShardedAVLtree::RebalanceLocked() {
+  int n = ShardCount();
+  // Шарды упорядочены по ключам, поэтому собираются в одно дерево соединениями за O(log size)
+  for (int i = 1; i < n; ++i) {
+    shards[0]->Join(*shards[i]);
+  }
+  int total = shards[0]->Size();
+  for (int i = n - 1; i > 0; --i) {
+    int bound = bounds[i - 1];
+    int rank = static_cast<int>((int64_t)total * i / n) + 1;
+    if (rank <= total) {
+      shards[0]->FindByRank(rank, bound);
+    }
+    // Границы должны оставаться неубывающими
+    if (i < n - 1) {
+      bound = std::min(bound, bounds[i]);
+    }
+    bounds[i - 1] = bound;
+    shards[0]->Split(bound, *shards[i]);
+  }
+  size = 0;
+  for (int i = 0; i <= n; ++i) {
+    fenwick[i] = 0;
+  }
+  for (int i = 0; i < n; ++i) {
+    counts[i] = 0;
+    AddSize(i, shards[i]->Size());
+  }
+}
+
+// Номер шарда, отвечающего за key
+int ShardedAVLtree::ShardOf(const int key) const {
+  return static_cast<int>(std::upper_bound(bounds.begin(), bounds.end(), key) - bounds.begin());
+}
+
+// Изменение размера шарда в дереве Фенвика
+void ShardedAVLtree::AddSize(const int shard, const int delta) {
+  counts[shard].fetch_add(delta, std::memory_order_relaxed);
+  size.fetch_add(delta, std::memory_order_relaxed);
+  int n = ShardCount();
+  for (int i = shard + 1; i <= n; i += i & -i) {
+    fenwick[i].fetch_add(delta, std::memory_order_relaxed);
+  }
+}
+
+// Шард, содержащий элемент с глобальным рангом rank; rank становится рангом внутри шарда
+int ShardedAVLtree::ShardByRank(int& rank) const {
+  int n = ShardCount();
+  if (rank < 1) {
+    return -1;
+  }
+  int step = 1;
+  while (step * 2 <= n) {
+    step *= 2;
+  }
+  int pos = 0;
+  for (; step > 0; step /= 2) {
+    if (pos + step <= n) {
+      int count = fenwick[pos + step].load(std::memory_order_relaxed);
+      if (count < rank) {
+        pos += step;
+        rank -= count;
+      }
+    }
+  }
+  return pos < n ? pos : -1;
+}
+
+// Нужно ли перераспределить ключи после роста шарда
+bool ShardedAVLtree::Skewed(const int shard) const {
+  const int min_shard_size = 1024;
+  int count = counts[shard].load(std::memory_order_relaxed);
+  int average = Size() / ShardCount();
+  return count > min_shard_size && count > 2 * average + min_shard_size / 4;
+}
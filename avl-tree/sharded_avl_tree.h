@@ -0,0 +1,51 @@
+#ifndef SHARDED_AVL_TREE
+#define SHARDED_AVL_TREE
+#include "avl_tree.h"
+#include <atomic>
+#include <memory>
+#include <shared_mutex>
+#include <vector>
+
+// Упорядоченный индекс из N деревьев AVLtree, разбитых по диапазонам ключей.
+// Каждый шард защищен собственной блокировкой, размеры шардов хранятся
+// в дереве Фенвика из атомарных счетчиков, по которому FindByRank выбирает шард.
+// Границы шардов пересчитываются автоматически, когда один шард
+// становится заметно больше среднего.
+class ShardedAVLtree {
+public:
+  explicit ShardedAVLtree(const int shard_count = 16);
+
+  void Insert(const int key);
+  bool Remove(const int key);
+  bool FindByKey(const int key);
+  // Ранг глобальный; при параллельных изменениях результат может отставать
+  // на операции, которые еще не учтены в счетчиках
+  bool FindByRank(const int rank, int& val);
+  int Size() const { return size.load(std::memory_order_relaxed); }
+  int ShardCount() const { return static_cast<int>(shards.size()); }
+
+  // Пересчет границ: шарды получают примерно поровну ключей
+  void Rebalance();
+
+private:
+  // Номер шарда, отвечающего за key
+  int ShardOf(const int key) const;
+  // Изменение размера шарда в дереве Фенвика
+  void AddSize(const int shard, const int delta);
+  // Шард, содержащий элемент с глобальным рангом rank; rank становится рангом внутри шарда
+  int ShardByRank(int& rank) const;
+  // Нужно ли перераспределить ключи после роста шарда
+  bool Skewed(const int shard) const;
+  void RebalanceLocked();
+
+  std::vector<std::unique_ptr<AVLtree>> shards;
+  // bounds[i] - наименьший ключ шарда i + 1
+  std::vector<int> bounds;
+  std::unique_ptr<std::atomic<int>[]> counts;
+  std::unique_ptr<std::atomic<int>[]> fenwick;
+  std::atomic<int> size;
+  // Разделяемая для операций, исключительная для перестроения границ
+  mutable std::shared_mutex routing_mutex;
+};
+
+#endif // !SHARDED_AVL_TREE
@@ -0,0 +1,416 @@
+#include "skip_list.h"
+#include <algorithm>
+#include <climits>
+#include <functional>
+#include <new>
+#include <thread>
+
+namespace {
+
+std::atomic<uint64_t> next_list_id(1);
+
+// Текущий блок пула потока; id защищает от блоков уже удаленного списка
+struct PoolCache {
+  uint64_t owner = 0;
+  char* cur = nullptr;
+  char* end = nullptr;
+};
+
+// Несколько блоков на поток, чтобы поток мог работать с разными списками
+const int pool_cache_size = 4;
+thread_local PoolCache pool_cache[pool_cache_size];
+thread_local int pool_cache_victim = 0;
+
+const size_t block_size = 64 * 1024;
+
+// Сколько удаленных узлов копится до ожидания эпохи
+const size_t retire_batch = 256;
+
+}
+
+void SkipList::node::Lock() {
+  while (locked.exchange(true, std::memory_order_acquire)) {
+    while (locked.load(std::memory_order_relaxed)) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+SkipList::SkipList()
+  :size(0), upper(Pack(1, 0)), id(next_list_id.fetch_add(1)) {
+  for (std::atomic<int>& count : free_count) {
+    count.store(0, std::memory_order_relaxed);
+  }
+  head = Allocate(INT_MIN, max_level);
+  head->linked.store(true);
+}
+
+SkipList::~SkipList() {
+  for (char* block : blocks) {
+    delete[] block;
+  }
+}
+
+bool SkipList::Insert(const int key) {
+  node* preds[max_level];
+  node* succs[max_level];
+  const int height = RandomLevel();
+  node* x = Allocate(key, height);
+  {
+    EpochDomain::Guard guard(epoch);
+    while (true) {
+      int found = Find(key, preds, succs);
+      if (found != -1) {
+        node* f = succs[found];
+        if (f->marked.load()) {
+          // Ключ удаляется: повтор, пока узел не уберут
+          std::this_thread::yield();
+          continue;
+        }
+        while (!f->linked.load()) {
+          std::this_thread::yield();
+        }
+        Recycle({ x });
+        return false;
+      }
+      bool valid = true;
+      int locked = 0;
+      for (; valid && locked < height; ++locked) {
+        node* pred = preds[locked];
+        node* succ = succs[locked];
+        if (locked == 0 || pred != preds[locked - 1]) {
+          pred->Lock();
+        }
+        valid = !pred->marked.load() && (!succ || !succ->marked.load()) && pred->Next()[locked].load() == succ;
+      }
+      if (!valid) {
+        Unlock(preds, locked);
+        continue;
+      }
+      // Узел выше вершины: блокировка head уже взята, он предшественник на новых уровнях
+      if (height > Top(upper.load())) {
+        Raise(height);
+      }
+      // Разбиение промежутков: учтенные узлы до x остаются у предшественника, x учтен у него же
+      for (int i = 0; i < height; ++i) {
+        x->Next()[i].store(succs[i], std::memory_order_relaxed);
+      }
+      int widths[max_level];
+      for (int i = 1; i < height; ++i) {
+        widths[i] = CountBetween(preds[i], key, i) + 1;
+        x->Width()[i].store(preds[i]->Width()[i].load(std::memory_order_relaxed) + 1 - widths[i],
+                            std::memory_order_relaxed);
+      }
+      x->counted.store(height - 1);
+      for (int i = 0; i < height; ++i) {
+        preds[i]->Next()[i].store(x);
+        if (i > 0) {
+          preds[i]->Width()[i].store(widths[i], std::memory_order_relaxed);
+        }
+      }
+      Unlock(preds, height);
+      break;
+    }
+    // Промежутки выше узла: каждый становится шире на единицу
+    Account(x, 1, preds, succs);
+    x->linked.store(true);
+  }
+  size.fetch_add(1, std::memory_order_relaxed);
+  return true;
+}
+
+bool SkipList::Remove(const int key) {
+  node* preds[max_level];
+  node* succs[max_level];
+  node* victim = nullptr;
+  {
+    EpochDomain::Guard guard(epoch);
+    int found = Find(key, preds, succs);
+    if (found == -1) {
+      return false;
+    }
+    victim = succs[found];
+    // Незавершенная вставка еще не добавила ключ
+    if (!victim->linked.load() || victim->marked.load() || victim->height - 1 != found) {
+      return false;
+    }
+    victim->Lock();
+    if (victim->marked.load()) {
+      victim->Unlock();
+      return false;
+    }
+    // Пометка - момент удаления
+    victim->marked.store(true);
+    size.fetch_sub(1, std::memory_order_relaxed);
+    Account(victim, -1, preds, succs);
+    const int height = victim->height;
+    while (true) {
+      bool valid = true;
+      int locked = 0;
+      for (; valid && locked < height; ++locked) {
+        node* pred = preds[locked];
+        if (locked == 0 || pred != preds[locked - 1]) {
+          pred->Lock();
+        }
+        valid = !pred->marked.load() && pred->Next()[locked].load() == victim;
+      }
+      if (valid) {
+        // Промежутки предшественника и удаляемого узла сливаются, сам узел из них уходит
+        for (int i = height - 1; i >= 0; --i) {
+          if (i > 0) {
+            preds[i]->Width()[i].store(preds[i]->Width()[i].load(std::memory_order_relaxed) +
+                                       victim->Width()[i].load(std::memory_order_relaxed) - 1,
+                                       std::memory_order_relaxed);
+          }
+          preds[i]->Next()[i].store(victim->Next()[i].load());
+        }
+        victim->counted.store(0);
+        Unlock(preds, height);
+        break;
+      }
+      Unlock(preds, locked);
+      Find(key, preds, succs);
+    }
+    victim->Unlock();
+  }
+  Retire(victim);
+  return true;
+}
+
+bool SkipList::FindByKey(const int key) const {
+  EpochDomain::Guard guard(epoch);
+  node* pred = head;
+  for (int level = max_level - 1; level >= 0; --level) {
+    node* curr = pred->Next()[level].load();
+    while (curr && curr->key < key) {
+      pred = curr;
+      curr = pred->Next()[level].load();
+    }
+    if (curr && curr->key == key) {
+      return curr->linked.load() && !curr->marked.load();
+    }
+  }
+  return false;
+}
+
+bool SkipList::FindByRank(const int rank, int& val) const {
+  EpochDomain::Guard guard(epoch);
+  node* x = head;
+  int pos = 0;
+  for (int level = Top(upper.load()) - 1; level >= 0; --level) {
+    while (true) {
+      node* next = x->Next()[level].load();
+      if (!next) {
+        break;
+      }
+      int width = level > 0 ? x->Width()[level].load(std::memory_order_relaxed) : 1;
+      if (pos + width > rank) {
+        break;
+      }
+      pos += width;
+      x = next;
+    }
+    if (pos == rank) {
+      break;
+    }
+  }
+  if (pos != rank || x == head || x->marked.load()) {
+    return false;
+  }
+  val = x->key;
+  return true;
+}
+
+// Предшественники и преемники key на всех уровнях; верхний уровень, где найден key, или -1
+int SkipList::Find(const int key, node** preds, node** succs) const {
+  int found = -1;
+  node* pred = head;
+  for (int level = max_level - 1; level >= 0; --level) {
+    node* curr = pred->Next()[level].load();
+    while (curr && curr->key < key) {
+      pred = curr;
+      curr = pred->Next()[level].load();
+    }
+    if (found == -1 && curr && curr->key == key) {
+      found = level;
+    }
+    preds[level] = pred;
+    succs[level] = curr;
+  }
+  return found;
+}
+
+// Снятие блокировок с предшественников уровней 0..levels-1
+void SkipList::Unlock(node** preds, const int levels) {
+  for (int i = 0; i < levels; ++i) {
+    if (i == 0 || preds[i] != preds[i - 1]) {
+      preds[i]->Unlock();
+    }
+  }
+}
+
+// Число учтенных на уровне level узлов между pred и позицией key на нижнем уровне.
+// Вызывается под блокировкой pred: учесть узел в этом промежутке или снять учет
+// без нее нельзя, поэтому учтенные узлы не меняются и не уходят с нижнего уровня
+int SkipList::CountBetween(node* pred, const int key, const int level) {
+  int count = 0;
+  for (node* y = pred->Next()[0].load(); y && y->key < key; y = y->Next()[0].load()) {
+    if (y->counted.load() >= level) {
+      ++count;
+    }
+  }
+  return count;
+}
+
+// Учет узла x (delta = 1) или снятие учета (delta = -1) в промежутках уровней
+// от x->height до вершины под блокировкой начала каждого промежутка; соседние
+// уровни с общим началом - за одну блокировку. Выше вершины - счетчик в upper;
+// пока его изменение и counted не согласованы, вершина не поднимается
+void SkipList::Account(node* x, const int delta, node** preds, node** succs) {
+  int level = x->height;
+  if (delta < 0) {
+    // Сначала неявные уровни: ниже вершины на этот момент учет снимается явно
+    const uint64_t u = upper.fetch_add(inflight - 1);
+    level = Top(u) - 1;
+    x->counted.store(level);
+    upper.fetch_sub(inflight);
+  }
+  while (true) {
+    const int top = Top(upper.load());
+    auto pending = [&]() { return delta > 0 ? level < top : level >= x->height; };
+    while (pending()) {
+      node* owner = preds[level];
+      owner->Lock();
+      bool valid = !owner->marked.load();
+      while (valid && pending() && preds[level] == owner) {
+        node* next = owner->Next()[level].load();
+        if (next && next->key <= x->key) {
+          valid = false;
+          break;
+        }
+        owner->Width()[level].store(owner->Width()[level].load(std::memory_order_relaxed) + delta,
+                                    std::memory_order_relaxed);
+        x->counted.store(delta > 0 ? level : level - 1);
+        level += delta;
+      }
+      owner->Unlock();
+      if (!valid) {
+        // Промежуток разбит или его начало удаляется: новые предшественники
+        Find(x->key, preds, succs);
+      }
+    }
+    if (delta < 0) {
+      return;
+    }
+    // Неявные уровни; если вершина поднялась, сначала явный учет на новых уровнях
+    uint64_t u = upper.load();
+    while (Top(u) == level && !upper.compare_exchange_weak(u, u + inflight)) {
+    }
+    if (Top(u) == level) {
+      x->counted.store(max_level);
+      upper.fetch_add(1 - inflight);
+      return;
+    }
+  }
+}
+
+// Подъем вершины до height; вызывается под блокировкой head. На новых уровнях
+// единственный промежуток - от head до конца, в нем все узлы, учтенные неявно.
+// Ожидание незавершенных изменений счетчика: после них counted узлов точен
+void SkipList::Raise(const int height) {
+  uint64_t u = upper.load();
+  while (Top(u) < height) {
+    if (u & inflight_mask) {
+      std::this_thread::yield();
+      u = upper.load();
+      continue;
+    }
+    for (int i = Top(u); i < height; ++i) {
+      head->Width()[i].store(static_cast<int>(Count(u)), std::memory_order_relaxed);
+    }
+    if (upper.compare_exchange_weak(u, Pack(height, Count(u)))) {
+      break;
+    }
+  }
+}
+
+SkipList::node* SkipList::Allocate(const int key, const int height) {
+  static_assert(sizeof(node) % alignof(std::atomic<node*>) == 0, "next pointers must stay aligned");
+  void* mem = nullptr;
+  if (free_count[height].load(std::memory_order_relaxed) > 0) {
+    std::lock_guard<std::mutex> lock(pool_mutex);
+    if (!free_nodes[height].empty()) {
+      mem = free_nodes[height].back();
+      free_nodes[height].pop_back();
+      free_count[height].fetch_sub(1, std::memory_order_relaxed);
+    }
+  }
+  if (!mem) {
+    size_t bytes = sizeof(node) + height * (sizeof(std::atomic<node*>) + sizeof(std::atomic<int>));
+    bytes = (bytes + alignof(node*) - 1) / alignof(node*) * alignof(node*);
+    PoolCache* cache = nullptr;
+    for (int i = 0; i < pool_cache_size && !cache; ++i) {
+      if (pool_cache[i].owner == id) {
+        cache = &pool_cache[i];
+      }
+    }
+    if (!cache) {
+      cache = &pool_cache[pool_cache_victim];
+      pool_cache_victim = (pool_cache_victim + 1) % pool_cache_size;
+      *cache = PoolCache();
+    }
+    if (cache->cur + bytes > cache->end) {
+      std::lock_guard<std::mutex> lock(pool_mutex);
+      size_t size = std::max(block_size, bytes);
+      blocks.push_back(new char[size]);
+      cache->owner = id;
+      cache->cur = blocks.back();
+      cache->end = blocks.back() + size;
+    }
+    mem = cache->cur;
+    cache->cur += bytes;
+  }
+  node* p = new (mem) node;
+  p->key = key;
+  p->height = height;
+  for (int i = 0; i < height; ++i) {
+    new (&p->Next()[i]) std::atomic<node*>(nullptr);
+    new (&p->Width()[i]) std::atomic<int>(0);
+  }
+  return p;
+}
+
+// Возврат узлов, которые уже никто не может прочитать, в списки свободных
+void SkipList::Recycle(const std::vector<node*>& nodes) {
+  std::lock_guard<std::mutex> lock(pool_mutex);
+  for (node* p : nodes) {
+    free_nodes[p->height].push_back(p);
+    free_count[p->height].fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+void SkipList::Retire(node* p) {
+  std::vector<node*> batch;
+  {
+    std::lock_guard<std::mutex> lock(retire_mutex);
+    retired.push_back(p);
+    if (retired.size() < retire_batch) {
+      return;
+    }
+    batch.swap(retired);
+  }
+  epoch.Synchronize();
+  Recycle(batch);
+}
+
+int SkipList::RandomLevel() {
+  thread_local uint64_t state = std::hash<std::thread::id>()(std::this_thread::get_id()) | 1;
+  state ^= state << 13;
+  state ^= state >> 7;
+  state ^= state << 17;
+  int level = 1;
+  for (uint64_t bits = state; (bits & 1) && level < max_level; bits >>= 1) {
+    ++level;
+  }
+  return level;
+}
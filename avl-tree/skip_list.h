@@ -0,0 +1,102 @@
+#ifndef SKIP_LIST
+#define SKIP_LIST
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "common/epoch.h"
+
+// Список с пропусками с тем же интерфейсом, что у AVLtree; ключи хранятся как множество.
+// FindByKey и FindByRank идут без блокировок и пишут только в счетчик эпохи.
+// Insert/Remove устроены как ленивый список (Herlihy, Lev, Luchangco, Shavit):
+// ссылки меняются под короткими блокировками предшественников, удаление сначала
+// помечает узел, а поиск проходит по ссылкам, не помогая удалению.
+// Для FindByRank узел на уровнях i > 0 хранит ширину - число узлов нижнего уровня
+// после него до следующего узла уровня i. Узел учитывается в ширине промежутка
+// под блокировкой узла, с которого промежуток начинается, а вставка, разбивающая
+// промежуток, под той же блокировкой считает уже учтенные в нем узлы. Поэтому
+// ширины не расходятся: когда писателей нет, FindByRank точен, а во время записи
+// может не учитывать незавершенные вставки и удаления.
+// Ширины хранятся явно только до вершины - высоты самого высокого узла. Выше
+// нее у каждого уровня один промежуток от head до конца списка, и ширины всех
+// этих уровней - один атомарный счетчик рядом с вершиной. Поэтому head
+// блокируется, только когда узел доходит до вершины, а не при каждой записи.
+// Узлы выделяются из пула блоками; удаленные узлы после ожидания эпохи
+// попадают в списки свободных узлов по высоте и используются повторно.
+class SkipList {
+public:
+  SkipList();
+  ~SkipList();
+  SkipList(const SkipList&) = delete;
+  SkipList& operator=(const SkipList&) = delete;
+
+  bool Insert(const int key);
+  bool Remove(const int key);
+  bool FindByKey(const int key) const;
+  bool FindByRank(const int rank, int& val) const;
+  int Size() const { return size.load(std::memory_order_relaxed); }
+
+private:
+  static const int max_level = 24;
+
+  // Узел переменной длины: next[height] и width[height] лежат сразу за заголовком
+  struct node {
+    int key;
+    int height;
+    // Узел учтен в ширинах промежутков уровней 1..counted; max_level - на всех уровнях
+    std::atomic<int> counted{0};
+    std::atomic<bool> locked{false};
+    std::atomic<bool> marked{false};
+    // Вставка завершена: узел связан и учтен на всех уровнях
+    std::atomic<bool> linked{false};
+
+    std::atomic<node*>* Next() { return reinterpret_cast<std::atomic<node*>*>(this + 1); }
+    std::atomic<int>* Width() { return reinterpret_cast<std::atomic<int>*>(Next() + height); }
+    void Lock();
+    void Unlock() { locked.store(false, std::memory_order_release); }
+  };
+
+  // Узел из списка свободных или из пула: блоки по 64 КБ, у каждого потока свой текущий блок
+  node* Allocate(const int key, const int height);
+  // Возврат узлов, которые уже никто не может прочитать, в списки свободных
+  void Recycle(const std::vector<node*>& nodes);
+  // Удаленный узел освобождается вместе с пачкой других после ожидания эпохи; вызывается вне Guard
+  void Retire(node* p);
+  static int RandomLevel();
+
+  // Предшественники и преемники key на всех уровнях; верхний уровень, где найден key, или -1
+  int Find(const int key, node** preds, node** succs) const;
+  // Снятие блокировок с предшественников уровней 0..levels-1
+  static void Unlock(node** preds, const int levels);
+  // Число учтенных на уровне level узлов между pred и позицией key на нижнем уровне
+  static int CountBetween(node* pred, const int key, const int level);
+  // Учет узла x (delta = 1) или снятие учета (delta = -1) в промежутках уровней
+  // от x->height и выше, где x не связан, под блокировкой начала каждого промежутка
+  void Account(node* x, const int delta, node** preds, node** succs);
+  // Подъем вершины до height; вызывается под блокировкой head
+  void Raise(const int height);
+
+  // upper: вершина в битах 56..63, число незавершенных изменений счетчика
+  // в битах 40..55, число учтенных выше вершины узлов в младших битах
+  static const uint64_t inflight = uint64_t(1) << 40;
+  static const uint64_t inflight_mask = (uint64_t(1) << 56) - inflight;
+  static uint64_t Pack(const int top, const uint64_t count) { return static_cast<uint64_t>(top) << 56 | count; }
+  static int Top(const uint64_t u) { return static_cast<int>(u >> 56); }
+  static uint64_t Count(const uint64_t u) { return u & (inflight - 1); }
+
+  node* head;
+  std::atomic<int> size;
+  // Вершина и ширина промежутков выше нее; узел учтен там, когда counted == max_level
+  std::atomic<uint64_t> upper;
+  const uint64_t id;
+  mutable EpochDomain epoch;
+  std::mutex pool_mutex;
+  std::vector<char*> blocks;
+  std::vector<node*> free_nodes[max_level + 1];
+  std::atomic<int> free_count[max_level + 1];
+  std::mutex retire_mutex;
+  std::vector<node*> retired;
+};
+
+#endif // !SKIP_LIST
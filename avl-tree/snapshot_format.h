@@ -0,0 +1,138 @@
+#ifndef AVL_SNAPSHOT_FORMAT_H
+#define AVL_SNAPSHOT_FORMAT_H
+
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+
+// Формат снимка: "AVLSNAP1", флаги (4 байта), число ключей (8 байт), ключи,
+// контрольная сумма ключей (8 байт); числа в little-endian.
+// Ключи хранятся со сдвигом 2^31, чтобы порядок int совпадал с порядком uint32:
+// либо по 4 байта, либо разностями соседних ключей в varint.
+// Снимки пишут AVLtree и PersistentAVLtree::Snapshot, загружает AVLtree
+namespace avl_snapshot {
+
+const char magic[8] = { 'A', 'V', 'L', 'S', 'N', 'A', 'P', '1' };
+const uint32_t delta_flag = 1;
+const size_t buffer_size = 1 << 20;
+// Байты снимка без ключей: заголовок и контрольная сумма
+const uint64_t overhead = sizeof(magic) + 4 + 8 + 8;
+
+// FNV-1a по 32-битным ключам
+const uint64_t checksum_basis = 0xcbf29ce484222325ull;
+inline uint64_t Checksum(const uint64_t sum, const uint32_t key) {
+  return (sum ^ key) * 0x100000001b3ull;
+}
+
+// Наибольшее число ключей, которое помещается в файл такого размера
+inline uint64_t MaxKeys(const uint64_t file_size, const uint64_t flags) {
+  return file_size < overhead ? 0 : (file_size - overhead) / (flags & delta_flag ? 1 : 4);
+}
+
+struct Writer {
+  FILE* out;
+  bool delta;
+  std::vector<unsigned char> buf;
+  uint64_t checksum = checksum_basis;
+  uint32_t prev = 0;
+  bool ok = true;
+
+  Writer(FILE* out, const bool delta) : out(out), delta(delta) { buf.reserve(buffer_size + 16); }
+
+  void PutFixed(uint64_t v, const int bytes) {
+    for (int i = 0; i < bytes; ++i, v >>= 8) {
+      buf.push_back(static_cast<unsigned char>(v));
+    }
+  }
+
+  // Заголовок; ключи должны идти следом, ровно count штук по возрастанию
+  void Header(const uint64_t count) {
+    buf.insert(buf.end(), magic, magic + sizeof(magic));
+    PutFixed(delta ? delta_flag : 0, 4);
+    PutFixed(count, 8);
+  }
+
+  void Key(const int key) {
+    uint32_t u = static_cast<uint32_t>(key) ^ 0x80000000u;
+    checksum = Checksum(checksum, u);
+    if (delta) {
+      uint32_t v = u - prev;
+      while (v >= 0x80) {
+        buf.push_back(static_cast<unsigned char>(v | 0x80));
+        v >>= 7;
+      }
+      buf.push_back(static_cast<unsigned char>(v));
+      prev = u;
+    }
+    else {
+      PutFixed(u, 4);
+    }
+    if (buf.size() >= buffer_size) {
+      Flush();
+    }
+  }
+
+  void Flush() {
+    ok = ok && std::fwrite(buf.data(), 1, buf.size(), out) == buf.size();
+    buf.clear();
+  }
+
+  // Контрольная сумма и запись остатка буфера; false при ошибке записи
+  bool Finish() {
+    PutFixed(checksum, 8);
+    Flush();
+    return ok;
+  }
+};
+
+struct Reader {
+  FILE* in;
+  std::vector<unsigned char> buf;
+  size_t pos = 0;
+  size_t end = 0;
+
+  explicit Reader(FILE* in) : in(in), buf(buffer_size) {}
+
+  bool Get(unsigned char& c) {
+    if (pos == end) {
+      end = std::fread(buf.data(), 1, buf.size(), in);
+      pos = 0;
+      if (end == 0) {
+        return false;
+      }
+    }
+    c = buf[pos++];
+    return true;
+  }
+
+  bool GetFixed(uint64_t& v, const int bytes) {
+    v = 0;
+    unsigned char c;
+    for (int i = 0; i < bytes; ++i) {
+      if (!Get(c)) {
+        return false;
+      }
+      v |= static_cast<uint64_t>(c) << (8 * i);
+    }
+    return true;
+  }
+
+  bool GetVarint(uint32_t& v) {
+    v = 0;
+    unsigned char c;
+    for (int shift = 0; shift < 35; shift += 7) {
+      if (!Get(c)) {
+        return false;
+      }
+      v |= static_cast<uint32_t>(c & 0x7f) << shift;
+      if (!(c & 0x80)) {
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+}
+
+#endif // !AVL_SNAPSHOT_FORMAT_H
@@ -1,29 +1,337 @@
 #include "avl_tree.h"
+#include "persistent_avl_tree.h"
+#include "sharded_avl_tree.h"
+#include "skip_list.h"
 #include <algorithm>
+#include <climits>
+#include <cstdio>
 #include <iostream>
 #include <iomanip>
 #include <thread>
 
 
-void insert(AVLtree& tree) {
+template<typename Tree>
+void insert(Tree& tree) {
   for (int i = 0; i < 100000; ++i) {
     tree.Insert(i);
   }
 }
 
-void del(AVLtree& tree) {
+template<typename Tree>
+void del(Tree& tree) {
   for (int i = 10; i < 100000; ++i) {
     tree.Remove(i);
   }
 }
 
 
-void insertRand(AVLtree& tree) {
+template<typename Tree>
+void insertRand(Tree& tree) {
   for (int i = 0; i < 100000; ++i) {
     tree.Insert(rand());
   }
 }
 
+void insertPersistent(PersistentAVLtree& tree) {
+  for (int i = 0; i < 100000; ++i) {
+    tree.Insert(rand());
+  }
+}
+
+// Длинный просмотр снимка по рангам, пока писатель продолжает вставки
+void scanPersistent(PersistentAVLtree& tree, long long& checked) {
+  for (int round = 0; round < 10; ++round) {
+    PersistentAVLtree::Snapshot snapshot = tree.GetSnapshot();
+    int prev = 0, val = 0;
+    for (int k = 1; snapshot.FindByRank(k, val); ++k) {
+      if (k > 1 && val < prev) {
+        std::cout << "Нарушен порядок в версии " << snapshot.Version() << std::endl;
+      }
+      prev = val;
+      ++checked;
+    }
+  }
+}
+
+void testPersistent() {
+  PersistentAVLtree tree;
+  long long checked = 0;
+  auto start = std::chrono::steady_clock::now();
+  std::thread th1(insertPersistent, std::ref(tree));
+  std::thread th2(scanPersistent, std::ref(tree), std::ref(checked));
+  th1.join();
+  th2.join();
+  auto finish = std::chrono::steady_clock::now();
+  long long all = std::chrono::duration_cast<std::chrono::nanoseconds>(finish - start).count();
+  std::cout << "Версия после вставок: " << tree.GetSnapshot().Version() << std::endl;
+  std::cout << "Проверено элементов в снимках: " << checked << std::endl;
+  std::cout << "Время: " << all / 1000000 << " ms" << std::endl;
+}
+
+void testBulk() {
+  std::vector<int> keys(1000000);
+  for (int i = 0; i < keys.size(); ++i) {
+    keys[i] = 2 * i;
+  }
+  AVLtree tree;
+  auto start = std::chrono::steady_clock::now();
+  tree.BuildFromSorted(keys);
+  auto finish = std::chrono::steady_clock::now();
+  std::cout << "Построение из 1000000 ключей: "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(finish - start).count() << " ms" << std::endl;
+
+  std::vector<int> batch(keys.size() / 2);
+  for (int i = 0; i < batch.size(); ++i) {
+    batch[i] = 4 * i + 1;
+  }
+  start = std::chrono::steady_clock::now();
+  tree.InsertBatch(batch);
+  tree.RemoveBatch(keys);
+  finish = std::chrono::steady_clock::now();
+  int val = 0;
+  tree.FindByRank(1, val);
+  std::cout << "Пакетные вставка и удаление: "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(finish - start).count() << " ms" << std::endl;
+  std::cout << "Первый элемент после удаления: " << val << std::endl;
+  std::cout << std::endl;
+}
+
+void testSetOperations() {
+  std::vector<int> keys(1000000);
+  for (int i = 0; i < keys.size(); ++i) {
+    keys[i] = 2 * i;
+  }
+  std::vector<int> delta(100000);
+  for (int i = 0; i < delta.size(); ++i) {
+    delta[i] = 20 * i + 1;
+  }
+  AVLtree tree, added, removed;
+  tree.BuildFromSorted(keys);
+  added.BuildFromSorted(delta);
+  removed.BuildFromSorted(std::vector<int>(keys.begin(), keys.begin() + keys.size() / 2));
+
+  auto start = std::chrono::steady_clock::now();
+  tree.Union(added);
+  const int after_union = tree.CountInRange(INT_MIN, INT_MAX);
+  tree.Difference(removed);
+  auto finish = std::chrono::steady_clock::now();
+  const int after_difference = tree.CountInRange(INT_MIN, INT_MAX);
+  std::cout << "Объединение и разность: "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(finish - start).count() << " ms" << std::endl;
+  std::cout << "Элементов после объединения: " << after_union << ", после разности: " << after_difference << std::endl;
+
+  // Меньше 1000000 остаются только ключи 20 * i + 1 при i < 50000
+  AVLtree upper;
+  tree.Split(1000000, upper);
+  const int below = tree.CountInRange(INT_MIN, INT_MAX);
+  const int above = upper.CountInRange(INT_MIN, INT_MAX);
+  std::cout << "Элементов меньше 1000000: " << below << std::endl;
+  tree.Join(upper);
+  std::vector<int> expected(keys.begin() + keys.size() / 2, keys.end());
+  expected.insert(expected.end(), delta.begin(), delta.end());
+  std::sort(expected.begin(), expected.end());
+  std::vector<int> joined;
+  tree.VisitRange(INT_MIN, INT_MAX, [&joined](int key) { joined.push_back(key); });
+  bool ok = after_union == 1100000 && after_difference == 600000 && below == 50000 && above == 550000 &&
+            upper.Size() == 0 && joined == expected;
+  std::cout << "Результаты операций " << (ok ? "верны" : "НЕВЕРНЫ") << std::endl;
+
+  // Пересекающиеся деревья с повторами: ключ k в первом дереве k % 4 раз, во втором k % 3 раз.
+  // Объединение складывает число копий, разность и пересечение учитывают все копии ключа
+  auto fill = [](AVLtree& t, const int copies) {
+    for (int r = 0; r < copies; ++r) {
+      for (int i = 0; i < 1000; ++i) {
+        int k = i * 7919 % 1000;
+        if (r < k % copies) {
+          t.Insert(k);
+        }
+      }
+    }
+  };
+  AVLtree united, other, diff, diff_other, common, common_other;
+  fill(united, 4);
+  fill(other, 3);
+  fill(diff, 4);
+  fill(diff_other, 3);
+  fill(common, 4);
+  fill(common_other, 3);
+  united.Union(other);
+  diff.Difference(diff_other);
+  common.Intersection(common_other);
+  bool duplicates = other.Size() == 0 && diff_other.Size() == 999 && common_other.Size() == 999;
+  for (int k = 0; k < 1000 && duplicates; ++k) {
+    duplicates = united.CountInRange(k, k + 1) == k % 4 + k % 3 &&
+                 diff.CountInRange(k, k + 1) == (k % 3 ? 0 : k % 4) &&
+                 common.CountInRange(k, k + 1) == (k % 3 ? k % 4 : 0);
+  }
+  std::cout << "Операции с повторами ключей " << (duplicates ? "верны" : "НЕВЕРНЫ") << std::endl;
+  std::cout << std::endl;
+}
+
+void testSnapshot() {
+  std::vector<int> keys(1000000);
+  for (int i = 0; i < keys.size(); ++i) {
+    keys[i] = 3 * i - 1000000;
+  }
+  AVLtree tree;
+  tree.BuildFromSorted(keys);
+  tree.Insert(INT_MIN);
+  tree.Insert(INT_MAX);
+  const char* path = "avl_snapshot.bin";
+  auto start = std::chrono::steady_clock::now();
+  bool saved = tree.SaveSnapshot(path);
+  auto middle = std::chrono::steady_clock::now();
+  AVLtree loaded;
+  bool ok = loaded.LoadSnapshot(path);
+  auto finish = std::chrono::steady_clock::now();
+  int val = 0;
+  ok = saved && ok && loaded.Size() == tree.Size() && loaded.FindByRank(2, val) && val == keys[0] &&
+       loaded.FindByKey(INT_MAX) && loaded.FindByKey(INT_MIN);
+  // Испорченный файл не загружается, дерево остается прежним
+  FILE* file = std::fopen(path, "r+b");
+  std::fseek(file, 100, SEEK_SET);
+  std::fputc(0x55, file);
+  std::fclose(file);
+  bool rejected = !loaded.LoadSnapshot(path) && loaded.Size() == tree.Size();
+  // Число ключей в заголовке (0x7f000000) больше, чем помещается в файл: отказ без выделения памяти
+  file = std::fopen(path, "r+b");
+  std::fseek(file, 12, SEEK_SET);
+  const unsigned char count[8] = { 0, 0, 0, 0x7f, 0, 0, 0, 0 };
+  std::fwrite(count, 1, sizeof(count), file);
+  std::fclose(file);
+  rejected = rejected && !loaded.LoadSnapshot(path) && loaded.Size() == tree.Size();
+
+  // Снимок версии PersistentAVLtree пишется, пока писатель продолжает вставки
+  PersistentAVLtree persistent;
+  for (int i = 0; i < 100000; ++i) {
+    persistent.Insert(2 * i);
+  }
+  PersistentAVLtree::Snapshot snapshot = persistent.GetSnapshot();
+  std::thread writer([&persistent]() {
+    for (int i = 0; i < 100000; ++i) {
+      persistent.Insert(2 * i + 1);
+    }
+  });
+  bool persistent_saved = snapshot.Save(path);
+  writer.join();
+  AVLtree from_persistent;
+  bool persistent_ok = persistent_saved && from_persistent.LoadSnapshot(path) &&
+                       from_persistent.Size() == snapshot.Size() && snapshot.Size() == 100000;
+  for (int k = 1; persistent_ok && k <= snapshot.Size(); k += 997) {
+    int expected = 0;
+    persistent_ok = snapshot.FindByRank(k, expected) && from_persistent.FindByRank(k, val) && val == expected;
+  }
+  std::remove(path);
+  std::cout << "Снимок из " << tree.Size() << " ключей: запись "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(middle - start).count() << " ms, загрузка "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(finish - middle).count() << " ms" << std::endl;
+  std::cout << "Загруженное дерево " << (ok ? "совпадает" : "НЕ СОВПАДАЕТ") << ", испорченный снимок "
+            << (rejected ? "отклонен" : "ПРИНЯТ") << std::endl;
+  std::cout << "Снимок версии PersistentAVLtree " << (persistent_ok ? "загружен в AVLtree" : "НЕ ЗАГРУЖЕН") << std::endl;
+  std::cout << std::endl;
+}
+
+void testBatchLookup() {
+  std::vector<int> keys(1000000);
+  for (int i = 0; i < keys.size(); ++i) {
+    keys[i] = 2 * i;
+  }
+  AVLtree tree;
+  tree.BuildFromSorted(keys);
+  // Запросы вперемешку, с повторами и значениями вне дерева
+  std::vector<int> ranks(500), queries(500);
+  for (int i = 0; i < ranks.size(); ++i) {
+    ranks[i] = rand() % (keys.size() + 10) - 5;
+    queries[i] = rand() % (2 * keys.size() + 10) - 5;
+  }
+  ranks[1] = ranks[0];
+  std::vector<int> vals;
+  std::vector<bool> found, keys_found;
+  const int rounds = 200;
+  auto start = std::chrono::steady_clock::now();
+  for (int r = 0; r < rounds; ++r) {
+    tree.FindByRankBatch(ranks, vals, found);
+    tree.FindByKeyBatch(queries, keys_found);
+  }
+  auto middle = std::chrono::steady_clock::now();
+  bool ok = true;
+  for (int r = 0; r < rounds; ++r) {
+    for (int i = 0; i < ranks.size(); ++i) {
+      int val = 0;
+      bool res = tree.FindByRank(ranks[i], val);
+      ok = ok && res == found[i] && (!res || val == vals[i]);
+      ok = ok && tree.FindByKey(queries[i]) == keys_found[i];
+    }
+  }
+  auto finish = std::chrono::steady_clock::now();
+  std::cout << "Пакеты по " << ranks.size() << " запросов ранга и ключа: "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(middle - start).count() << " ms, по одному: "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(finish - middle).count() << " ms" << std::endl;
+  std::cout << "Ответы пакетов " << (ok ? "совпадают" : "НЕ СОВПАДАЮТ") << " с одиночными запросами" << std::endl;
+  std::cout << std::endl;
+}
+
+void insertSharded(ShardedAVLtree& tree, int from) {
+  for (int i = from; i < from + 100000; ++i) {
+    tree.Insert(i);
+  }
+}
+
+void insertRandSharded(ShardedAVLtree& tree) {
+  for (int i = 0; i < 100000; ++i) {
+    tree.Insert(rand());
+  }
+}
+
+void testSharded() {
+  ShardedAVLtree tree(8);
+  auto start = std::chrono::steady_clock::now();
+  std::thread th1(insertSharded, std::ref(tree), 0);
+  std::thread th2(insertSharded, std::ref(tree), 1000000);
+  std::thread th3(insertRandSharded, std::ref(tree));
+  th1.join();
+  th2.join();
+  th3.join();
+  auto finish = std::chrono::steady_clock::now();
+  int val = 0;
+  tree.FindByRank(tree.Size() / 2, val);
+  std::cout << "Шардов: " << tree.ShardCount() << ", элементов: " << tree.Size() << std::endl;
+  std::cout << "Медиана: " << val << std::endl;
+  std::cout << "Время: "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(finish - start).count() << " ms" << std::endl;
+  std::cout << std::endl;
+}
+
+// Тот же сценарий, что и для AVLtree, на списке с пропусками
+void testSkipList() {
+  SkipList list;
+  auto start = std::chrono::steady_clock::now();
+  std::thread th1(insert<SkipList>, std::ref(list));
+  std::thread th2(del<SkipList>, std::ref(list));
+  std::thread th3(insertRand<SkipList>, std::ref(list));
+  th1.join();
+  th2.join();
+  th3.join();
+  auto finish = std::chrono::steady_clock::now();
+  int val = 0;
+  list.FindByRank(list.Size() / 2, val);
+  // Ширины точны без пересчета: ранги 1..Size() дают ключи списка по возрастанию
+  bool exact = true;
+  int prev = 0;
+  for (int i = 1; i <= list.Size() && exact; ++i) {
+    int key = 0;
+    exact = list.FindByRank(i, key) && (i == 1 || key > prev) && list.FindByKey(key);
+    prev = key;
+  }
+  exact = exact && !list.FindByRank(list.Size() + 1, prev);
+  std::cout << "Список с пропусками, элементов: " << list.Size() << std::endl;
+  std::cout << "Медиана: " << val << std::endl;
+  std::cout << "Ранги после параллельной записи " << (exact ? "точны" : "НЕ ТОЧНЫ") << std::endl;
+  std::cout << "Время: "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(finish - start).count() << " ms" << std::endl;
+  std::cout << std::endl;
+}
+
 int main() {
   setlocale(LC_ALL, "Russian");
   std::cout << std::setprecision(5);
@@ -34,17 +342,24 @@ int main() {
   tree.Insert(1);
   tree.Insert(7);
   tree.Remove(5);
-  std::cout << "   5: " << tree.FindByKey(5) << std::endl;
-  std::cout << "   7: " << tree.FindByKey(7) << std::endl;
+  std::cout << "Дерево содержит элемент 5: " << tree.FindByKey(5) << std::endl;
+  std::cout << "Дерево содержит элемент 7: " << tree.FindByKey(7) << std::endl;
   int val = 0;
   bool ex = tree.FindByRank(2, val);
-  std::cout << "2-  = " << val << std::endl;
+  std::cout << "2-ый элемент = " << val << std::endl;
+  int rank = 0;
+  tree.RankOf(10, rank);
+  std::cout << "Номер элемента 10: " << rank << std::endl;
+  std::cout << "Элементов в [1, 10): " << tree.CountInRange(1, 10) << std::endl;
+  std::cout << "Элементы в [1, 10):";
+  tree.VisitRange(1, 10, [](int key) { std::cout << " " << key; });
+  std::cout << std::endl;
   std::cout << std::endl;
 
   auto start = std::chrono::steady_clock::now();
-  std::thread th1(insert, std::ref(tree));
-  std::thread th2(del, std::ref(tree));
-  std::thread th3(insertRand, std::ref(tree));
+  std::thread th1(insert<AVLtree>, std::ref(tree));
+  std::thread th2(del<AVLtree>, std::ref(tree));
+  std::thread th3(insertRand<AVLtree>, std::ref(tree));
   th1.join();
   th2.join();
   th3.join();
@@ -54,7 +369,18 @@ int main() {
   for (auto t : tree.work) {
     sumwork += t.second.count();
   }
-  std::cout << "  : " << sumwork * 1. / all << std::endl;
+  std::cout << "Коэффициент эффективного использования: " << sumwork * 1. / all << std::endl;
+  std::cout << std::endl;
+
+  testPersistent();
+  std::cout << std::endl;
+
+  testBulk();
+  testSetOperations();
+  testSnapshot();
+  testBatchLookup();
+  testSharded();
+  testSkipList();
 
   return 0;
 }
\ No newline at end of file
@@ -0,0 +1,335 @@
+#include "containers.h"
+#include "workload.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Параметры прогона: каждый список перебирается полностью
+struct Config {
+  std::vector<std::string> containers;
+  std::vector<int> threads;
+  std::vector<int> reads;
+  std::vector<Distribution> distributions;
+  std::vector<int> sizes;
+  int ops = 20000;
+  int keys = 65536;
+  uint32_t seed = 42;
+  bool csv = false;
+  std::string out;
+};
+
+struct Case {
+  std::string container;
+  int threads;
+  int read_percent;
+  Distribution distribution;
+  int element_size;
+};
+
+struct Result {
+  Case c;
+  long long ops;
+  double seconds;
+  double ops_per_sec;
+  long long p50, p90, p99, p999, max;
+  // Доля времени операций, проведенная в ожидании блокировки; < 0 - не измеряется
+  double lock_wait;
+};
+
+template<typename Bench>
+Result Run(const Config& cfg, const Case& c) {
+  Bench bench;
+  bench.Prefill(cfg.keys);
+  std::vector<std::vector<long long>> latency(c.threads);
+  std::atomic<int> ready(0);
+  std::atomic<bool> go(false);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < c.threads; ++t) {
+    threads.emplace_back([&, t]() {
+      // Зерно зависит только от параметров нагрузки, а не от контейнера:
+      // все контейнеры получают одинаковую последовательность операций
+      std::seed_seq seq{cfg.seed, static_cast<uint32_t>(t), static_cast<uint32_t>(c.read_percent),
+                        static_cast<uint32_t>(c.distribution)};
+      std::mt19937 rng(seq);
+      KeyGenerator keys(c.distribution, cfg.keys, t, c.threads);
+      std::uniform_int_distribution<int> percent(0, 99);
+      std::vector<long long>& lat = latency[t];
+      lat.reserve(cfg.ops);
+      bench.Warmup();
+      ++ready;
+      while (!go.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+      }
+      long long writes = 0;
+      for (int i = 0; i < cfg.ops; ++i) {
+        int key = keys.Next(rng);
+        bool read = percent(rng) < c.read_percent;
+        auto time1 = std::chrono::steady_clock::now();
+        if (read) {
+          bench.Read(key);
+        }
+        // Запись чередует вставку и удаление, размер контейнера остается примерно постоянным
+        else if (writes++ % 2 == 0) {
+          bench.Add(key);
+        }
+        else {
+          bench.Remove(key);
+        }
+        auto time2 = std::chrono::steady_clock::now();
+        lat.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(time2 - time1).count());
+      }
+    });
+  }
+  while (ready.load() < c.threads) {
+    std::this_thread::yield();
+  }
+  // Все потоки ждут старта, поэтому карты времен можно обнулить без блокировки
+  bench.Reset();
+  auto start = std::chrono::steady_clock::now();
+  go.store(true, std::memory_order_release);
+  for (auto& th : threads) {
+    th.join();
+  }
+  auto finish = std::chrono::steady_clock::now();
+
+  std::vector<long long> all;
+  for (auto& lat : latency) {
+    all.insert(all.end(), lat.begin(), lat.end());
+  }
+  std::sort(all.begin(), all.end());
+  long long total = 0;
+  for (long long l : all) {
+    total += l;
+  }
+  auto percentile = [&all](const double p) {
+    if (all.empty()) {
+      return 0LL;
+    }
+    size_t i = std::min(all.size() - 1, static_cast<size_t>(p * all.size()));
+    return all[i];
+  };
+  Result r;
+  r.c = c;
+  r.ops = static_cast<long long>(all.size());
+  r.seconds = std::chrono::duration_cast<std::chrono::duration<double>>(finish - start).count();
+  r.ops_per_sec = r.seconds > 0 ? r.ops / r.seconds : 0;
+  r.p50 = percentile(0.5);
+  r.p90 = percentile(0.9);
+  r.p99 = percentile(0.99);
+  r.p999 = percentile(0.999);
+  r.max = all.empty() ? 0 : all.back();
+  r.lock_wait = total > 0 ? bench.LockWait(total) : -1;
+  return r;
+}
+
+const int element_sizes[] = { 4, 64, 256 };
+
+struct CaseRunner {
+  const Config& cfg;
+  const Case& c;
+  Result& r;
+  template<typename Bench>
+  void Visit() { r = Run<Bench>(cfg, c); }
+};
+
+std::vector<std::string> Split(const std::string& s) {
+  std::vector<std::string> parts;
+  std::stringstream in(s);
+  std::string part;
+  while (std::getline(in, part, ',')) {
+    if (!part.empty()) {
+      parts.push_back(part);
+    }
+  }
+  return parts;
+}
+
+std::vector<int> SplitInts(const std::string& s) {
+  std::vector<int> values;
+  for (const std::string& part : Split(s)) {
+    values.push_back(std::atoi(part.c_str()));
+  }
+  return values;
+}
+
+void Usage() {
+  std::cerr << "usage: benchmark [options]\n"
+            << "  --containers LIST  stack,queue,vector,fc-stack,fc-queue,pq,relaxed-pq,avl,\n"
+            << "                     persistent-avl,sharded-avl,skip-list,fc-avl,hash-set (default: all)\n"
+            << "  --threads LIST     thread counts (default: 1,2,4,... up to hardware threads, at least 4)\n"
+            << "  --reads LIST       read percentages (default: 10,50,90)\n"
+            << "  --dist LIST        uniform,zipf,sequential (default: all)\n"
+            << "  --sizes LIST       element sizes in bytes: 4,64,256 (default: all; trees use 4)\n"
+            << "  --ops N            operations per thread (default: 20000)\n"
+            << "  --keys N           key range and initial size (default: 65536)\n"
+            << "  --seed N           random seed (default: 42)\n"
+            << "  --format json|csv  output format (default: json)\n"
+            << "  --out FILE         write results to FILE instead of stdout\n";
+}
+
+bool ParseArgs(int argc, char** argv, Config& cfg) {
+  cfg.containers = SizedContainers();
+  cfg.containers.insert(cfg.containers.end(), TreeContainers().begin(), TreeContainers().end());
+  int hw = std::max(4, static_cast<int>(std::thread::hardware_concurrency()));
+  for (int t = 1; t <= hw; t *= 2) {
+    cfg.threads.push_back(t);
+  }
+  cfg.reads = { 10, 50, 90 };
+  cfg.distributions = { Distribution::uniform, Distribution::zipf, Distribution::sequential };
+  cfg.sizes = { 4, 64, 256 };
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      return false;
+    }
+    std::string value = argv[++i];
+    if (arg == "--containers") {
+      cfg.containers = Split(value);
+    }
+    else if (arg == "--threads") {
+      cfg.threads = SplitInts(value);
+    }
+    else if (arg == "--reads") {
+      cfg.reads = SplitInts(value);
+    }
+    else if (arg == "--dist") {
+      cfg.distributions.clear();
+      for (const std::string& name : Split(value)) {
+        Distribution d;
+        if (!ParseDistribution(name, d)) {
+          return false;
+        }
+        cfg.distributions.push_back(d);
+      }
+    }
+    else if (arg == "--sizes") {
+      cfg.sizes = SplitInts(value);
+      for (int size : cfg.sizes) {
+        if (std::find(std::begin(element_sizes), std::end(element_sizes), size) == std::end(element_sizes)) {
+          return false;
+        }
+      }
+    }
+    else if (arg == "--ops") {
+      cfg.ops = std::atoi(value.c_str());
+    }
+    else if (arg == "--keys") {
+      cfg.keys = std::max(1, std::atoi(value.c_str()));
+    }
+    else if (arg == "--seed") {
+      cfg.seed = static_cast<uint32_t>(std::strtoul(value.c_str(), nullptr, 10));
+    }
+    else if (arg == "--format") {
+      if (value != "json" && value != "csv") {
+        return false;
+      }
+      cfg.csv = value == "csv";
+    }
+    else if (arg == "--out") {
+      cfg.out = value;
+    }
+    else {
+      return false;
+    }
+  }
+  return true;
+}
+
+void WriteLockWait(std::ostream& out, const double lock_wait, const char* none) {
+  if (lock_wait < 0) {
+    out << none;
+  }
+  else {
+    out << lock_wait;
+  }
+}
+
+void WriteCsv(std::ostream& out, const Config& cfg, const std::vector<Result>& results) {
+  out << "container,threads,read_percent,distribution,element_size,seed,ops,seconds,ops_per_sec,"
+      << "p50_ns,p90_ns,p99_ns,p999_ns,max_ns,lock_wait_fraction\n";
+  for (const Result& r : results) {
+    out << r.c.container << ',' << r.c.threads << ',' << r.c.read_percent << ','
+        << DistributionName(r.c.distribution) << ',' << r.c.element_size << ',' << cfg.seed << ','
+        << r.ops << ',' << r.seconds << ',' << r.ops_per_sec << ',' << r.p50 << ',' << r.p90 << ','
+        << r.p99 << ',' << r.p999 << ',' << r.max << ',';
+    WriteLockWait(out, r.lock_wait, "");
+    out << '\n';
+  }
+}
+
+void WriteJson(std::ostream& out, const Config& cfg, const std::vector<Result>& results) {
+  out << "{\n  \"seed\": " << cfg.seed << ",\n  \"ops_per_thread\": " << cfg.ops
+      << ",\n  \"keys\": " << cfg.keys << ",\n  \"hardware_threads\": " << std::thread::hardware_concurrency()
+      << ",\n  \"results\": [\n";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const Result& r = results[i];
+    out << "    {\"container\": \"" << r.c.container << "\", \"threads\": " << r.c.threads
+        << ", \"read_percent\": " << r.c.read_percent << ", \"distribution\": \""
+        << DistributionName(r.c.distribution) << "\", \"element_size\": " << r.c.element_size
+        << ", \"ops\": " << r.ops << ", \"seconds\": " << r.seconds << ", \"ops_per_sec\": " << r.ops_per_sec
+        << ", \"latency_ns\": {\"p50\": " << r.p50 << ", \"p90\": " << r.p90 << ", \"p99\": " << r.p99
+        << ", \"p999\": " << r.p999 << ", \"max\": " << r.max << "}, \"lock_wait_fraction\": ";
+    WriteLockWait(out, r.lock_wait, "null");
+    out << (i + 1 < results.size() ? "},\n" : "}\n");
+  }
+  out << "  ]\n}\n";
+}
+
+int main(int argc, char** argv) {
+  Config cfg;
+  if (!ParseArgs(argc, argv, cfg)) {
+    Usage();
+    return 1;
+  }
+  std::vector<Result> results;
+  for (const std::string& container : cfg.containers) {
+    bool sized = IsSizedContainer(container);
+    bool tree = IsTreeContainer(container);
+    if (!sized && !tree) {
+      std::cerr << "unknown container: " << container << std::endl;
+      return 1;
+    }
+    std::vector<int> sizes = sized ? cfg.sizes : std::vector<int>{ 4 };
+    for (int size : sizes) {
+      for (Distribution d : cfg.distributions) {
+        for (int read : cfg.reads) {
+          for (int threads : cfg.threads) {
+            Case c{ container, std::max(threads, 1), std::min(std::max(read, 0), 100), d, size };
+            std::cerr << c.container << " threads=" << c.threads << " reads=" << c.read_percent
+                      << " dist=" << DistributionName(d) << " size=" << size << std::endl;
+            Result r;
+            CaseRunner runner{ cfg, c, r };
+            if (VisitContainer(c.container, c.element_size, runner)) {
+              results.push_back(r);
+            }
+          }
+        }
+      }
+    }
+  }
+  std::ofstream file;
+  if (!cfg.out.empty()) {
+    file.open(cfg.out);
+    if (!file) {
+      std::cerr << "cannot open " << cfg.out << std::endl;
+      return 1;
+    }
+  }
+  std::ostream& out = cfg.out.empty() ? std::cout : file;
+  if (cfg.csv) {
+    WriteCsv(out, cfg, results);
+  }
+  else {
+    WriteJson(out, cfg, results);
+  }
+  return 0;
+}
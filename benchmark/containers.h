@@ -0,0 +1,505 @@
+#ifndef BENCHMARK_CONTAINERS_H
+#define BENCHMARK_CONTAINERS_H
+
+#include "avl-tree/avl_tree.h"
+#include "avl-tree/persistent_avl_tree.h"
+#include "avl-tree/sharded_avl_tree.h"
+#include "avl-tree/skip_list.h"
+#include "flat-combining/flat_combining.h"
+#include "vector-stack-queue/relaxed_priority_queue.h"
+#include "vector-stack-queue/threadsafe_hash_map.h"
+#include "vector-stack-queue/threadsafe_priority_queue.h"
+#include "vector-stack-queue/threadsafe_queue.h"
+#include "vector-stack-queue/threadsafe_stack.h"
+#include "vector-stack-queue/threadsafe_vector.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Обертки над всеми вариантами контейнеров с общим интерфейсом для нагрузочных
+// тестов и воспроизведения трасс:
+// Prefill - начальное заполнение, Warmup - первые операции потока до замера
+// (в них заводятся записи потока в картах wait/work), Reset - обнуление карт,
+// Add/Remove/Read/Update/Rank - операции, LockWait - доля ожидания блокировки
+// по данным самого контейнера (< 0 - контейнер ее не измеряет).
+
+// Элемент заданного размера для стека, очереди и вектора
+template<int Size>
+struct Payload {
+  int key;
+  char pad[Size - sizeof(int)];
+  Payload(int k = 0) : key(k) {}
+};
+
+template<int Size>
+using Element = std::conditional_t<Size == sizeof(int), int, Payload<Size>>;
+
+inline int KeyOf(const int v) { return v; }
+template<int Size>
+int KeyOf(const Payload<Size>& v) { return v.key; }
+
+// Очереди с приоритетом выдают наименьший ключ первым, как очередь заданий по сроку
+struct KeyGreater {
+  template<typename T>
+  bool operator()(const T& a, const T& b) const { return KeyOf(a) > KeyOf(b); }
+};
+
+// Результаты чтений складываются сюда, чтобы компилятор их не выбросил
+inline thread_local long long sink = 0;
+
+inline long long Sum(const std::map<std::thread::id, std::chrono::nanoseconds>& times) {
+  long long sum = 0;
+  for (auto& t : times) {
+    sum += t.second.count();
+  }
+  return sum;
+}
+
+inline void Reset(std::map<std::thread::id, std::chrono::nanoseconds>& times) {
+  for (auto& t : times) {
+    t.second = std::chrono::nanoseconds(0);
+  }
+}
+
+// Prefill кладет в стек и очередь не меньше элементов, чем будет извлечений,
+// поэтому top/front никогда не видят пустой контейнер
+template<typename T>
+struct StackBench {
+  ThreadsafeStack<T> obj;
+  void Prefill(const int keys) {
+    for (int i = 0; i < std::max(keys, 1); ++i) {
+      obj.push(T(i));
+    }
+  }
+  void Warmup() {
+    obj.push(T(0));
+    obj.pop();
+    sink += KeyOf(obj.top());
+  }
+  void Reset() {
+    ::Reset(obj.wait);
+    ::Reset(obj.work);
+  }
+  void Add(const int key) { obj.push(T(key)); }
+  void Remove(const int) { obj.pop(); }
+  void Read(const int) { sink += KeyOf(obj.top()); }
+  void Update(const int key) { obj.top(T(key)); }
+  void Rank(const int key) { Read(key); }
+  double LockWait(const long long latency) { return Sum(obj.wait) * 1. / latency; }
+};
+
+template<typename T>
+struct QueueBench {
+  ThreadsafeQueue<T> obj;
+  void Prefill(const int keys) {
+    for (int i = 0; i < std::max(keys, 1); ++i) {
+      obj.push(T(i));
+    }
+  }
+  void Warmup() {
+    obj.push(T(0));
+    obj.pop();
+    sink += KeyOf(obj.front());
+  }
+  void Reset() {
+    ::Reset(obj.wait);
+    ::Reset(obj.work);
+  }
+  void Add(const int key) { obj.push(T(key)); }
+  void Remove(const int) { obj.pop(); }
+  void Read(const int) { sink += KeyOf(obj.front()); }
+  void Update(const int key) { obj.back(T(key)); }
+  void Rank(const int key) { Read(key); }
+  double LockWait(const long long latency) { return Sum(obj.wait) * 1. / latency; }
+};
+
+// Вектор сохраняет размер: вставка и удаление записывают ячейку key % size
+template<typename T>
+struct VectorBench {
+  ThreadsafeVector<T> obj;
+  ptrdiff_t n = 1;
+  void Prefill(const int keys) {
+    n = std::max(keys, 1);
+    obj.resize(n);
+  }
+  void Warmup() {
+    obj.at(0, T(0));
+    sink += KeyOf(obj.at(0));
+  }
+  void Reset() {
+    ::Reset(obj.wait);
+    ::Reset(obj.work);
+  }
+  void Add(const int key) { obj.at(Index(key), T(key)); }
+  void Remove(const int key) { obj.at(Index(key), T()); }
+  void Read(const int key) { sink += KeyOf(obj.at(Index(key))); }
+  void Update(const int key) { Add(key); }
+  void Rank(const int key) { Read(key); }
+  double LockWait(const long long latency) { return Sum(obj.wait) * 1. / latency; }
+  ptrdiff_t Index(const int key) const { return static_cast<ptrdiff_t>(static_cast<uint32_t>(key) % n); }
+};
+
+template<typename T>
+struct PriorityQueueBench {
+  ThreadsafePriorityQueue<T, KeyGreater> obj;
+  void Prefill(const int keys) {
+    std::vector<T> vals;
+    for (int i = 0; i < std::max(keys, 1); ++i) {
+      vals.push_back(T(i));
+    }
+    obj.push_bulk(vals);
+  }
+  void Warmup() {
+    T val;
+    obj.push(T(0));
+    obj.try_pop(val);
+    sink += KeyOf(obj.top());
+  }
+  void Reset() {
+    ::Reset(obj.wait);
+    ::Reset(obj.work);
+  }
+  void Add(const int key) { obj.push(T(key)); }
+  void Remove(const int) {
+    T val;
+    sink += obj.try_pop(val);
+  }
+  void Read(const int) { sink += KeyOf(obj.top()); }
+  void Update(const int key) {
+    T val;
+    if (obj.try_pop(val)) {
+      obj.push(T(key));
+    }
+  }
+  void Rank(const int key) { Read(key); }
+  double LockWait(const long long latency) { return Sum(obj.wait) * 1. / latency; }
+};
+
+// Вершины у ослабленной очереди нет: чтение - приблизительный размер
+template<typename T>
+struct RelaxedPriorityQueueBench {
+  RelaxedPriorityQueue<T, KeyGreater> obj;
+  void Prefill(const int keys) {
+    for (int i = 0; i < std::max(keys, 1); ++i) {
+      obj.push(T(i));
+    }
+  }
+  void Warmup() {}
+  void Reset() { obj.reset_times(); }
+  void Add(const int key) { obj.push(T(key)); }
+  void Remove(const int) {
+    T val;
+    sink += obj.try_pop(val);
+  }
+  void Read(const int) { sink += obj.size(); }
+  void Update(const int key) {
+    T val;
+    if (obj.try_pop(val)) {
+      obj.push(T(key));
+    }
+  }
+  void Rank(const int key) { Read(key); }
+  double LockWait(const long long latency) { return obj.wait_time().count() * 1. / latency; }
+};
+
+template<typename T>
+struct CombiningStackBench {
+  ThreadsafeStack<T> obj;
+  FlatCombining<ThreadsafeStack<T>> fc{obj};
+  void Prefill(const int keys) {
+    for (int i = 0; i < std::max(keys, 1); ++i) {
+      obj.push(T(i));
+    }
+  }
+  void Warmup() {}
+  void Reset() {}
+  void Add(const int key) { fc.Execute([key](ThreadsafeStack<T>& s) { s.push(T(key)); }); }
+  void Remove(const int) { fc.Execute([](ThreadsafeStack<T>& s) { s.pop(); }); }
+  void Read(const int) { sink += KeyOf(fc.Execute([](ThreadsafeStack<T>& s) { return s.top(); })); }
+  void Update(const int key) { fc.Execute([key](ThreadsafeStack<T>& s) { s.top(T(key)); }); }
+  void Rank(const int key) { Read(key); }
+  double LockWait(const long long) { return -1; }
+};
+
+template<typename T>
+struct CombiningQueueBench {
+  ThreadsafeQueue<T> obj;
+  FlatCombining<ThreadsafeQueue<T>> fc{obj};
+  void Prefill(const int keys) {
+    for (int i = 0; i < std::max(keys, 1); ++i) {
+      obj.push(T(i));
+    }
+  }
+  void Warmup() {}
+  void Reset() {}
+  void Add(const int key) { fc.Execute([key](ThreadsafeQueue<T>& q) { q.push(T(key)); }); }
+  void Remove(const int) { fc.Execute([](ThreadsafeQueue<T>& q) { q.pop(); }); }
+  void Read(const int) { sink += KeyOf(fc.Execute([](ThreadsafeQueue<T>& q) { return q.front(); })); }
+  void Update(const int key) { fc.Execute([key](ThreadsafeQueue<T>& q) { q.back(T(key)); }); }
+  void Rank(const int key) { Read(key); }
+  double LockWait(const long long) { return -1; }
+};
+
+// Деревья хранят только ключи; Update - удаление и повторная вставка ключа
+struct TreeBench {
+  AVLtree obj;
+  void Prefill(const int keys) {
+    std::vector<int> sorted(std::max(keys, 0));
+    for (int i = 0; i < keys; ++i) {
+      sorted[i] = i;
+    }
+    obj.BuildFromSorted(sorted);
+  }
+  void Warmup() {
+    obj.Insert(0);
+    obj.Remove(0);
+    sink += obj.FindByKey(0);
+  }
+  void Reset() { ::Reset(obj.work); }
+  void Add(const int key) { obj.Insert(key); }
+  void Remove(const int key) { obj.Remove(key); }
+  void Read(const int key) { sink += obj.FindByKey(key); }
+  void Update(const int key) {
+    if (obj.Remove(key)) {
+      obj.Insert(key);
+    }
+  }
+  void Rank(const int key) {
+    int val = 0;
+    sink += obj.FindByRank(key, val);
+  }
+  // Дерево не считает ожидание отдельно: все, что не работа под блокировкой, - ожидание
+  double LockWait(const long long latency) { return 1. - Sum(obj.work) * 1. / latency; }
+};
+
+struct PersistentTreeBench {
+  PersistentAVLtree obj;
+  void Prefill(const int keys) {
+    for (int i = 0; i < keys; ++i) {
+      obj.Insert(i);
+    }
+  }
+  void Warmup() {}
+  void Reset() {}
+  void Add(const int key) { obj.Insert(key); }
+  void Remove(const int key) { obj.Remove(key); }
+  void Read(const int key) { sink += obj.FindByKey(key); }
+  void Update(const int key) {
+    obj.Remove(key);
+    obj.Insert(key);
+  }
+  void Rank(const int key) {
+    int val = 0;
+    sink += obj.FindByRank(key, val);
+  }
+  double LockWait(const long long) { return -1; }
+};
+
+struct ShardedTreeBench {
+  ShardedAVLtree obj;
+  int keys = 1;
+  void Prefill(const int n) {
+    keys = std::max(n, 1);
+    for (int i = 0; i < n; ++i) {
+      obj.Insert(i);
+    }
+    obj.Rebalance();
+  }
+  // Записи потока должны появиться в каждом шарде
+  void Warmup() {
+    for (int i = 0; i < 4 * obj.ShardCount(); ++i) {
+      int key = static_cast<int>((int64_t)keys * i / (4 * obj.ShardCount()));
+      obj.Insert(key);
+      obj.Remove(key);
+      sink += obj.FindByKey(key);
+    }
+  }
+  void Reset() {}
+  void Add(const int key) { obj.Insert(key); }
+  void Remove(const int key) { obj.Remove(key); }
+  void Read(const int key) { sink += obj.FindByKey(key); }
+  void Update(const int key) {
+    if (obj.Remove(key)) {
+      obj.Insert(key);
+    }
+  }
+  void Rank(const int key) {
+    int val = 0;
+    sink += obj.FindByRank(key, val);
+  }
+  double LockWait(const long long) { return -1; }
+};
+
+struct SkipListBench {
+  SkipList obj;
+  void Prefill(const int keys) {
+    for (int i = 0; i < keys; ++i) {
+      obj.Insert(i);
+    }
+  }
+  void Warmup() {}
+  void Reset() {}
+  void Add(const int key) { obj.Insert(key); }
+  void Remove(const int key) { obj.Remove(key); }
+  void Read(const int key) { sink += obj.FindByKey(key); }
+  void Update(const int key) {
+    if (obj.Remove(key)) {
+      obj.Insert(key);
+    }
+  }
+  void Rank(const int key) {
+    int val = 0;
+    sink += obj.FindByRank(key, val);
+  }
+  // Блокировки узлов короткие и не измеряются
+  double LockWait(const long long) { return -1; }
+};
+
+struct CombiningTreeBench {
+  AVLtree obj;
+  FlatCombining<AVLtree> fc{obj};
+  void Prefill(const int keys) {
+    for (int i = 0; i < keys; ++i) {
+      obj.Insert(i);
+    }
+  }
+  void Warmup() {}
+  void Reset() {}
+  void Add(const int key) { fc.Execute(key, [key](AVLtree& t) { t.Insert(key); }); }
+  void Remove(const int key) { fc.Execute(key, [key](AVLtree& t) { t.Remove(key); }); }
+  void Read(const int key) { sink += fc.Execute([key](AVLtree& t) { return t.FindByKey(key); }); }
+  void Update(const int key) {
+    fc.Execute(key, [key](AVLtree& t) {
+      if (t.Remove(key)) {
+        t.Insert(key);
+      }
+    });
+  }
+  void Rank(const int key) {
+    sink += fc.Execute([key](AVLtree& t) {
+      int val = 0;
+      return t.FindByRank(key, val);
+    });
+  }
+  double LockWait(const long long) { return -1; }
+};
+
+// Хеш-множество без порядка: ранга нет, Rank - поиск ключа
+struct HashSetBench {
+  ThreadsafeHashSet<int> obj;
+  void Prefill(const int keys) {
+    for (int i = 0; i < keys; ++i) {
+      obj.insert(i);
+    }
+  }
+  void Warmup() {}
+  void Reset() {}
+  void Add(const int key) { obj.insert(key); }
+  void Remove(const int key) { obj.erase(key); }
+  void Read(const int key) { sink += obj.contains(key); }
+  void Update(const int key) {
+    if (obj.erase(key)) {
+      obj.insert(key);
+    }
+  }
+  void Rank(const int key) { Read(key); }
+  double LockWait(const long long) { return -1; }
+};
+
+// Контейнеры, у которых есть вариант для каждого размера элемента
+inline const std::vector<std::string>& SizedContainers() {
+  static const std::vector<std::string> names = { "stack", "queue", "vector", "fc-stack", "fc-queue", "pq", "relaxed-pq" };
+  return names;
+}
+
+// Контейнеры ключей int
+inline const std::vector<std::string>& TreeContainers() {
+  static const std::vector<std::string> names = { "avl", "persistent-avl", "sharded-avl", "skip-list", "fc-avl",
+                                                  "hash-set" };
+  return names;
+}
+
+inline bool IsSizedContainer(const std::string& name) {
+  const std::vector<std::string>& names = SizedContainers();
+  return std::find(names.begin(), names.end(), name) != names.end();
+}
+
+inline bool IsTreeContainer(const std::string& name) {
+  const std::vector<std::string>& names = TreeContainers();
+  return std::find(names.begin(), names.end(), name) != names.end();
+}
+
+template<int Size, typename Visitor>
+bool VisitSized(const std::string& name, Visitor& visitor) {
+  using T = Element<Size>;
+  if (name == "stack") {
+    visitor.template Visit<StackBench<T>>();
+  }
+  else if (name == "queue") {
+    visitor.template Visit<QueueBench<T>>();
+  }
+  else if (name == "vector") {
+    visitor.template Visit<VectorBench<T>>();
+  }
+  else if (name == "fc-stack") {
+    visitor.template Visit<CombiningStackBench<T>>();
+  }
+  else if (name == "fc-queue") {
+    visitor.template Visit<CombiningQueueBench<T>>();
+  }
+  else if (name == "pq") {
+    visitor.template Visit<PriorityQueueBench<T>>();
+  }
+  else if (name == "relaxed-pq") {
+    visitor.template Visit<RelaxedPriorityQueueBench<T>>();
+  }
+  else {
+    return false;
+  }
+  return true;
+}
+
+// Вызов visitor.Visit<Bench>() для обертки контейнера name с элементами element_size байт;
+// false, если такого варианта нет
+template<typename Visitor>
+bool VisitContainer(const std::string& name, const int element_size, Visitor& visitor) {
+  if (name == "avl") {
+    visitor.template Visit<TreeBench>();
+  }
+  else if (name == "persistent-avl") {
+    visitor.template Visit<PersistentTreeBench>();
+  }
+  else if (name == "sharded-avl") {
+    visitor.template Visit<ShardedTreeBench>();
+  }
+  else if (name == "skip-list") {
+    visitor.template Visit<SkipListBench>();
+  }
+  else if (name == "fc-avl") {
+    visitor.template Visit<CombiningTreeBench>();
+  }
+  else if (name == "hash-set") {
+    visitor.template Visit<HashSetBench>();
+  }
+  else if (element_size == 4) {
+    return VisitSized<4>(name, visitor);
+  }
+  else if (element_size == 64) {
+    return VisitSized<64>(name, visitor);
+  }
+  else if (element_size == 256) {
+    return VisitSized<256>(name, visitor);
+  }
+  else {
+    return false;
+  }
+  return true;
+}
+
+#endif
@@ -0,0 +1,183 @@
+#include "common/cache_line.h"
+#include "vector-stack-queue/threadsafe_stack.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Ложное разделение строк кэша: у каждого потока свой контейнер, контейнеры
+// лежат в памяти подряд. Сравниваются плотный массив (соседние блокировки
+// в одной строке кэша), тот же тип в AlignedArray и ThreadsafeStack в AlignedArray.
+
+// Блокировка и данные без выравнивания, как в контейнерах до разнесения по строкам кэша
+struct Slot {
+  std::shared_mutex mutex;
+  std::vector<int> data;
+};
+
+struct Result {
+  std::string layout;
+  int threads;
+  size_t stride;
+  long long ops;
+  double seconds;
+  double ops_per_sec;
+};
+
+thread_local long long sink = 0;
+
+void SlotOps(Slot& slot, const int ops) {
+  for (int i = 0; i < ops; ++i) {
+    if (i % 4 == 3) {
+      std::shared_lock<std::shared_mutex> lock(slot.mutex);
+      sink += slot.data.size();
+    }
+    else {
+      std::lock_guard<std::shared_mutex> lock(slot.mutex);
+      if (slot.data.size() == 32) {
+        slot.data.clear();
+      }
+      slot.data.push_back(i);
+    }
+  }
+}
+
+void StackOps(ThreadsafeStack<int>& stack, const int ops) {
+  for (int i = 0; i < ops; ++i) {
+    if (i % 4 == 3) {
+      sink += stack.size();
+    }
+    else if (i % 4 == 2) {
+      stack.pop();
+    }
+    else {
+      stack.push(i);
+    }
+  }
+}
+
+// Запуск work(i) в потоке i одновременно во всех потоках
+template<typename Work>
+Result Run(const std::string& layout, const int threads, const size_t stride, const int ops, Work work) {
+  std::atomic<int> ready(0);
+  std::atomic<bool> go(false);
+  std::vector<std::thread> pool;
+  for (int t = 0; t < threads; ++t) {
+    pool.emplace_back([&, t]() {
+      ready.fetch_add(1);
+      while (!go.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+      }
+      work(t);
+    });
+  }
+  while (ready.load() < threads) {
+    std::this_thread::yield();
+  }
+  auto start = std::chrono::steady_clock::now();
+  go.store(true, std::memory_order_release);
+  for (auto& th : pool) {
+    th.join();
+  }
+  double seconds = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - start).count();
+  long long total = static_cast<long long>(ops) * threads;
+  return Result{ layout, threads, stride, total, seconds, seconds > 0 ? total / seconds : 0 };
+}
+
+std::vector<int> SplitInts(const std::string& s) {
+  std::vector<int> values;
+  size_t start = 0;
+  while (start <= s.size()) {
+    size_t end = s.find(',', start);
+    if (end == std::string::npos) {
+      end = s.size();
+    }
+    if (end > start) {
+      values.push_back(std::atoi(s.substr(start, end - start).c_str()));
+    }
+    start = end + 1;
+  }
+  return values;
+}
+
+int main(int argc, char** argv) {
+  std::vector<int> thread_counts;
+  int hw = std::max(4, static_cast<int>(std::thread::hardware_concurrency()));
+  for (int t = 1; t <= hw; t *= 2) {
+    thread_counts.push_back(t);
+  }
+  int ops = 1000000;
+  std::string out_path;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (i + 1 >= argc) {
+      arg.clear();
+    }
+    if (arg == "--threads") {
+      thread_counts = SplitInts(argv[++i]);
+    }
+    else if (arg == "--ops") {
+      ops = std::max(1, std::atoi(argv[++i]));
+    }
+    else if (arg == "--out") {
+      out_path = argv[++i];
+    }
+    else {
+      std::cerr << "usage: false_sharing [--threads LIST] [--ops N] [--out FILE]\n";
+      return 1;
+    }
+  }
+
+  std::vector<Result> results;
+  for (int threads : thread_counts) {
+    threads = std::max(threads, 1);
+    {
+      std::unique_ptr<Slot[]> slots(new Slot[threads]);
+      for (int t = 0; t < threads; ++t) {
+        slots[t].data.reserve(32);
+      }
+      results.push_back(Run("packed", threads, sizeof(Slot), ops, [&](int t) { SlotOps(slots[t], ops); }));
+    }
+    {
+      AlignedArray<Slot> slots(threads);
+      for (int t = 0; t < threads; ++t) {
+        slots[t].data.reserve(32);
+      }
+      results.push_back(Run("aligned", threads, AlignedArray<Slot>::stride, ops, [&](int t) { SlotOps(slots[t], ops); }));
+    }
+    {
+      AlignedArray<ThreadsafeStack<int>> stacks(threads);
+      results.push_back(Run("ThreadsafeStack", threads, AlignedArray<ThreadsafeStack<int>>::stride, ops,
+                            [&](int t) { StackOps(stacks[t], ops); }));
+    }
+  }
+
+  std::ofstream file;
+  if (!out_path.empty()) {
+    file.open(out_path);
+    if (!file) {
+      std::cerr << "cannot open " << out_path << std::endl;
+      return 1;
+    }
+  }
+  std::ostream& out = out_path.empty() ? std::cout : file;
+  out << "{\n  \"cache_line_size\": " << cache_line_size << ",\n  \"ops_per_thread\": " << ops
+      << ",\n  \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n  \"results\": [\n";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const Result& r = results[i];
+    out << "    {\"layout\": \"" << r.layout << "\", \"threads\": " << r.threads << ", \"stride\": " << r.stride
+        << ", \"ops\": " << r.ops << ", \"seconds\": " << r.seconds << ", \"ops_per_sec\": " << r.ops_per_sec
+        << (i + 1 < results.size() ? "},\n" : "}\n");
+  }
+  out << "  ]\n}\n";
+  return 0;
+}
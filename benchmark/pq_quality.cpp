@@ -0,0 +1,141 @@
+#include "vector-stack-queue/relaxed_priority_queue.h"
+#include "vector-stack-queue/threadsafe_priority_queue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Качество ослабленной очереди с приоритетом. В очередь кладутся ключи 0..n-1,
+// затем потоки одновременно извлекают их все. Номер извлечения берется из общего
+// счетчика; ошибка ранга - разность между ключом и номером (у строгой очереди
+// она отлична от нуля только из-за гонки между извлечением и счетчиком).
+
+struct Result {
+  std::string queue;
+  int threads;
+  long long pops;
+  double seconds;
+  double pops_per_sec;
+  double mean_rank_error;
+  long long max_rank_error;
+};
+
+template<typename Queue>
+Result Run(const std::string& name, Queue& queue, const int threads, const int n) {
+  std::vector<int> keys(n);
+  for (int i = 0; i < n; ++i) {
+    keys[i] = i;
+  }
+  std::shuffle(keys.begin(), keys.end(), std::mt19937(42));
+  for (int key : keys) {
+    queue.push(key);
+  }
+  std::atomic<long long> ticket(0);
+  std::vector<std::vector<long long>> errors(threads);
+  std::atomic<int> ready(0);
+  std::atomic<bool> go(false);
+  std::vector<std::thread> pool;
+  for (int t = 0; t < threads; ++t) {
+    pool.emplace_back([&, t]() {
+      errors[t].reserve(n / threads + 1);
+      ready.fetch_add(1);
+      while (!go.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+      }
+      int key = 0;
+      while (queue.try_pop(key)) {
+        long long order = ticket.fetch_add(1);
+        errors[t].push_back(std::abs(key - order));
+      }
+    });
+  }
+  while (ready.load() < threads) {
+    std::this_thread::yield();
+  }
+  auto start = std::chrono::steady_clock::now();
+  go.store(true, std::memory_order_release);
+  for (auto& th : pool) {
+    th.join();
+  }
+  double seconds = std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - start).count();
+  long long pops = 0, sum = 0, max = 0;
+  for (auto& e : errors) {
+    for (long long err : e) {
+      ++pops;
+      sum += err;
+      max = std::max(max, err);
+    }
+  }
+  return Result{ name, threads, pops, seconds, seconds > 0 ? pops / seconds : 0, pops ? sum * 1. / pops : 0, max };
+}
+
+int main(int argc, char** argv) {
+  std::vector<int> thread_counts;
+  int hw = std::max(4, static_cast<int>(std::thread::hardware_concurrency()));
+  for (int t = 1; t <= hw; t *= 2) {
+    thread_counts.push_back(t);
+  }
+  int n = 1000000;
+  unsigned factor = 2;
+  bool args_ok = argc % 2 == 1;
+  for (int i = 1; args_ok && i + 1 < argc; i += 2) {
+    std::string arg = argv[i];
+    if (arg == "--threads") {
+      thread_counts.clear();
+      std::string list = argv[i + 1];
+      for (size_t pos = 0; pos < list.size();) {
+        size_t end = std::min(list.find(',', pos), list.size());
+        thread_counts.push_back(std::max(1, std::atoi(list.substr(pos, end - pos).c_str())));
+        pos = end + 1;
+      }
+    }
+    else if (arg == "--keys") {
+      n = std::max(1, std::atoi(argv[i + 1]));
+    }
+    else if (arg == "--factor") {
+      factor = static_cast<unsigned>(std::max(1, std::atoi(argv[i + 1])));
+    }
+    else {
+      args_ok = false;
+    }
+  }
+  if (!args_ok) {
+    std::cerr << "usage: pq_quality [--threads LIST] [--keys N] [--factor C]\n";
+    return 1;
+  }
+
+  std::vector<Result> results;
+  for (int threads : thread_counts) {
+    {
+      ThreadsafePriorityQueue<int, std::greater<int>> queue;
+      results.push_back(Run("pq", queue, threads, n));
+    }
+    {
+      RelaxedPriorityQueue<int, std::greater<int>> queue(threads, factor);
+      results.push_back(Run("relaxed-pq", queue, threads, n));
+    }
+  }
+  std::cout << "{\n  \"keys\": " << n << ",\n  \"factor\": " << factor
+            << ",\n  \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n  \"results\": [\n";
+  for (size_t i = 0; i < results.size(); ++i) {
+    const Result& r = results[i];
+    std::cout << "    {\"queue\": \"" << r.queue << "\", \"threads\": " << r.threads << ", \"pops\": " << r.pops
+              << ", \"seconds\": " << r.seconds << ", \"pops_per_sec\": " << r.pops_per_sec
+              << ", \"mean_rank_error\": " << r.mean_rank_error << ", \"max_rank_error\": " << r.max_rank_error
+              << (i + 1 < results.size() ? "},\n" : "}\n");
+  }
+  std::cout << "  ]\n}\n";
+  bool complete = true;
+  for (const Result& r : results) {
+    complete = complete && r.pops == n;
+  }
+  return complete ? 0 : 1;
+}
@@ -0,0 +1,83 @@
+#include "avl-tree/avl_tree.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+// Время записи и загрузки снимка AVLtree в сравнении с повторной вставкой ключей.
+// Ключи - случайные различные числа, по умолчанию 1e7; для 1e8 нужно около 8 ГБ памяти (два дерева сразу).
+
+double Seconds(std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration_cast<std::chrono::duration<double>>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+  long long keys = 10000000;
+  std::string path = "avl_snapshot.bin";
+  bool compare = false;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--compare") {
+      compare = true;
+    }
+    else if (arg == "--keys" && i + 1 < argc) {
+      keys = std::max(1LL, std::min<long long>(std::atof(argv[++i]), 2000000000LL));
+    }
+    else if (arg == "--path" && i + 1 < argc) {
+      path = argv[++i];
+    }
+    else {
+      std::cerr << "usage: snapshot_reload [--keys N] [--path FILE] [--compare]\n"
+                << "  --compare  also time rebuilding the tree with one Insert per key\n";
+      return 1;
+    }
+  }
+
+  // Различные ключи с неравномерными промежутками: разности в varint занимают 1-3 байта
+  std::mt19937 gen(42);
+  std::vector<int> sorted(keys);
+  long long key = -static_cast<long long>(keys) * 64;
+  for (long long i = 0; i < keys; ++i) {
+    key += 1 + gen() % 256;
+    sorted[i] = static_cast<int>(key);
+  }
+  AVLtree tree;
+  tree.BuildFromSorted(sorted);
+
+  std::cout << "{\"keys\": " << keys << ", \"results\": [";
+  for (bool delta : { true, false }) {
+    auto start = std::chrono::steady_clock::now();
+    bool ok = tree.SaveSnapshot(path, delta);
+    double save = Seconds(start);
+    struct stat st;
+    long long bytes = ok && stat(path.c_str(), &st) == 0 ? st.st_size : 0;
+    AVLtree loaded;
+    start = std::chrono::steady_clock::now();
+    ok = ok && loaded.LoadSnapshot(path);
+    double load = Seconds(start);
+    ok = ok && loaded.Size() == tree.Size();
+    std::remove(path.c_str());
+    std::cout << (delta ? "" : ", ") << "{\"encoding\": \"" << (delta ? "delta" : "raw") << "\", \"ok\": "
+              << (ok ? "true" : "false") << ", \"bytes\": " << bytes << ", \"bytes_per_key\": " << bytes * 1. / keys
+              << ", \"save_seconds\": " << save << ", \"load_seconds\": " << load
+              << ", \"load_keys_per_sec\": " << keys / load << "}";
+  }
+  std::cout << "]";
+  if (compare) {
+    std::shuffle(sorted.begin(), sorted.end(), gen);
+    AVLtree replayed;
+    auto start = std::chrono::steady_clock::now();
+    for (int k : sorted) {
+      replayed.Insert(k);
+    }
+    std::cout << ", \"insert_replay_seconds\": " << Seconds(start);
+  }
+  std::cout << "}" << std::endl;
+  return 0;
+}
@@ -0,0 +1,99 @@
+#ifndef BENCHMARK_WORKLOAD_H
+#define BENCHMARK_WORKLOAD_H
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <string>
+
+// Распределения ключей для нагрузочных тестов
+enum class Distribution { uniform, zipf, sequential };
+
+inline const char* DistributionName(const Distribution d) {
+  switch (d) {
+  case Distribution::uniform: return "uniform";
+  case Distribution::zipf: return "zipf";
+  default: return "sequential";
+  }
+}
+
+inline bool ParseDistribution(const std::string& name, Distribution& d) {
+  if (name == "uniform") {
+    d = Distribution::uniform;
+  }
+  else if (name == "zipf") {
+    d = Distribution::zipf;
+  }
+  else if (name == "sequential" || name == "seq") {
+    d = Distribution::sequential;
+  }
+  else {
+    return false;
+  }
+  return true;
+}
+
+// Генератор ключей из [0, key_count). Случайность берется из переданного
+// mt19937, поэтому при одинаковом зерне последовательность воспроизводится.
+// Zipf - алгоритм Грея (как в YCSB) с theta = 0.99; номера ключей перемешиваются,
+// чтобы горячие ключи не лежали рядом.
+class KeyGenerator {
+public:
+  KeyGenerator(const Distribution d, const int key_count, const int thread, const int threads)
+    :dist(d), n(std::max(key_count, 1)), next(0) {
+    if (dist == Distribution::sequential) {
+      // Потоки начинают с разных участков диапазона
+      next = static_cast<int>((int64_t)n * thread / std::max(threads, 1));
+    }
+    if (dist == Distribution::zipf) {
+      for (int i = 1; i <= n; ++i) {
+        zetan += 1. / std::pow(i, theta);
+      }
+      double zeta2 = 1. + 1. / std::pow(2., theta);
+      alpha = 1. / (1. - theta);
+      eta = (1. - std::pow(2. / n, 1. - theta)) / (1. - zeta2 / zetan);
+    }
+  }
+
+  int Next(std::mt19937& rng) {
+    switch (dist) {
+    case Distribution::uniform:
+      return std::uniform_int_distribution<int>(0, n - 1)(rng);
+    case Distribution::zipf:
+      return Scramble(Zipf(rng));
+    default: {
+      int key = next;
+      next = next + 1 == n ? 0 : next + 1;
+      return key;
+    }
+    }
+  }
+
+private:
+  int Zipf(std::mt19937& rng) {
+    double u = std::uniform_real_distribution<double>(0., 1.)(rng);
+    double uz = u * zetan;
+    if (uz < 1.) {
+      return 0;
+    }
+    if (uz < 1. + std::pow(0.5, theta)) {
+      return 1;
+    }
+    return std::min(n - 1, static_cast<int>(n * std::pow(eta * u - eta + 1., alpha)));
+  }
+
+  int Scramble(const int rank) const {
+    return static_cast<int>(static_cast<uint32_t>(rank) * 2654435761u % static_cast<uint32_t>(n));
+  }
+
+  static constexpr double theta = 0.99;
+  Distribution dist;
+  int n;
+  int next;
+  double zetan = 0.;
+  double alpha = 0.;
+  double eta = 0.;
+};
+
+#endif
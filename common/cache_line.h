@@ -0,0 +1,71 @@
+#ifndef CACHE_LINE_H
+#define CACHE_LINE_H
+
+#include <cstddef>
+#include <new>
+
+// Размер, на который нужно разносить данные, изменяемые разными потоками,
+// чтобы они не попадали в одну строку кэша (ложное разделение)
+#if defined(__cpp_lib_hardware_interference_size)
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Winterference-size"
+#endif
+constexpr std::size_t cache_line_size = std::hardware_destructive_interference_size;
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic pop
+#endif
+#else
+constexpr std::size_t cache_line_size = 64;
+#endif
+
+// Массив объектов, каждый из которых начинается с новой строки кэша.
+// Объекты создаются на месте, поэтому подходят и некопируемые контейнеры.
+template<typename T>
+class AlignedArray {
+public:
+  template<typename... Args>
+  explicit AlignedArray(const std::size_t n, const Args&... args);
+  ~AlignedArray();
+  AlignedArray(const AlignedArray&) = delete;
+  AlignedArray& operator=(const AlignedArray&) = delete;
+
+  T& operator[](const std::size_t i) { return *reinterpret_cast<T*>(data + i * stride); }
+  const T& operator[](const std::size_t i) const { return *reinterpret_cast<const T*>(data + i * stride); }
+  std::size_t size() const { return count; }
+
+  // Шаг между соседними объектами: sizeof(T), округленный вверх до строки кэша
+  static constexpr std::size_t stride = (sizeof(T) + cache_line_size - 1) / cache_line_size * cache_line_size;
+
+private:
+  static constexpr std::size_t alignment = alignof(T) > cache_line_size ? alignof(T) : cache_line_size;
+
+  unsigned char* data = nullptr;
+  std::size_t count = 0;
+};
+
+template<typename T>
+template<typename... Args>
+AlignedArray<T>::AlignedArray(const std::size_t n, const Args&... args) {
+  static_assert(stride % alignof(T) == 0, "stride must keep every element aligned");
+  data = static_cast<unsigned char*>(::operator new(n * stride, std::align_val_t(alignment)));
+  try {
+    for (; count < n; ++count) {
+      new (data + count * stride) T(args...);
+    }
+  }
+  catch (...) {
+    this->~AlignedArray();
+    throw;
+  }
+}
+
+template<typename T>
+AlignedArray<T>::~AlignedArray() {
+  while (count > 0) {
+    (*this)[--count].~T();
+  }
+  ::operator delete(data, std::align_val_t(alignment));
+}
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+#include "common/cache_line.h"
+
+// Ожидание читателей по эпохам, как в SRCU. Читатель на время чтения
+// увеличивает счетчик текущей эпохи и ничего не блокирует. Писатель,
+// убрав объект из структуры, вызывает Synchronize(): эпоха дважды
+// переключается, и писатель ждет, пока обнулятся счетчики прежних эпох.
+// После этого на убранный объект не ссылается ни один читатель, если он был
+// убран атомарной записью с порядком seq_cst, как и все операции со счетчиками.
+// Счетчики разнесены по строкам кэша и выбираются по потоку.
+class EpochDomain {
+public:
+  // Участок чтения: пока объект жив, убранные из структуры объекты не освобождаются
+  class Guard {
+  public:
+    explicit Guard(EpochDomain& domain);
+    ~Guard() { counter->fetch_sub(1, std::memory_order_release); }
+    Guard(const Guard&) = delete;
+    Guard& operator=(const Guard&) = delete;
+
+  private:
+    std::atomic<long>* counter;
+  };
+
+  explicit EpochDomain(const unsigned stripes = std::thread::hardware_concurrency());
+  EpochDomain(const EpochDomain&) = delete;
+  EpochDomain& operator=(const EpochDomain&) = delete;
+
+  // Ожидание конца всех чтений, начатых до вызова; вызывается вне Guard
+  void Synchronize();
+
+private:
+  std::atomic<long>& Counter(const unsigned parity, const size_t stripe) {
+    return counters[parity * stripes + stripe];
+  }
+
+  const size_t stripes;
+  AlignedArray<std::atomic<long>> counters;
+  alignas(cache_line_size) std::atomic<unsigned> epoch{0};
+  std::mutex sync_mutex;
+};
+
+inline EpochDomain::Guard::Guard(EpochDomain& domain) {
+  thread_local size_t stripe = std::hash<std::thread::id>()(std::this_thread::get_id());
+  unsigned e = domain.epoch.load();
+  counter = &domain.Counter(e & 1, stripe % domain.stripes);
+  counter->fetch_add(1);
+}
+
+inline EpochDomain::EpochDomain(const unsigned stripes)
+  : stripes(stripes > 0 ? stripes : 1), counters(2 * this->stripes, 0L) {}
+
+inline void EpochDomain::Synchronize() {
+  std::lock_guard<std::mutex> lock(sync_mutex);
+  // Читатель мог прочитать номер эпохи до переключения и отметиться в старом
+  // счетчике позже; второе переключение дожидается и таких читателей
+  for (int round = 0; round < 2; ++round) {
+    unsigned e = epoch.load();
+    epoch.store(e + 1);
+    for (size_t i = 0; i < stripes; ++i) {
+      while (Counter(e & 1, i).load() != 0) {
+        std::this_thread::yield();
+      }
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef THREAD_RANDOM_H
+#define THREAD_RANDOM_H
+
+#include <atomic>
+#include <cstdint>
+
+// xorshift: генератор потока без общих данных; для выбора случайной кучи или очереди
+inline uint64_t ThreadRandom() {
+  static std::atomic<uint64_t> seed(0x9E3779B97F4A7C15ull);
+  thread_local uint64_t state = seed.fetch_add(0x9E3779B97F4A7C15ull, std::memory_order_relaxed) | 1;
+  state ^= state << 13;
+  state ^= state >> 7;
+  state ^= state << 17;
+  return state;
+}
+
+#endif
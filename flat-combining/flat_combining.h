@@ -0,0 +1,358 @@
+#ifndef FLAT_COMBINING_H
+#define FLAT_COMBINING_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "common/cache_line.h"
+
+// Адаптер плоского комбинирования (flat combining) для любого контейнера.
+// Поток публикует операцию в своей записи и ждет; поток, захвативший
+// блокировку комбинатора, применяет к контейнеру все опубликованные операции
+// за один проход. Операции с ключом применяются первыми по возрастанию ключа,
+// поэтому вставки в AVLtree идут по соседним путям дерева.
+// Сам контейнер не меняется: комбинатор вызывает его обычные методы, и
+// блокировка контейнера берется одним потоком без конкуренции.
+template<typename Container>
+class FlatCombining {
+public:
+  explicit FlatCombining(Container& obj);
+  FlatCombining(const FlatCombining&) = delete;
+  FlatCombining& operator=(const FlatCombining&) = delete;
+
+  // Выполнение op(obj) через комбинатор; результат op возвращается по значению
+  template<typename Op>
+  auto Execute(Op op) -> std::decay_t<decltype(op(std::declval<Container&>()))>;
+  // То же для операции с ключом: внутри прохода такие операции упорядочены по key
+  template<typename Op>
+  auto Execute(const int key, Op op) -> std::decay_t<decltype(op(std::declval<Container&>()))>;
+
+  // Число проходов комбинатора и примененных в них операций
+  uint64_t Passes() const { return passes.load(std::memory_order_relaxed); }
+  uint64_t Operations() const { return operations.load(std::memory_order_relaxed); }
+  // Записей в списке комбинатора
+  int64_t Records() const { return state->linked.load(std::memory_order_relaxed); }
+
+private:
+  enum { idle, pending, done };
+
+  // Запись потока; выравнивание по строке кэша, чтобы ожидающие потоки не мешали друг другу
+  struct alignas(cache_line_size) record {
+    std::atomic<int> state{idle};
+    void (*invoke)(Container&, void*) = nullptr;
+    void* context = nullptr;
+    bool ordered = false;
+    int key = 0;
+    record* next = nullptr;
+    // Запись в списке; снимает ее комбинатор, возвращает поток-владелец
+    std::atomic<bool> active{false};
+    // Номер прохода, в котором запись обслуживалась последний раз; меняет комбинатор
+    uint64_t age = 0;
+    // Поток-владелец завершился, запись удаляется при снятии со списка; под блокировкой комбинатора
+    bool abandoned = false;
+  };
+
+  // Общая часть адаптера; живет, пока на нее ссылается адаптер или кэш какого-нибудь потока
+  struct shared_state {
+    std::atomic<record*> records{nullptr};
+    std::atomic<int64_t> linked{0};
+    // Блокировка комбинатора
+    std::atomic<bool> combining{false};
+    ~shared_state();
+    bool TryLock() { return !combining.load(std::memory_order_relaxed) && !combining.exchange(true, std::memory_order_acquire); }
+    void Lock();
+    void Unlock() { combining.store(false, std::memory_order_release); }
+  };
+
+  // Запись потока для одного адаптера. При завершении потока запись вне списка
+  // удаляется сразу, а запись в списке помечается брошенной и удаляется комбинатором
+  struct cache {
+    std::shared_ptr<shared_state> owner;
+    record* rec;
+    cache(std::shared_ptr<shared_state> owner, record* rec) : owner(std::move(owner)), rec(rec) {}
+    cache(cache&& other) : owner(std::move(other.owner)), rec(std::exchange(other.rec, nullptr)) {}
+    cache& operator=(cache&& other);
+    ~cache();
+  };
+
+  // Записи потока для всех адаптеров, с которыми он работал
+  struct thread_records {
+    std::vector<cache> caches;
+  };
+
+  // Операция и место для ее результата на стеке ожидающего потока
+  template<typename Op, typename R>
+  struct call {
+    Op& op;
+    std::optional<R> result;
+    std::exception_ptr error;
+    explicit call(Op& op) : op(op) {}
+    static void Invoke(Container& obj, void* context);
+    R Result() { return std::move(*result); }
+  };
+
+  template<typename Op>
+  struct call<Op, void> {
+    Op& op;
+    std::exception_ptr error;
+    explicit call(Op& op) : op(op) {}
+    static void Invoke(Container& obj, void* context);
+    void Result() {}
+  };
+
+  template<typename Op>
+  auto Run(const bool ordered, const int key, Op& op) -> std::decay_t<decltype(op(std::declval<Container&>()))>;
+  // Запись текущего потока для этого адаптера
+  record* Record();
+  // Добавление записи владельца в начало списка
+  void Link(record* rec);
+  // Публикация операции и ожидание, пока ее применит комбинатор
+  void Publish(record* rec);
+  // Применение всех опубликованных операций; вызывается под блокировкой комбинатора
+  void Combine();
+  // Снятие со списка простаивающих записей; вызывается под блокировкой комбинатора
+  void Cleanup();
+
+  static thread_local thread_records tls;
+
+  Container& obj;
+  std::shared_ptr<shared_state> state;
+  std::vector<record*> batch;
+  // Номер прохода для возраста записей; меняется под блокировкой комбинатора
+  uint64_t pass_count = 0;
+  std::atomic<uint64_t> passes;
+  std::atomic<uint64_t> operations;
+};
+
+namespace flat_combining_detail {
+
+// Каждые cleanup_period проходов комбинатор снимает записи, простаивающие больше max_idle проходов
+const uint64_t cleanup_period = 64;
+const uint64_t max_idle = 256;
+
+}
+
+template<typename Container>
+thread_local typename FlatCombining<Container>::thread_records FlatCombining<Container>::tls;
+
+template<typename Container>
+FlatCombining<Container>::FlatCombining(Container& obj)
+  :obj(obj), state(std::make_shared<shared_state>()), passes(0), operations(0) {
+}
+
+template<typename Container>
+FlatCombining<Container>::shared_state::~shared_state() {
+  record* p = records.load();
+  while (p) {
+    record* next = p->next;
+    delete p;
+    p = next;
+  }
+}
+
+template<typename Container>
+void FlatCombining<Container>::shared_state::Lock() {
+  while (!TryLock()) {
+    std::this_thread::yield();
+  }
+}
+
+template<typename Container>
+typename FlatCombining<Container>::cache& FlatCombining<Container>::cache::operator=(cache&& other) {
+  // Обмен: прежняя запись достается other и обрабатывается его деструктором
+  std::swap(owner, other.owner);
+  std::swap(rec, other.rec);
+  return *this;
+}
+
+template<typename Container>
+FlatCombining<Container>::cache::~cache() {
+  if (!rec) {
+    return;
+  }
+  owner->Lock();
+  if (rec->active.load(std::memory_order_relaxed)) {
+    rec->abandoned = true;
+  }
+  else {
+    delete rec;
+  }
+  owner->Unlock();
+}
+
+template<typename Container>
+template<typename Op>
+auto FlatCombining<Container>::Execute(Op op) -> std::decay_t<decltype(op(std::declval<Container&>()))> {
+  return Run(false, 0, op);
+}
+
+template<typename Container>
+template<typename Op>
+auto FlatCombining<Container>::Execute(const int key, Op op) -> std::decay_t<decltype(op(std::declval<Container&>()))> {
+  return Run(true, key, op);
+}
+
+template<typename Container>
+template<typename Op>
+auto FlatCombining<Container>::Run(const bool ordered, const int key, Op& op)
+  -> std::decay_t<decltype(op(std::declval<Container&>()))> {
+  using R = std::decay_t<decltype(op(std::declval<Container&>()))>;
+  call<Op, R> c(op);
+  record* rec = Record();
+  rec->invoke = &call<Op, R>::Invoke;
+  rec->context = &c;
+  rec->ordered = ordered;
+  rec->key = key;
+  Publish(rec);
+  if (c.error) {
+    std::rethrow_exception(c.error);
+  }
+  return c.Result();
+}
+
+template<typename Container>
+template<typename Op, typename R>
+void FlatCombining<Container>::call<Op, R>::Invoke(Container& obj, void* context) {
+  call* c = static_cast<call*>(context);
+  try {
+    c->result.emplace(c->op(obj));
+  }
+  catch (...) {
+    c->error = std::current_exception();
+  }
+}
+
+template<typename Container>
+template<typename Op>
+void FlatCombining<Container>::call<Op, void>::Invoke(Container& obj, void* context) {
+  call* c = static_cast<call*>(context);
+  try {
+    c->op(obj);
+  }
+  catch (...) {
+    c->error = std::current_exception();
+  }
+}
+
+// Запись текущего потока для этого адаптера
+template<typename Container>
+typename FlatCombining<Container>::record* FlatCombining<Container>::Record() {
+  std::vector<cache>& caches = tls.caches;
+  // Последний использованный адаптер - в конце
+  if (!caches.empty() && caches.back().owner == state) {
+    return caches.back().rec;
+  }
+  for (size_t i = 0; i < caches.size();) {
+    if (caches[i].owner == state) {
+      std::swap(caches[i], caches.back());
+      return caches.back().rec;
+    }
+    // Адаптер удален, его общую часть держит только этот кэш
+    if (caches[i].owner.use_count() == 1) {
+      caches.erase(caches.begin() + i);
+    }
+    else {
+      ++i;
+    }
+  }
+  caches.emplace_back(state, new record);
+  return caches.back().rec;
+}
+
+// Добавление записи владельца в начало списка; начало списка комбинатор не снимает
+template<typename Container>
+void FlatCombining<Container>::Link(record* rec) {
+  rec->active.store(true, std::memory_order_relaxed);
+  state->linked.fetch_add(1, std::memory_order_relaxed);
+  record* head = state->records.load(std::memory_order_relaxed);
+  do {
+    rec->next = head;
+  } while (!state->records.compare_exchange_weak(head, rec, std::memory_order_release, std::memory_order_relaxed));
+}
+
+// Публикация операции и ожидание, пока ее применит комбинатор
+template<typename Container>
+void FlatCombining<Container>::Publish(record* rec) {
+  rec->state.store(pending, std::memory_order_release);
+  for (int spin = 0; rec->state.load(std::memory_order_acquire) != done; ++spin) {
+    // Простаивавшую запись комбинатор мог снять со списка; тогда она возвращается
+    if (!rec->active.load(std::memory_order_acquire)) {
+      Link(rec);
+    }
+    // Блокировка захватывается, только если она выглядит свободной
+    if (state->TryLock()) {
+      Combine();
+      state->Unlock();
+    }
+    else if (spin >= 64) {
+      std::this_thread::yield();
+    }
+  }
+  rec->state.store(idle, std::memory_order_relaxed);
+}
+
+// Применение всех опубликованных операций; вызывается под блокировкой комбинатора
+template<typename Container>
+void FlatCombining<Container>::Combine() {
+  // Несколько проходов подбирают операции, опубликованные во время предыдущего
+  const int max_passes = 3;
+  for (int pass = 0; pass < max_passes; ++pass) {
+    if (++pass_count % flat_combining_detail::cleanup_period == 0) {
+      Cleanup();
+    }
+    batch.clear();
+    for (record* p = state->records.load(std::memory_order_acquire); p; p = p->next) {
+      if (p->state.load(std::memory_order_acquire) == pending) {
+        p->age = pass_count;
+        batch.push_back(p);
+      }
+    }
+    if (batch.empty()) {
+      break;
+    }
+    auto unordered = std::stable_partition(batch.begin(), batch.end(), [](const record* p) { return p->ordered; });
+    std::stable_sort(batch.begin(), unordered, [](const record* a, const record* b) { return a->key < b->key; });
+    for (record* p : batch) {
+      p->invoke(obj, p->context);
+      p->state.store(done, std::memory_order_release);
+    }
+    passes.fetch_add(1, std::memory_order_relaxed);
+    operations.fetch_add(batch.size(), std::memory_order_relaxed);
+  }
+}
+
+// Снятие со списка записей, простаивающих больше max_idle проходов (Hendler, Incze,
+// Shavit, Tzafrir): иначе каждый проход обходит записи давно не работающих потоков.
+// Начало списка не снимается, туда без блокировки добавляют записи владельцы
+template<typename Container>
+void FlatCombining<Container>::Cleanup() {
+  record* prev = state->records.load(std::memory_order_acquire);
+  if (!prev) {
+    return;
+  }
+  for (record* p = prev->next; p; p = prev->next) {
+    if (pass_count - p->age > flat_combining_detail::max_idle && p->state.load(std::memory_order_acquire) == idle) {
+      prev->next = p->next;
+      state->linked.fetch_sub(1, std::memory_order_relaxed);
+      if (p->abandoned) {
+        delete p;
+      }
+      else {
+        p->active.store(false, std::memory_order_release);
+      }
+    }
+    else {
+      prev = p;
+    }
+  }
+}
+
+#endif
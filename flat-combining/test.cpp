@@ -0,0 +1,164 @@
+#include "flat_combining.h"
+#include "avl-tree/avl_tree.h"
+#include "vector-stack-queue/threadsafe_queue.h"
+#include "vector-stack-queue/threadsafe_stack.h"
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+const int threads_count = 4;
+
+template<typename Func>
+double runThreads(Func func) {
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (int i = 0; i < threads_count; ++i) {
+    threads.emplace_back(func, i);
+  }
+  for (auto& th : threads) {
+    th.join();
+  }
+  auto finish = std::chrono::steady_clock::now();
+  return std::chrono::duration_cast<std::chrono::milliseconds>(finish - start).count();
+}
+
+template<typename Container>
+void printStats(const FlatCombining<Container>& fc) {
+  std::cout << "Проходов комбинатора: " << fc.Passes() << ", средний размер пакета: "
+            << fc.Operations() * 1. / std::max<uint64_t>(fc.Passes(), 1) << std::endl;
+}
+
+void testStack() {
+  int n = 200000;
+  ThreadsafeStack<int> direct;
+  double t1 = runThreads([&](int) {
+    for (int i = 0; i < n; ++i) {
+      direct.push(i);
+      if (i % 2) {
+        direct.pop();
+      }
+    }
+  });
+  ThreadsafeStack<int> obj;
+  FlatCombining<ThreadsafeStack<int>> fc(obj);
+  double t2 = runThreads([&](int) {
+    for (int i = 0; i < n; ++i) {
+      fc.Execute([i](ThreadsafeStack<int>& s) { s.push(i); });
+      if (i % 2) {
+        fc.Execute([](ThreadsafeStack<int>& s) { s.pop(); });
+      }
+    }
+  });
+  std::cout << "----------СТЕК----------" << std::endl;
+  std::cout << "Напрямую: " << t1 << " ms, размер " << direct.size() << std::endl;
+  std::cout << "С комбинированием: " << t2 << " ms, размер " << obj.size() << std::endl;
+  printStats(fc);
+  std::cout << std::endl;
+}
+
+void testQueue() {
+  int n = 200000;
+  ThreadsafeQueue<int> obj;
+  FlatCombining<ThreadsafeQueue<int>> fc(obj);
+  std::vector<long long> sums(threads_count);
+  double t = runThreads([&](int id) {
+    for (int i = 0; i < n; ++i) {
+      fc.Execute([i](ThreadsafeQueue<int>& q) { q.push(i); });
+      // Проверка и извлечение выполняются комбинатором как одна операция
+      sums[id] += fc.Execute([](ThreadsafeQueue<int>& q) {
+        int val = 0;
+        if (!q.empty()) {
+          val = q.front();
+          q.pop();
+        }
+        return val;
+      });
+    }
+  });
+  long long sum = 0;
+  for (long long s : sums) {
+    sum += s;
+  }
+  std::cout << "----------ОЧЕРЕДЬ----------" << std::endl;
+  std::cout << "С комбинированием: " << t << " ms, размер " << obj.size() << std::endl;
+  std::cout << "Сумма извлеченных элементов: " << sum << " (ожидается "
+            << (long long)threads_count * n * (n - 1) / 2 << ")" << std::endl;
+  printStats(fc);
+  std::cout << std::endl;
+}
+
+void testTree() {
+  int n = 100000;
+  AVLtree direct;
+  double t1 = runThreads([&](int id) {
+    for (int i = 0; i < n; ++i) {
+      direct.Insert(i * threads_count + id);
+    }
+  });
+  AVLtree obj;
+  FlatCombining<AVLtree> fc(obj);
+  double t2 = runThreads([&](int id) {
+    for (int i = 0; i < n; ++i) {
+      int key = i * threads_count + id;
+      fc.Execute(key, [key](AVLtree& tree) { tree.Insert(key); });
+    }
+  });
+  bool ok = obj.Size() == threads_count * n;
+  for (int i = 1; ok && i <= obj.Size(); i += 997) {
+    int val = -1;
+    ok = obj.FindByRank(i, val) && val == i - 1;
+  }
+  std::cout << "----------ДЕРЕВО----------" << std::endl;
+  std::cout << "Напрямую: " << t1 << " ms, размер " << direct.Size() << std::endl;
+  std::cout << "С комбинированием: " << t2 << " ms, размер " << obj.Size() << std::endl;
+  std::cout << "Порядок ключей " << (ok ? "верный" : "НЕВЕРНЫЙ") << std::endl;
+  printStats(fc);
+  std::cout << std::endl;
+}
+
+// Потоки приходят и уходят и работают с большим числом адаптеров, чем раньше помещалось
+// в кэш записей потока: список комбинатора не должен расти с числом потоков
+void testRecords() {
+  const int adapters_count = 6;
+  const int rounds = 50;
+  const int n = 200;
+  ThreadsafeStack<int> obj;
+  std::vector<std::unique_ptr<FlatCombining<ThreadsafeStack<int>>>> fcs;
+  for (int i = 0; i < adapters_count; ++i) {
+    fcs.emplace_back(new FlatCombining<ThreadsafeStack<int>>(obj));
+  }
+  for (int round = 0; round < rounds; ++round) {
+    runThreads([&](int) {
+      for (int i = 0; i < n; ++i) {
+        fcs[i % adapters_count]->Execute([i](ThreadsafeStack<int>& s) { s.push(i); });
+      }
+    });
+  }
+  // Проходы одного потока стареют записи завершившихся потоков
+  for (auto& fc : fcs) {
+    for (int i = 0; i < 1000; ++i) {
+      fc->Execute([](ThreadsafeStack<int>& s) { s.pop(); });
+    }
+  }
+  int64_t records = 0;
+  for (auto& fc : fcs) {
+    records += fc->Records();
+  }
+  std::cout << "----------ЗАПИСИ----------" << std::endl;
+  std::cout << "Потоков: " << rounds * threads_count << ", адаптеров: " << adapters_count
+            << ", записей в списках: " << records << std::endl;
+  std::cout << std::endl;
+}
+
+int main() {
+  setlocale(LC_ALL, "Russian");
+  testStack();
+  testQueue();
+  testTree();
+  testRecords();
+  return 0;
+}
@@ -0,0 +1,227 @@
+#ifndef LOCK_TRACE_H
+#define LOCK_TRACE_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "metrics.h"
+
+// Трассировка блокировок контейнеров для просмотра на временной шкале
+// (chrome://tracing, ui.perfetto.dev). Каждая операция записывает три момента:
+// начало ожидания блокировки, захват и освобождение. Записи хранятся в кольцевом
+// буфере потока; при переполнении затираются самые старые. Dump сохраняет
+// их как Chrome trace JSON: каждый экземпляр контейнера - отдельный процесс,
+// каждая операция - отрезок ожидания и отрезок удержания блокировки.
+namespace lock_trace {
+
+using clock = std::chrono::steady_clock;
+
+struct Event {
+  const void* instance;
+  const char* container;
+  const char* op;
+  bool exclusive;
+  uint32_t thread;
+  clock::time_point begin;
+  clock::time_point acquired;
+  clock::time_point released;
+};
+
+namespace detail {
+
+const uint64_t ring_size = 1 << 14;
+
+// Буфер пишет только владелец. События текущего включения начинаются с start;
+// владелец сам сдвигает start, когда видит новое поколение
+struct Ring {
+  Event events[ring_size];
+  std::atomic<uint64_t> head{0};
+  std::atomic<uint64_t> start{0};
+  std::atomic<uint64_t> generation{0};
+  uint32_t thread = 0;
+};
+
+// Буфер завершившегося потока достается следующему новому потоку, а до тех пор
+// хранит события, чтобы они попали в Dump. Буферы удаляются в конце программы
+struct Tracer {
+  std::atomic<bool> enabled{false};
+  // Номер включения трассировки
+  std::atomic<uint64_t> generation{0};
+  std::mutex registry_mutex;
+  std::vector<Ring*> rings;
+  std::vector<Ring*> free_rings;
+  uint32_t next_thread = 0;
+
+  ~Tracer() {
+    for (Ring* ring : rings) {
+      delete ring;
+    }
+  }
+};
+
+inline Tracer& Instance() {
+  static Tracer tracer;
+  return tracer;
+}
+
+// Возврат буфера при завершении потока
+struct RingOwner {
+  Ring* ring = nullptr;
+  ~RingOwner() {
+    if (ring) {
+      Tracer& t = Instance();
+      std::lock_guard<std::mutex> lock(t.registry_mutex);
+      t.free_rings.push_back(ring);
+    }
+  }
+};
+
+inline Ring* MyRing() {
+  thread_local RingOwner owner;
+  if (!owner.ring) {
+    Tracer& t = Instance();
+    std::lock_guard<std::mutex> lock(t.registry_mutex);
+    if (!t.free_rings.empty()) {
+      owner.ring = t.free_rings.back();
+      t.free_rings.pop_back();
+    }
+    else {
+      owner.ring = new Ring;
+      t.rings.push_back(owner.ring);
+    }
+    owner.ring->thread = t.next_thread++;
+  }
+  return owner.ring;
+}
+
+inline double Micros(const clock::time_point t, const clock::time_point origin) {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(t - origin).count() / 1000.;
+}
+
+}
+
+inline bool Enabled() {
+  return detail::Instance().enabled.load(std::memory_order_relaxed);
+}
+
+// Включение трассировки; события предыдущего включения в Dump не попадают
+inline void Start() {
+  detail::Tracer& t = detail::Instance();
+  t.generation.fetch_add(1, std::memory_order_relaxed);
+  t.enabled.store(true, std::memory_order_release);
+}
+
+inline void Stop() {
+  detail::Instance().enabled.store(false, std::memory_order_release);
+}
+
+// Момент начала ожидания для операций, которые сами его не измеряют;
+// нужен и трассировке, и метрикам
+inline clock::time_point Begin() {
+  return Enabled() || metrics::Enabled() ? clock::now() : clock::time_point();
+}
+
+inline void Record(const void* instance, const char* container, const char* op, const bool exclusive,
+                   const clock::time_point begin, const clock::time_point acquired, const clock::time_point released) {
+  // Нулевое начало - трассировку включили посреди операции
+  if (!Enabled() || begin == clock::time_point()) {
+    return;
+  }
+  detail::Tracer& t = detail::Instance();
+  detail::Ring* ring = detail::MyRing();
+  uint64_t head = ring->head.load(std::memory_order_relaxed);
+  uint64_t generation = t.generation.load(std::memory_order_relaxed);
+  if (ring->generation.load(std::memory_order_relaxed) != generation) {
+    ring->start.store(head, std::memory_order_relaxed);
+    ring->generation.store(generation, std::memory_order_release);
+  }
+  ring->events[head % detail::ring_size] = Event{ instance, container, op, exclusive, ring->thread, begin, acquired, released };
+  ring->head.store(head + 1, std::memory_order_release);
+}
+
+// Сохранение событий в формате Chrome trace; вызывается после Stop()
+inline bool Dump(const std::string& path) {
+  detail::Tracer& t = detail::Instance();
+  std::vector<std::pair<uint32_t, Event>> events;
+  {
+    std::lock_guard<std::mutex> lock(t.registry_mutex);
+    uint64_t generation = t.generation.load(std::memory_order_relaxed);
+    for (detail::Ring* ring : t.rings) {
+      if (ring->generation.load(std::memory_order_acquire) != generation) {
+        continue;
+      }
+      uint64_t head = ring->head.load(std::memory_order_acquire);
+      // Самая старая ячейка может перезаписываться операцией, начатой до Stop()
+      uint64_t first = head > detail::ring_size - 1 ? head - (detail::ring_size - 1) : 0;
+      first = std::max(first, ring->start.load(std::memory_order_relaxed));
+      for (uint64_t i = first; i < head; ++i) {
+        const Event& e = ring->events[i % detail::ring_size];
+        events.emplace_back(e.thread, e);
+      }
+    }
+  }
+  FILE* out = std::fopen(path.c_str(), "w");
+  if (!out) {
+    return false;
+  }
+  clock::time_point origin = clock::time_point::max();
+  for (auto& e : events) {
+    origin = std::min(origin, e.second.begin);
+  }
+  std::fprintf(out, "{\"displayTimeUnit\": \"ns\", \"traceEvents\": [\n");
+  bool first = true;
+  auto separator = [&]() {
+    std::fprintf(out, first ? "  " : ",\n  ");
+    first = false;
+  };
+  std::map<const void*, int> instances;
+  std::map<uint32_t, bool> threads;
+  for (auto& p : events) {
+    const Event& e = p.second;
+    int pid = 0;
+    auto it = instances.find(e.instance);
+    if (it == instances.end()) {
+      pid = static_cast<int>(instances.size()) + 1;
+      instances[e.instance] = pid;
+      separator();
+      std::fprintf(out, "{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": %d, \"args\": {\"name\": \"%s %p\"}}",
+                   pid, e.container, e.instance);
+    }
+    else {
+      pid = it->second;
+    }
+    const char* mode = e.exclusive ? "exclusive" : "shared";
+    if (e.acquired > e.begin) {
+      separator();
+      std::fprintf(out, "{\"name\": \"%s wait\", \"cat\": \"wait\", \"ph\": \"X\", \"pid\": %d, \"tid\": %u, "
+                   "\"ts\": %.3f, \"dur\": %.3f, \"args\": {\"lock\": \"%s\"}}",
+                   e.op, pid, p.first, detail::Micros(e.begin, origin), detail::Micros(e.acquired, e.begin), mode);
+    }
+    separator();
+    std::fprintf(out, "{\"name\": \"%s\", \"cat\": \"%s\", \"ph\": \"X\", \"pid\": %d, \"tid\": %u, "
+                 "\"ts\": %.3f, \"dur\": %.3f}",
+                 e.op, mode, pid, p.first, detail::Micros(e.acquired, origin), detail::Micros(e.released, e.acquired));
+    threads[p.first] = true;
+  }
+  // Имена потоков нужны в каждом процессе, где поток встречается
+  for (auto& inst : instances) {
+    for (auto& th : threads) {
+      separator();
+      std::fprintf(out, "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %u, "
+                   "\"args\": {\"name\": \"thread %u\"}}", inst.second, th.first, th.first);
+    }
+  }
+  std::fprintf(out, "\n]}\n");
+  return std::fclose(out) == 0;
+}
+
+}
+
+#endif
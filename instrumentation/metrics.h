@@ -0,0 +1,345 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#include "common/cache_line.h"
+
+// Метрики контейнеров для долго работающих сервисов. Каждый контейнер хранит
+// LockStats: счетчики операций, ожидания блокировки и гистограмму ожидания,
+// разбитые на полосы по потокам, чтобы потоки не делили строки кэша.
+// Контейнер, зарегистрированный через Registration, попадает в отчет
+// фонового потока, который с заданным интервалом записывает файл в текстовом
+// формате Prometheus (для textfile collector node_exporter).
+// Пока опрос не запущен, операции контейнеров только проверяют флаг.
+namespace metrics {
+
+using clock = std::chrono::steady_clock;
+
+namespace detail {
+
+inline std::atomic<bool>& Collecting() {
+  static std::atomic<bool> collecting(false);
+  return collecting;
+}
+
+inline unsigned ThreadStripe() {
+  static std::atomic<unsigned> next(0);
+  thread_local unsigned stripe = next.fetch_add(1, std::memory_order_relaxed);
+  return stripe;
+}
+
+}
+
+inline bool Enabled() {
+  return detail::Collecting().load(std::memory_order_relaxed);
+}
+
+class LockStats {
+public:
+  static const int buckets = 32;
+  // Ожидание дольше этого считается конфликтом за блокировку
+  static const uint64_t contended_ns = 1000;
+
+  struct Snapshot {
+    uint64_t ops = 0;
+    uint64_t contended = 0;
+    uint64_t wait_ns = 0;
+    uint64_t work_ns = 0;
+    // hist[i] - число ожиданий длительностью меньше 2^i нс (и не меньше 2^(i-1))
+    uint64_t hist[buckets] = {};
+    int64_t size = 0;
+    int64_t height = -1;
+  };
+
+  explicit LockStats(const char* kind) : kind(kind) {}
+  LockStats(const LockStats&) = delete;
+  LockStats& operator=(const LockStats&) = delete;
+
+  const char* Kind() const { return kind; }
+
+  void Record(const clock::time_point begin, const clock::time_point acquired, const clock::time_point released) {
+    if (!Enabled() || begin == clock::time_point()) {
+      return;
+    }
+    uint64_t wait = std::chrono::duration_cast<std::chrono::nanoseconds>(acquired - begin).count();
+    uint64_t work = std::chrono::duration_cast<std::chrono::nanoseconds>(released - acquired).count();
+    Stripe& s = stripe[detail::ThreadStripe() % stripes];
+    s.ops.fetch_add(1, std::memory_order_relaxed);
+    s.wait_ns.fetch_add(wait, std::memory_order_relaxed);
+    s.work_ns.fetch_add(work, std::memory_order_relaxed);
+    if (wait > contended_ns) {
+      s.contended.fetch_add(1, std::memory_order_relaxed);
+    }
+    s.hist[Bucket(wait)].fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // То же с текущим размером (и высотой для деревьев)
+  void Record(const clock::time_point begin, const clock::time_point acquired, const clock::time_point released,
+              const int64_t new_size, const int64_t new_height = -1) {
+    Record(begin, acquired, released);
+    Gauge(new_size, new_height);
+  }
+
+  // Значения пишутся, только если изменились, чтобы читатели не делили строку кэша
+  void Gauge(const int64_t new_size, const int64_t new_height = -1) {
+    if (!Enabled()) {
+      return;
+    }
+    if (size.load(std::memory_order_relaxed) != new_size) {
+      size.store(new_size, std::memory_order_relaxed);
+    }
+    if (height.load(std::memory_order_relaxed) != new_height) {
+      height.store(new_height, std::memory_order_relaxed);
+    }
+  }
+
+  Snapshot Read() const {
+    Snapshot res;
+    for (const Stripe& s : stripe) {
+      res.ops += s.ops.load(std::memory_order_relaxed);
+      res.contended += s.contended.load(std::memory_order_relaxed);
+      res.wait_ns += s.wait_ns.load(std::memory_order_relaxed);
+      res.work_ns += s.work_ns.load(std::memory_order_relaxed);
+      for (int i = 0; i < buckets; ++i) {
+        res.hist[i] += s.hist[i].load(std::memory_order_relaxed);
+      }
+    }
+    res.size = size.load(std::memory_order_relaxed);
+    res.height = height.load(std::memory_order_relaxed);
+    return res;
+  }
+
+private:
+  static const int stripes = 8;
+
+  struct alignas(cache_line_size) Stripe {
+    std::atomic<uint64_t> ops{0};
+    std::atomic<uint64_t> contended{0};
+    std::atomic<uint64_t> wait_ns{0};
+    std::atomic<uint64_t> work_ns{0};
+    std::atomic<uint64_t> hist[buckets] = {};
+  };
+
+  static int Bucket(uint64_t ns) {
+    int b = 0;
+    while (ns && b < buckets - 1) {
+      ns >>= 1;
+      ++b;
+    }
+    return b;
+  }
+
+  const char* kind;
+  Stripe stripe[stripes];
+  alignas(cache_line_size) std::atomic<int64_t> size{0};
+  std::atomic<int64_t> height{-1};
+};
+
+namespace detail {
+
+struct Entry {
+  std::string name;
+  const LockStats* stats;
+  LockStats::Snapshot prev;
+  clock::time_point prev_time;
+};
+
+struct Registry {
+  std::mutex mutex;
+  std::map<uint64_t, Entry> entries;
+  uint64_t next_id = 1;
+  // Фоновый опрос
+  std::thread sampler;
+  std::mutex sampler_mutex;
+  std::condition_variable wake;
+  bool stop = false;
+
+  ~Registry() {
+    {
+      std::lock_guard<std::mutex> lock(sampler_mutex);
+      stop = true;
+    }
+    wake.notify_all();
+    if (sampler.joinable()) {
+      sampler.join();
+    }
+  }
+};
+
+inline Registry& Instance() {
+  static Registry registry;
+  return registry;
+}
+
+inline std::string Escape(const std::string& s) {
+  std::string res;
+  for (char c : s) {
+    if (c == '\\' || c == '"') {
+      res += '\\';
+      res += c;
+    }
+    else if (c == '\n') {
+      res += "\\n";
+    }
+    else {
+      res += c;
+    }
+  }
+  return res;
+}
+
+// Верхняя граница интервала гистограммы, в который попадает доля q ожиданий
+inline double Quantile(const uint64_t* hist, const uint64_t total, const double q) {
+  if (total == 0) {
+    return 0;
+  }
+  uint64_t need = static_cast<uint64_t>(q * total + 0.5);
+  uint64_t sum = 0;
+  for (int i = 0; i < LockStats::buckets; ++i) {
+    sum += hist[i];
+    if (sum >= need) {
+      return i == 0 ? 0 : static_cast<double>(uint64_t(1) << i);
+    }
+  }
+  return static_cast<double>(uint64_t(1) << (LockStats::buckets - 1));
+}
+
+}
+
+// Регистрация контейнера в отчете на время жизни объекта
+class Registration {
+public:
+  Registration(const LockStats& stats, const std::string& name) {
+    detail::Registry& r = detail::Instance();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    id = r.next_id++;
+    r.entries[id] = detail::Entry{ name, &stats, stats.Read(), clock::now() };
+  }
+  ~Registration() {
+    detail::Registry& r = detail::Instance();
+    std::lock_guard<std::mutex> lock(r.mutex);
+    r.entries.erase(id);
+  }
+  Registration(const Registration&) = delete;
+  Registration& operator=(const Registration&) = delete;
+
+private:
+  uint64_t id;
+};
+
+// Отчет в текстовом формате Prometheus; скорости считаются от предыдущего вызова
+inline std::string Render() {
+  detail::Registry& r = detail::Instance();
+  std::lock_guard<std::mutex> lock(r.mutex);
+  std::ostringstream ops_rate, ops_total, size, height, wait_p99, contention, wait_share;
+  clock::time_point now = clock::now();
+  for (auto& it : r.entries) {
+    detail::Entry& e = it.second;
+    LockStats::Snapshot cur = e.stats->Read();
+    std::string labels = "{name=\"" + detail::Escape(e.name) + "\",container=\"" + e.stats->Kind() + "\"}";
+    double seconds = std::chrono::duration_cast<std::chrono::duration<double>>(now - e.prev_time).count();
+    uint64_t ops = cur.ops - e.prev.ops;
+    uint64_t hist[LockStats::buckets];
+    for (int i = 0; i < LockStats::buckets; ++i) {
+      hist[i] = cur.hist[i] - e.prev.hist[i];
+    }
+    uint64_t wait = cur.wait_ns - e.prev.wait_ns;
+    uint64_t work = cur.work_ns - e.prev.work_ns;
+    ops_rate << "threadsafe_ops_per_second" << labels << ' ' << (seconds > 0 ? ops / seconds : 0) << '\n';
+    ops_total << "threadsafe_ops_total" << labels << ' ' << cur.ops << '\n';
+    size << "threadsafe_size" << labels << ' ' << cur.size << '\n';
+    if (cur.height >= 0) {
+      height << "threadsafe_tree_height" << labels << ' ' << cur.height << '\n';
+    }
+    wait_p99 << "threadsafe_lock_wait_p99_seconds" << labels << ' ' << detail::Quantile(hist, ops, 0.99) * 1e-9 << '\n';
+    contention << "threadsafe_contention_ratio" << labels << ' '
+               << (ops ? static_cast<double>(cur.contended - e.prev.contended) / ops : 0) << '\n';
+    wait_share << "threadsafe_lock_wait_fraction" << labels << ' '
+               << (wait + work ? static_cast<double>(wait) / (wait + work) : 0) << '\n';
+    e.prev = cur;
+    e.prev_time = now;
+  }
+  std::ostringstream out;
+  out << "# HELP threadsafe_ops_per_second Operations per second over the last sampling interval.\n"
+      << "# TYPE threadsafe_ops_per_second gauge\n" << ops_rate.str()
+      << "# HELP threadsafe_ops_total Operations since sampling started.\n"
+      << "# TYPE threadsafe_ops_total counter\n" << ops_total.str()
+      << "# HELP threadsafe_size Elements in the container (queue or stack depth, tree size).\n"
+      << "# TYPE threadsafe_size gauge\n" << size.str()
+      << "# HELP threadsafe_tree_height Height of the tree.\n"
+      << "# TYPE threadsafe_tree_height gauge\n" << height.str()
+      << "# HELP threadsafe_lock_wait_p99_seconds 99th percentile of lock wait over the last interval (power-of-two bucket bound).\n"
+      << "# TYPE threadsafe_lock_wait_p99_seconds gauge\n" << wait_p99.str()
+      << "# HELP threadsafe_contention_ratio Share of operations that waited for the lock longer than 1us.\n"
+      << "# TYPE threadsafe_contention_ratio gauge\n" << contention.str()
+      << "# HELP threadsafe_lock_wait_fraction Share of operation time spent waiting for the lock.\n"
+      << "# TYPE threadsafe_lock_wait_fraction gauge\n" << wait_share.str();
+  return out.str();
+}
+
+// Запись отчета: сначала во временный файл, затем переименование, чтобы читатель не видел половину файла
+inline bool WriteFile(const std::string& path) {
+  std::string text = Render();
+  std::string tmp = path + ".tmp";
+  FILE* out = std::fopen(tmp.c_str(), "w");
+  if (!out) {
+    return false;
+  }
+  bool ok = std::fwrite(text.data(), 1, text.size(), out) == text.size();
+  ok = std::fclose(out) == 0 && ok;
+  std::remove(path.c_str());
+  return ok && std::rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+// Запуск фонового опроса: каждые interval отчет записывается в path
+inline bool Start(const std::string& path, const std::chrono::milliseconds interval) {
+  detail::Registry& r = detail::Instance();
+  std::lock_guard<std::mutex> lock(r.sampler_mutex);
+  if (r.sampler.joinable()) {
+    return false;
+  }
+  r.stop = false;
+  detail::Collecting().store(true, std::memory_order_relaxed);
+  Render();
+  r.sampler = std::thread([&r, path, interval]() {
+    std::unique_lock<std::mutex> lock(r.sampler_mutex);
+    while (!r.wake.wait_for(lock, interval, [&r]() { return r.stop; })) {
+      lock.unlock();
+      WriteFile(path);
+      lock.lock();
+    }
+  });
+  return true;
+}
+
+// Остановка опроса; последний отчет записывается перед выходом
+inline void Stop(const std::string& path = std::string()) {
+  detail::Registry& r = detail::Instance();
+  {
+    std::lock_guard<std::mutex> lock(r.sampler_mutex);
+    if (!r.sampler.joinable()) {
+      return;
+    }
+    r.stop = true;
+  }
+  r.wake.notify_all();
+  r.sampler.join();
+  if (!path.empty()) {
+    WriteFile(path);
+  }
+  detail::Collecting().store(false, std::memory_order_relaxed);
+}
+
+}
+
+#endif
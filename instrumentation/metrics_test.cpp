@@ -0,0 +1,77 @@
+#include "metrics.h"
+#include "avl-tree/avl_tree.h"
+#include "vector-stack-queue/threadsafe_queue.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+void fillQueue(ThreadsafeQueue<int>& obj, int num) {
+  for (int i = 0; i < num; ++i) {
+    obj.push(i);
+    if (i % 2) {
+      obj.pop();
+    }
+  }
+}
+
+void fillTree(AVLtree& tree, int num) {
+  for (int i = 0; i < num; ++i) {
+    tree.Insert(i);
+    tree.FindByKey(i / 2);
+  }
+}
+
+// Значение метрики name с меткой name="label"
+double Value(const std::string& text, const std::string& name, const std::string& label) {
+  std::string prefix = name + "{name=\"" + label + "\"";
+  size_t pos = text.find(prefix);
+  if (pos == std::string::npos) {
+    return -1;
+  }
+  return std::stod(text.substr(text.find(' ', pos) + 1));
+}
+
+int main() {
+  setlocale(LC_ALL, "Russian");
+  const std::string path = "metrics.prom";
+  ThreadsafeQueue<int> queue;
+  AVLtree tree;
+  metrics::Registration queue_reg(queue.stats, "jobs");
+  metrics::Registration tree_reg(tree.stats, "index");
+  int n = 20000;
+  metrics::Start(path, std::chrono::milliseconds(20));
+  std::vector<std::thread> threads;
+  threads.emplace_back(fillQueue, std::ref(queue), n);
+  threads.emplace_back(fillQueue, std::ref(queue), n);
+  threads.emplace_back(fillTree, std::ref(tree), n);
+  for (auto& th : threads) {
+    th.join();
+  }
+  metrics::Stop(path);
+  // Операции после остановки опроса не считаются
+  queue.push(0);
+
+  std::ifstream in(path);
+  std::stringstream text;
+  text << in.rdbuf();
+  std::string s = text.str();
+  double queue_ops = Value(s, "threadsafe_ops_total", "jobs");
+  double queue_size = Value(s, "threadsafe_size", "jobs");
+  double tree_ops = Value(s, "threadsafe_ops_total", "index");
+  double tree_size = Value(s, "threadsafe_size", "index");
+  double tree_height = Value(s, "threadsafe_tree_height", "index");
+  double ratio = Value(s, "threadsafe_contention_ratio", "jobs");
+  std::cout << "----------МЕТРИКИ----------" << std::endl;
+  std::cout << s;
+  std::cout << "Операций очереди: " << queue_ops << " (ожидается " << n * 3 << "), размер " << queue_size << std::endl;
+  std::cout << "Операций дерева: " << tree_ops << " (ожидается " << n * 2 << "), размер " << tree_size
+            << ", высота " << tree_height << std::endl;
+  bool ok = queue_ops == n * 3 && queue_size == n && tree_ops == n * 2 && tree_size == n
+    && tree_height > 0 && ratio >= 0 && ratio <= 1;
+  std::remove(path.c_str());
+  return ok ? 0 : 1;
+}
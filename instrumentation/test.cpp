@@ -0,0 +1,102 @@
+#include "lock_trace.h"
+#include "avl-tree/avl_tree.h"
+#include "vector-stack-queue/threadsafe_stack.h"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+void readStack(ThreadsafeStack<int>& obj, int num) {
+  for (int i = 0; i < num; ++i) {
+    obj.top();
+  }
+}
+
+void pushStack(ThreadsafeStack<int>& obj, int num) {
+  for (int i = 0; i < num; ++i) {
+    obj.push(i);
+  }
+}
+
+void insertTree(AVLtree& tree, int num) {
+  for (int i = 0; i < num; ++i) {
+    tree.Insert(i);
+  }
+}
+
+void removeTree(AVLtree& tree, int num) {
+  for (int i = 0; i < num; ++i) {
+    tree.Remove(i);
+    tree.FindByKey(num - i);
+  }
+}
+
+// Число отрезков удержания блокировок в сохраненной трассе
+long long countHolds(const std::string& path) {
+  std::ifstream in(path);
+  std::stringstream text;
+  text << in.rdbuf();
+  std::string s = text.str();
+  long long holds = 0;
+  for (size_t pos = s.find("\"cat\": \"exclusive\""); pos != std::string::npos; pos = s.find("\"cat\": \"exclusive\"", pos + 1)) {
+    ++holds;
+  }
+  for (size_t pos = s.find("\"cat\": \"shared\""); pos != std::string::npos; pos = s.find("\"cat\": \"shared\"", pos + 1)) {
+    ++holds;
+  }
+  return holds;
+}
+
+int main() {
+  setlocale(LC_ALL, "Russian");
+  const std::string path = "lock_trace.json";
+  ThreadsafeStack<int> stack;
+  AVLtree tree;
+  stack.push(0);
+  int n = 2000;
+  lock_trace::Start();
+  std::vector<std::thread> threads;
+  threads.emplace_back(pushStack, std::ref(stack), n);
+  threads.emplace_back(readStack, std::ref(stack), n);
+  threads.emplace_back(readStack, std::ref(stack), n);
+  threads.emplace_back(insertTree, std::ref(tree), n);
+  threads.emplace_back(removeTree, std::ref(tree), n);
+  for (auto& th : threads) {
+    th.join();
+  }
+  lock_trace::Stop();
+  // Операции после Stop() в трассу не попадают
+  stack.push(1);
+  if (!lock_trace::Dump(path)) {
+    std::cout << "Не удалось записать " << path << std::endl;
+    return 1;
+  }
+  long long holds = countHolds(path);
+  long long expected = n * 6LL;
+  std::cout << "----------ТРАССИРОВКА БЛОКИРОВОК----------" << std::endl;
+  std::cout << "Операций в трассе: " << holds << " (ожидается " << expected << ")" << std::endl;
+
+  // Повторное включение: потоки сменяют друг друга и получают буферы завершившихся,
+  // а события первого включения в трассу не попадают
+  // Все потоки пишут в один буфер, поэтому вместе - не больше его размера
+  const std::string path2 = "lock_trace2.json";
+  int rounds = 10;
+  int m = 1000;
+  lock_trace::Start();
+  for (int i = 0; i < rounds; ++i) {
+    std::thread th(pushStack, std::ref(stack), m);
+    th.join();
+  }
+  lock_trace::Stop();
+  if (!lock_trace::Dump(path2)) {
+    std::cout << "Не удалось записать " << path2 << std::endl;
+    return 1;
+  }
+  long long holds2 = countHolds(path2);
+  std::cout << "Операций при повторном включении: " << holds2 << " (ожидается " << rounds * m << ")" << std::endl;
+  std::cout << "Откройте " << path << " в chrome://tracing или ui.perfetto.dev" << std::endl;
+  return holds == expected && holds2 == rounds * m ? 0 : 1;
+}
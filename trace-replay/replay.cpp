@@ -0,0 +1,312 @@
+#include "trace.h"
+#include "benchmark/containers.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Воспроизведение трассы: по потоку на каждый записанный поток, операции
+// выдаются в записанные моменты времени, деленные на speed (0 - без пауз).
+// Воспроизводятся события одного контейнера трассы: заданного source или
+// экземпляра с наибольшим числом событий
+struct Options {
+  std::string path;
+  std::string container = "avl";
+  // Вид контейнера трассы и, через двоеточие, номер экземпляра
+  std::string source;
+  double speed = 1.;
+  int prefill = 0;
+  bool dump = false;
+};
+
+struct Replay {
+  const Options& opt;
+  const std::map<uint32_t, std::vector<trace::Event>>& threads;
+  std::vector<long long> latency;
+  std::vector<long long> lag;
+  double seconds = 0;
+  double lock_wait = -1;
+
+  Replay(const Options& opt, const std::map<uint32_t, std::vector<trace::Event>>& threads)
+    : opt(opt), threads(threads) {}
+
+  template<typename Bench>
+  void Visit() {
+    Bench bench;
+    // Стек и очередь не должны опустеть: извлечений не больше, чем начальных элементов
+    long long removes = 0;
+    for (auto& t : threads) {
+      for (const trace::Event& e : t.second) {
+        removes += e.op == trace::Op::remove;
+      }
+    }
+    int prefill = opt.prefill;
+    if (IsSizedContainer(opt.container)) {
+      prefill = static_cast<int>(std::max<long long>(prefill, removes + 1));
+    }
+    bench.Prefill(prefill);
+
+    std::vector<std::vector<long long>> thread_latency(threads.size());
+    std::vector<std::vector<long long>> thread_lag(threads.size());
+    std::atomic<int> ready(0);
+    std::atomic<bool> go(false);
+    std::chrono::steady_clock::time_point start;
+    std::vector<std::thread> workers;
+    for (int index = 0; index < static_cast<int>(threads.size()); ++index) {
+      workers.emplace_back([&, index]() {
+        const std::vector<trace::Event>& events = std::next(threads.begin(), index)->second;
+        std::vector<long long>& lat = thread_latency[index];
+        std::vector<long long>& late = thread_lag[index];
+        lat.reserve(events.size());
+        late.reserve(events.size());
+        bench.Warmup();
+        ++ready;
+        while (!go.load(std::memory_order_acquire)) {
+          std::this_thread::yield();
+        }
+        for (const trace::Event& e : events) {
+          auto due = start;
+          if (opt.speed > 0) {
+            due += std::chrono::nanoseconds(static_cast<long long>(e.time / opt.speed));
+            // Длинные паузы - сном, короткие - активным ожиданием
+            auto now = std::chrono::steady_clock::now();
+            if (due - now > std::chrono::microseconds(200)) {
+              std::this_thread::sleep_for(due - now - std::chrono::microseconds(100));
+            }
+            while (std::chrono::steady_clock::now() < due) {
+              std::this_thread::yield();
+            }
+          }
+          auto time1 = std::chrono::steady_clock::now();
+          switch (e.op) {
+          case trace::Op::add: bench.Add(e.key); break;
+          case trace::Op::remove: bench.Remove(e.key); break;
+          case trace::Op::read: bench.Read(e.key); break;
+          case trace::Op::update: bench.Update(e.key); break;
+          case trace::Op::rank: bench.Rank(e.key); break;
+          }
+          auto time2 = std::chrono::steady_clock::now();
+          lat.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(time2 - time1).count());
+          if (opt.speed > 0) {
+            late.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(time1 - due).count());
+          }
+        }
+      });
+    }
+    while (ready.load() < static_cast<int>(workers.size())) {
+      std::this_thread::yield();
+    }
+    bench.Reset();
+    start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    for (auto& th : workers) {
+      th.join();
+    }
+    auto finish = std::chrono::steady_clock::now();
+    seconds = std::chrono::duration_cast<std::chrono::duration<double>>(finish - start).count();
+    long long total = 0;
+    for (size_t i = 0; i < thread_latency.size(); ++i) {
+      latency.insert(latency.end(), thread_latency[i].begin(), thread_latency[i].end());
+      lag.insert(lag.end(), thread_lag[i].begin(), thread_lag[i].end());
+    }
+    for (long long l : latency) {
+      total += l;
+    }
+    lock_wait = total > 0 ? bench.LockWait(total) : -1;
+    std::sort(latency.begin(), latency.end());
+    std::sort(lag.begin(), lag.end());
+  }
+};
+
+long long Percentile(const std::vector<long long>& sorted, const double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  return sorted[std::min(sorted.size() - 1, static_cast<size_t>(p * sorted.size()))];
+}
+
+const char* OpName(const trace::Op op) {
+  switch (op) {
+  case trace::Op::add: return "add";
+  case trace::Op::remove: return "remove";
+  case trace::Op::read: return "read";
+  case trace::Op::update: return "update";
+  default: return "rank";
+  }
+}
+
+const char* KindName(const trace::Kind kind) {
+  switch (kind) {
+  case trace::Kind::vector: return "vector";
+  case trace::Kind::stack: return "stack";
+  case trace::Kind::queue: return "queue";
+  case trace::Kind::priority_queue: return "pq";
+  case trace::Kind::hash_map: return "hash-map";
+  case trace::Kind::avl_tree: return "avl";
+  default: return "other";
+  }
+}
+
+// Разбор source "KIND" или "KIND:ID"; без номера экземпляр выбирается по числу событий
+bool ParseSource(const std::string& source, trace::Kind& kind, long long& instance) {
+  size_t colon = source.find(':');
+  std::string name = source.substr(0, colon);
+  instance = colon == std::string::npos ? -1 : std::atoll(source.c_str() + colon + 1);
+  for (int k = 0; k <= static_cast<int>(trace::Kind::avl_tree); ++k) {
+    if (name == KindName(static_cast<trace::Kind>(k))) {
+      kind = static_cast<trace::Kind>(k);
+      return instance >= -1;
+    }
+  }
+  return false;
+}
+
+// Выбор контейнера трассы и удаление событий остальных контейнеров
+bool SelectSource(const Options& opt, std::map<uint32_t, std::vector<trace::Event>>& threads,
+                  trace::Kind& kind, uint32_t& instance) {
+  long long wanted = -1;
+  bool any_kind = opt.source.empty();
+  if (!any_kind && !ParseSource(opt.source, kind, wanted)) {
+    return false;
+  }
+  if (wanted >= 0) {
+    instance = static_cast<uint32_t>(wanted);
+  }
+  else {
+    std::map<std::pair<trace::Kind, uint32_t>, long long> counts;
+    for (auto& t : threads) {
+      for (const trace::Event& e : t.second) {
+        if (any_kind || e.kind == kind) {
+          ++counts[{ e.kind, e.instance }];
+        }
+      }
+    }
+    auto busiest = std::max_element(counts.begin(), counts.end(),
+                                    [](const auto& a, const auto& b) { return a.second < b.second; });
+    if (busiest == counts.end()) {
+      return false;
+    }
+    kind = busiest->first.first;
+    instance = busiest->first.second;
+  }
+  for (auto it = threads.begin(); it != threads.end();) {
+    std::vector<trace::Event>& events = it->second;
+    events.erase(std::remove_if(events.begin(), events.end(),
+                                [&](const trace::Event& e) { return e.kind != kind || e.instance != instance; }),
+                 events.end());
+    it = events.empty() ? threads.erase(it) : std::next(it);
+  }
+  return !threads.empty();
+}
+
+void Usage() {
+  std::cerr << "usage: trace_replay TRACE [options]\n"
+            << "  --container NAME  stack,queue,vector,fc-stack,fc-queue,pq,relaxed-pq,avl,\n"
+            << "                    persistent-avl,sharded-avl,skip-list,fc-avl,hash-set (default: avl)\n"
+            << "  --speed X         replay X times faster than recorded; 0 - no pauses (default: 1)\n"
+            << "  --prefill N       initial elements; stack and queue get at least one per remove\n"
+            << "  --source KIND[:ID] traced container to replay: vector,stack,queue,pq,hash-map,avl\n"
+            << "                    and instance number (default: the one with most events)\n"
+            << "  --dump            print the events instead of replaying them\n";
+}
+
+bool ParseArgs(int argc, char** argv, Options& opt) {
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    if (arg == "--dump") {
+      opt.dump = true;
+    }
+    else if (arg.compare(0, 2, "--") != 0) {
+      opt.path = arg;
+    }
+    else if (i + 1 >= argc) {
+      return false;
+    }
+    else if (arg == "--container") {
+      opt.container = argv[++i];
+    }
+    else if (arg == "--speed") {
+      opt.speed = std::max(0., std::atof(argv[++i]));
+    }
+    else if (arg == "--prefill") {
+      opt.prefill = std::max(0, std::atoi(argv[++i]));
+    }
+    else if (arg == "--source") {
+      opt.source = argv[++i];
+    }
+    else {
+      return false;
+    }
+  }
+  return !opt.path.empty() && (IsSizedContainer(opt.container) || IsTreeContainer(opt.container));
+}
+
+int main(int argc, char** argv) {
+  Options opt;
+  if (!ParseArgs(argc, argv, opt)) {
+    Usage();
+    return 1;
+  }
+  std::map<uint32_t, std::vector<trace::Event>> threads;
+  if (!trace::Read(opt.path, threads)) {
+    std::cerr << "cannot read trace " << opt.path << std::endl;
+    return 1;
+  }
+  // Без --source дамп содержит события всех контейнеров
+  trace::Kind kind = trace::Kind::other;
+  uint32_t instance = 0;
+  if ((!opt.dump || !opt.source.empty()) && !SelectSource(opt, threads, kind, instance)) {
+    std::cerr << "no events of " << (opt.source.empty() ? std::string("any container") : opt.source)
+              << " in trace " << opt.path << std::endl;
+    return 1;
+  }
+  if (opt.dump) {
+    std::vector<std::pair<uint32_t, trace::Event>> all;
+    for (auto& t : threads) {
+      for (const trace::Event& e : t.second) {
+        all.emplace_back(t.first, e);
+      }
+    }
+    std::stable_sort(all.begin(), all.end(), [](const auto& a, const auto& b) { return a.second.time < b.second.time; });
+    std::cout << "time_ns,thread,container,instance,op,key\n";
+    for (auto& p : all) {
+      std::cout << p.second.time << ',' << p.first << ',' << KindName(p.second.kind) << ',' << p.second.instance << ','
+                << OpName(p.second.op) << ',' << p.second.key << '\n';
+    }
+    return 0;
+  }
+  size_t events = 0;
+  for (auto& t : threads) {
+    events += t.second.size();
+  }
+  Replay replay(opt, threads);
+  VisitContainer(opt.container, 4, replay);
+  std::cout << "{\"trace\": \"" << opt.path << "\", \"source\": \"" << KindName(kind) << ':' << instance
+            << "\", \"container\": \"" << opt.container << "\", \"threads\": " << threads.size() << ", \"events\": " << events
+            << ", \"speed\": " << opt.speed << ", \"seconds\": " << replay.seconds
+            << ", \"ops_per_sec\": " << (replay.seconds > 0 ? events / replay.seconds : 0)
+            << ", \"latency_ns\": {\"p50\": " << Percentile(replay.latency, 0.5)
+            << ", \"p90\": " << Percentile(replay.latency, 0.9) << ", \"p99\": " << Percentile(replay.latency, 0.99)
+            << ", \"p999\": " << Percentile(replay.latency, 0.999)
+            << ", \"max\": " << (replay.latency.empty() ? 0 : replay.latency.back()) << "}";
+  if (opt.speed > 0) {
+    std::cout << ", \"lag_ns\": {\"p50\": " << Percentile(replay.lag, 0.5) << ", \"p99\": " << Percentile(replay.lag, 0.99)
+              << ", \"max\": " << (replay.lag.empty() ? 0 : replay.lag.back()) << "}";
+  }
+  std::cout << ", \"lock_wait_fraction\": ";
+  if (replay.lock_wait < 0) {
+    std::cout << "null";
+  }
+  else {
+    std::cout << replay.lock_wait;
+  }
+  std::cout << "}" << std::endl;
+  return 0;
+}
@@ -0,0 +1,73 @@
+#include "trace.h"
+#include "avl-tree/avl_tree.h"
+#include "vector-stack-queue/threadsafe_stack.h"
+
+#include <cstdio>
+#include <iostream>
+#include <set>
+#include <thread>
+#include <vector>
+
+const int threads_count = 4;
+const int ops_count = 50000;
+
+void work(AVLtree& tree, ThreadsafeStack<int>& stack, int id) {
+  for (int i = 0; i < ops_count; ++i) {
+    int key = i * threads_count + id;
+    tree.Insert(key);
+    stack.push(key);
+    if (i % 4 == 3) {
+      tree.FindByKey(key);
+      stack.pop();
+    }
+  }
+}
+
+int main() {
+  setlocale(LC_ALL, "Russian");
+  const std::string path = "trace_test.bin";
+  AVLtree tree;
+  ThreadsafeStack<int> stack;
+  // Операции до начала записи в трассу не попадают
+  tree.Insert(-1);
+  if (!trace::Start(path)) {
+    std::cout << "Не удалось открыть " << path << std::endl;
+    return 1;
+  }
+  std::vector<std::thread> threads;
+  for (int i = 0; i < threads_count; ++i) {
+    threads.emplace_back(work, std::ref(tree), std::ref(stack), i);
+  }
+  for (auto& th : threads) {
+    th.join();
+  }
+  uint64_t dropped = trace::Stop();
+
+  std::map<uint32_t, std::vector<trace::Event>> events;
+  bool ok = trace::Read(path, events);
+  long long total = 0, adds = 0, ordered = 0, tree_events = 0, stack_events = 0;
+  std::set<std::pair<trace::Kind, uint32_t>> sources;
+  for (auto& t : events) {
+    for (size_t i = 0; i < t.second.size(); ++i) {
+      const trace::Event& e = t.second[i];
+      total += 1;
+      adds += e.op == trace::Op::add;
+      ordered += i == 0 || t.second[i - 1].time <= e.time;
+      tree_events += e.kind == trace::Kind::avl_tree;
+      stack_events += e.kind == trace::Kind::stack;
+      sources.emplace(e.kind, e.instance);
+    }
+  }
+  long long expected = threads_count * (ops_count * 2LL + ops_count / 4 * 2);
+  std::cout << "----------ТРАССА----------" << std::endl;
+  std::cout << "Файл прочитан: " << (ok ? "да" : "нет") << ", потоков: " << events.size() << std::endl;
+  std::cout << "Событий: " << total << " + отброшено " << dropped << " (ожидается " << expected << ")" << std::endl;
+  std::cout << "Вставок: " << adds << " (ожидается " << threads_count * ops_count * 2LL << ")" << std::endl;
+  std::cout << "Порядок времени в потоках " << (ordered == total ? "верный" : "НЕВЕРНЫЙ") << std::endl;
+  // Без отброшенных событий дерево и стек получают поровну: вставка и поиск против push и pop
+  bool split = sources.size() == 2 && tree_events + stack_events == total && (dropped > 0 || tree_events == stack_events);
+  std::cout << "Контейнеров: " << sources.size() << ", событий дерева: " << tree_events << ", стека: " << stack_events
+            << (split ? "" : " - НЕВЕРНО") << std::endl;
+  std::remove(path.c_str());
+  return ok && total + (long long)dropped == expected && ordered == total && split ? 0 : 1;
+}
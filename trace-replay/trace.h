@@ -0,0 +1,342 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include "common/cache_line.h"
+
+// Запись трассы операций над контейнерами: контейнер, операция, ключ, поток и время.
+// Контейнеры вызывают trace::Record в начале каждой операции с данными;
+// пока запись не включена, это одна проверка атомарного флага.
+// Каждый поток пишет в свой кольцевой буфер без блокировок, фоновый поток
+// раз в миллисекунду сбрасывает буферы в файл. Если буфер переполнен,
+// событие отбрасывается и учитывается в счетчике, который возвращает Stop().
+//
+// Формат файла: "TRC2", затем блоки событий одного потока:
+//   varint поток, varint число событий, varint время первого события
+//   (нс от начала записи), далее для каждого события varint приращение
+//   времени, байт операции, байт вида контейнера, varint номера экземпляра
+//   и varint ключа в zigzag-кодировании. Экземпляры нумеруются с нуля в
+//   порядке первого события. Файлы "TRC1" без вида и экземпляра тоже читаются.
+namespace trace {
+
+// Операции обобщены, чтобы трассу можно было воспроизвести на любом контейнере
+enum class Op : uint8_t {
+  add,     // push, push_back, Insert
+  remove,  // pop, pop_back, Remove
+  read,    // top, front, back, at, FindByKey
+  update,  // запись существующего элемента
+  rank     // FindByRank, ключ - ранг
+};
+
+// Вид контейнера, на котором выполнена операция
+enum class Kind : uint8_t {
+  other,
+  vector,
+  stack,
+  queue,
+  priority_queue,
+  hash_map,
+  avl_tree
+};
+
+struct Event {
+  uint64_t time;
+  int32_t key;
+  Op op;
+  Kind kind;
+  // Номер экземпляра контейнера в трассе
+  uint32_t instance;
+};
+
+// Ключ события: целые значения записываются как есть, остальные - нулем
+template<typename T>
+int Key(const T& val) {
+  if constexpr (std::is_integral<T>::value || std::is_enum<T>::value) {
+    return static_cast<int>(val);
+  }
+  else {
+    return 0;
+  }
+}
+
+namespace detail {
+
+const uint64_t ring_size = 1 << 16;
+
+inline uint64_t Now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Событие в буфере: вместо номера экземпляра адрес контейнера, номер дает фоновый поток
+struct Entry {
+  uint64_t time;
+  const void* object;
+  int32_t key;
+  Op op;
+  Kind kind;
+};
+
+// Буфер потока: пишет только владелец, читает только фоновый поток
+struct Ring {
+  Entry events[ring_size];
+  alignas(cache_line_size) std::atomic<uint64_t> head{0};
+  alignas(cache_line_size) std::atomic<uint64_t> tail{0};
+  std::atomic<bool> abandoned{false};
+  uint32_t thread = 0;
+};
+
+struct Recorder {
+  std::atomic<bool> enabled{false};
+  std::atomic<uint64_t> dropped{0};
+  // Регистрация буферов новых потоков и их обход фоновым потоком
+  std::mutex registry_mutex;
+  std::vector<Ring*> rings;
+  uint32_t next_thread = 0;
+  // Start/Stop
+  std::mutex control_mutex;
+  std::thread writer;
+  std::atomic<bool> stop{false};
+  FILE* out = nullptr;
+  uint64_t start_time = 0;
+  std::vector<unsigned char> block;
+  // Номера экземпляров по адресам; адрес удаленного контейнера может достаться новому
+  std::unordered_map<const void*, uint32_t> instances;
+
+  ~Recorder();
+};
+
+inline Recorder& Instance() {
+  static Recorder recorder;
+  return recorder;
+}
+
+// Буфер освобождает фоновый поток, когда владелец завершился и все события записаны
+struct RingOwner {
+  Ring* ring = nullptr;
+  ~RingOwner() {
+    if (ring) {
+      ring->abandoned.store(true, std::memory_order_release);
+    }
+  }
+};
+
+inline Ring* MyRing() {
+  thread_local RingOwner owner;
+  if (!owner.ring) {
+    Recorder& r = Instance();
+    Ring* ring = new Ring;
+    std::lock_guard<std::mutex> lock(r.registry_mutex);
+    ring->thread = r.next_thread++;
+    r.rings.push_back(ring);
+    owner.ring = ring;
+  }
+  return owner.ring;
+}
+
+inline void PutVarint(std::vector<unsigned char>& out, uint64_t v) {
+  while (v >= 0x80) {
+    out.push_back(static_cast<unsigned char>(v | 0x80));
+    v >>= 7;
+  }
+  out.push_back(static_cast<unsigned char>(v));
+}
+
+inline bool GetVarint(FILE* in, uint64_t& v) {
+  v = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    int c = std::fgetc(in);
+    if (c == EOF) {
+      return false;
+    }
+    v |= static_cast<uint64_t>(c & 0x7f) << shift;
+    if (!(c & 0x80)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+inline uint64_t ZigZag(const int32_t v) { return (static_cast<uint32_t>(v) << 1) ^ static_cast<uint32_t>(v >> 31); }
+inline int32_t UnZigZag(const uint64_t v) { return static_cast<int32_t>((v >> 1) ^ (~(v & 1) + 1)); }
+
+inline uint32_t Instance(Recorder& r, const void* object) {
+  auto it = r.instances.find(object);
+  if (it == r.instances.end()) {
+    it = r.instances.emplace(object, static_cast<uint32_t>(r.instances.size())).first;
+  }
+  return it->second;
+}
+
+// Запись накопленных событий всех потоков; вызывается фоновым потоком или из Stop
+inline void Drain(Recorder& r) {
+  std::lock_guard<std::mutex> lock(r.registry_mutex);
+  for (size_t i = 0; i < r.rings.size();) {
+    Ring* ring = r.rings[i];
+    bool abandoned = ring->abandoned.load(std::memory_order_acquire);
+    uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+    uint64_t head = ring->head.load(std::memory_order_acquire);
+    // События, оставшиеся от предыдущей записи, пропускаются
+    while (tail < head && ring->events[tail % ring_size].time < r.start_time) {
+      ++tail;
+    }
+    if (tail < head) {
+      const Entry& first = ring->events[tail % ring_size];
+      r.block.clear();
+      PutVarint(r.block, ring->thread);
+      PutVarint(r.block, head - tail);
+      PutVarint(r.block, first.time - r.start_time);
+      uint64_t prev = first.time;
+      for (uint64_t j = tail; j < head; ++j) {
+        const Entry& e = ring->events[j % ring_size];
+        PutVarint(r.block, e.time - prev);
+        r.block.push_back(static_cast<unsigned char>(e.op));
+        r.block.push_back(static_cast<unsigned char>(e.kind));
+        PutVarint(r.block, Instance(r, e.object));
+        PutVarint(r.block, ZigZag(e.key));
+        prev = e.time;
+      }
+      std::fwrite(r.block.data(), 1, r.block.size(), r.out);
+    }
+    ring->tail.store(head, std::memory_order_release);
+    if (abandoned) {
+      delete ring;
+      r.rings[i] = r.rings.back();
+      r.rings.pop_back();
+    }
+    else {
+      ++i;
+    }
+  }
+}
+
+inline void WriterLoop(Recorder& r) {
+  while (!r.stop.load(std::memory_order_acquire)) {
+    Drain(r);
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  Drain(r);
+}
+
+}
+
+// Начало записи трассы в файл path; false, если запись уже идет или файл не открылся
+inline bool Start(const std::string& path) {
+  detail::Recorder& r = detail::Instance();
+  std::lock_guard<std::mutex> lock(r.control_mutex);
+  if (r.out) {
+    return false;
+  }
+  r.out = std::fopen(path.c_str(), "wb");
+  if (!r.out) {
+    return false;
+  }
+  std::fwrite("TRC2", 1, 4, r.out);
+  r.start_time = detail::Now();
+  r.instances.clear();
+  r.dropped = 0;
+  r.stop = false;
+  r.writer = std::thread(detail::WriterLoop, std::ref(r));
+  r.enabled.store(true, std::memory_order_release);
+  return true;
+}
+
+// Окончание записи; возвращает число отброшенных из-за переполнения событий
+inline uint64_t Stop() {
+  detail::Recorder& r = detail::Instance();
+  std::lock_guard<std::mutex> lock(r.control_mutex);
+  if (!r.out) {
+    return 0;
+  }
+  r.enabled.store(false, std::memory_order_release);
+  r.stop.store(true, std::memory_order_release);
+  r.writer.join();
+  std::fclose(r.out);
+  r.out = nullptr;
+  return r.dropped.load();
+}
+
+inline bool Enabled() {
+  return detail::Instance().enabled.load(std::memory_order_relaxed);
+}
+
+// Событие операции op над контейнером object вида kind
+inline void Record(const Kind kind, const void* object, const Op op, const int key) {
+  detail::Recorder& r = detail::Instance();
+  if (!r.enabled.load(std::memory_order_relaxed)) {
+    return;
+  }
+  detail::Ring* ring = detail::MyRing();
+  uint64_t head = ring->head.load(std::memory_order_relaxed);
+  if (head - ring->tail.load(std::memory_order_acquire) >= detail::ring_size) {
+    r.dropped.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+  detail::Entry& e = ring->events[head % detail::ring_size];
+  e.time = detail::Now();
+  e.object = object;
+  e.key = key;
+  e.op = op;
+  e.kind = kind;
+  ring->head.store(head + 1, std::memory_order_release);
+}
+
+// Чтение трассы: события каждого потока в порядке времени (нс от начала записи)
+inline bool Read(const std::string& path, std::map<uint32_t, std::vector<Event>>& threads) {
+  FILE* in = std::fopen(path.c_str(), "rb");
+  if (!in) {
+    return false;
+  }
+  char magic[4];
+  bool ok = std::fread(magic, 1, 4, in) == 4;
+  const bool v1 = ok && std::string(magic, 4) == "TRC1";
+  ok = ok && (v1 || std::string(magic, 4) == "TRC2");
+  uint64_t thread = 0;
+  while (ok && detail::GetVarint(in, thread)) {
+    uint64_t count = 0, time = 0;
+    ok = detail::GetVarint(in, count) && detail::GetVarint(in, time);
+    std::vector<Event>& events = threads[static_cast<uint32_t>(thread)];
+    for (uint64_t i = 0; ok && i < count; ++i) {
+      uint64_t delta = 0, key = 0, instance = 0;
+      int op = 0, kind = 0;
+      ok = detail::GetVarint(in, delta) && (op = std::fgetc(in)) != EOF && op <= static_cast<int>(Op::rank);
+      if (ok && !v1) {
+        ok = (kind = std::fgetc(in)) != EOF && kind <= static_cast<int>(Kind::avl_tree) &&
+             detail::GetVarint(in, instance);
+      }
+      ok = ok && detail::GetVarint(in, key);
+      time += delta;
+      events.push_back(Event{ time, detail::UnZigZag(key), static_cast<Op>(op), static_cast<Kind>(kind),
+                              static_cast<uint32_t>(instance) });
+    }
+  }
+  std::fclose(in);
+  return ok;
+}
+
+inline detail::Recorder::~Recorder() {
+  if (out) {
+    enabled = false;
+    stop = true;
+    writer.join();
+    std::fclose(out);
+  }
+  for (Ring* ring : rings) {
+    delete ring;
+  }
+}
+
+}
+
+#endif
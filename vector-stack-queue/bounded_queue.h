@@ -0,0 +1,393 @@
+#ifndef BOUNDED_QUEUE_H
+#define BOUNDED_QUEUE_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#include <coroutine>
+#define BOUNDED_QUEUE_COROUTINES 1
+#endif
+
+#include "common/cache_line.h"
+
+// Очередь ограниченной емкости. Кольцевой буфер выделяется один раз в конструкторе.
+// Кроме неблокирующих try_push/try_pop и блокирующих push/pop, в C++20 есть
+// co_await async_pop() и co_await async_push(val): если операцию нельзя выполнить
+// сразу, сопрограмма приостанавливается и встает в список ожидания, встроенный
+// в сам объект ожидания (он живет в кадре сопрограммы). Встречная операция
+// передает элемент напрямую и возобновляет сопрограмму - на своем стеке
+// или через переданный исполнитель. Операции, выполнимые сразу, памяти не выделяют.
+// После close() ожидающие возобновляются с отказом, новые элементы не принимаются,
+// а оставшиеся можно дочитать.
+template<typename T>
+class BoundedQueue {
+public:
+  explicit BoundedQueue(const size_t capacity);
+  BoundedQueue(const BoundedQueue&) = delete;
+  BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+  // false, если очередь полна (пуста) или закрыта
+  bool try_push(const T& val);
+  bool try_pop(T& val);
+  // Ожидание места (элемента); false, если очередь закрыта
+  bool push(const T& val);
+  bool pop(T& val);
+  void close();
+
+  bool closed();
+  bool empty();
+  size_t size();
+  size_t capacity() const { return ring.size(); }
+
+#ifdef BOUNDED_QUEUE_COROUTINES
+  class pop_awaiter;
+  class push_awaiter;
+
+  // co_await возвращает std::optional<T>; пустой - очередь закрыта и пуста
+  pop_awaiter async_pop() { return pop_awaiter(*this, nullptr, nullptr); }
+  // Исполнитель - вызываемый объект void(std::coroutine_handle<>), должен жить до возобновления
+  template<typename Executor>
+  pop_awaiter async_pop(Executor& executor) { return pop_awaiter(*this, &Post<Executor>, &executor); }
+  // co_await возвращает false, если очередь закрыта
+  push_awaiter async_push(T val) { return push_awaiter(*this, std::move(val), nullptr, nullptr); }
+  template<typename Executor>
+  push_awaiter async_push(T val, Executor& executor) {
+    return push_awaiter(*this, std::move(val), &Post<Executor>, &executor);
+  }
+#endif
+
+private:
+  enum class status { done, blocked, closed };
+
+  // Ожидающая сопрограмма; звено списка хранится в ее объекте ожидания
+  struct waiter {
+#ifdef BOUNDED_QUEUE_COROUTINES
+    std::coroutine_handle<> handle;
+    void (*post)(void*, std::coroutine_handle<>) = nullptr;
+    void* executor = nullptr;
+#endif
+    waiter* next = nullptr;
+    bool ok = false;
+    void Resume();
+  };
+
+  struct waiter_list {
+    waiter* head = nullptr;
+    waiter* tail = nullptr;
+    void PushBack(waiter* w);
+    waiter* PopFront();
+  };
+
+  struct pop_waiter : waiter {
+    std::optional<T> value;
+  };
+
+  struct push_waiter : waiter {
+    std::optional<T> value;
+  };
+
+#ifdef BOUNDED_QUEUE_COROUTINES
+  template<typename Executor>
+  static void Post(void* executor, std::coroutine_handle<> h) { (*static_cast<Executor*>(executor))(h); }
+#endif
+
+  // Операции под блокировкой; resume - ожидающий, которого нужно возобновить после снятия блокировки
+  status PushLocked(std::optional<T>& val, waiter*& resume);
+  status PopLocked(std::optional<T>& val, waiter*& resume);
+
+  alignas(cache_line_size) std::vector<std::optional<T>> ring;
+  size_t head = 0;
+  size_t count = 0;
+  bool is_closed = false;
+  waiter_list pop_waiters;
+  waiter_list push_waiters;
+  alignas(cache_line_size) std::mutex mutex;
+  std::condition_variable not_empty;
+  std::condition_variable not_full;
+};
+
+template<typename T>
+void BoundedQueue<T>::waiter::Resume() {
+#ifdef BOUNDED_QUEUE_COROUTINES
+  if (post) {
+    post(executor, handle);
+  }
+  else {
+    handle.resume();
+  }
+#endif
+}
+
+template<typename T>
+void BoundedQueue<T>::waiter_list::PushBack(waiter* w) {
+  w->next = nullptr;
+  if (tail) {
+    tail->next = w;
+  }
+  else {
+    head = w;
+  }
+  tail = w;
+}
+
+template<typename T>
+typename BoundedQueue<T>::waiter* BoundedQueue<T>::waiter_list::PopFront() {
+  waiter* w = head;
+  if (w) {
+    head = w->next;
+    if (!head) {
+      tail = nullptr;
+    }
+  }
+  return w;
+}
+
+template<typename T>
+BoundedQueue<T>::BoundedQueue(const size_t capacity) : ring(capacity > 0 ? capacity : 1) {}
+
+template<typename T>
+typename BoundedQueue<T>::status BoundedQueue<T>::PushLocked(std::optional<T>& val, waiter*& resume) {
+  if (is_closed) {
+    return status::closed;
+  }
+  // Ожидающие извлечения есть только при пустом буфере: элемент передается напрямую
+  if (waiter* w = pop_waiters.PopFront()) {
+    static_cast<pop_waiter*>(w)->value = std::move(val);
+    w->ok = true;
+    resume = w;
+    return status::done;
+  }
+  if (count == ring.size()) {
+    return status::blocked;
+  }
+  ring[(head + count) % ring.size()] = std::move(val);
+  ++count;
+  not_empty.notify_one();
+  return status::done;
+}
+
+template<typename T>
+typename BoundedQueue<T>::status BoundedQueue<T>::PopLocked(std::optional<T>& val, waiter*& resume) {
+  if (count == 0) {
+    return is_closed ? status::closed : status::blocked;
+  }
+  val = std::move(ring[head]);
+  ring[head].reset();
+  head = (head + 1) % ring.size();
+  --count;
+  // Освободившееся место сразу занимает первый ожидающий вставки
+  if (waiter* w = push_waiters.PopFront()) {
+    ring[(head + count) % ring.size()] = std::move(static_cast<push_waiter*>(w)->value);
+    ++count;
+    w->ok = true;
+    resume = w;
+  }
+  else {
+    not_full.notify_one();
+  }
+  return status::done;
+}
+
+template<typename T>
+bool BoundedQueue<T>::try_push(const T& val) {
+  std::optional<T> item(val);
+  waiter* resume = nullptr;
+  status res;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    res = PushLocked(item, resume);
+  }
+  if (resume) {
+    resume->Resume();
+  }
+  return res == status::done;
+}
+
+template<typename T>
+bool BoundedQueue<T>::try_pop(T& val) {
+  std::optional<T> item;
+  waiter* resume = nullptr;
+  status res;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    res = PopLocked(item, resume);
+  }
+  if (resume) {
+    resume->Resume();
+  }
+  if (res == status::done) {
+    val = std::move(*item);
+  }
+  return res == status::done;
+}
+
+template<typename T>
+bool BoundedQueue<T>::push(const T& val) {
+  std::optional<T> item(val);
+  waiter* resume = nullptr;
+  status res;
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    while ((res = PushLocked(item, resume)) == status::blocked) {
+      not_full.wait(lock);
+    }
+  }
+  if (resume) {
+    resume->Resume();
+  }
+  return res == status::done;
+}
+
+template<typename T>
+bool BoundedQueue<T>::pop(T& val) {
+  std::optional<T> item;
+  waiter* resume = nullptr;
+  status res;
+  {
+    std::unique_lock<std::mutex> lock(mutex);
+    while ((res = PopLocked(item, resume)) == status::blocked) {
+      not_empty.wait(lock);
+    }
+  }
+  if (resume) {
+    resume->Resume();
+  }
+  if (res == status::done) {
+    val = std::move(*item);
+  }
+  return res == status::done;
+}
+
+template<typename T>
+void BoundedQueue<T>::close() {
+  waiter_list woken;
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (is_closed) {
+      return;
+    }
+    is_closed = true;
+    for (waiter_list* list : { &pop_waiters, &push_waiters }) {
+      while (waiter* w = list->PopFront()) {
+        w->ok = false;
+        woken.PushBack(w);
+      }
+    }
+    not_empty.notify_all();
+    not_full.notify_all();
+  }
+  // Звено читается до возобновления: после него объект ожидания может исчезнуть
+  for (waiter* w = woken.head; w;) {
+    waiter* next = w->next;
+    w->Resume();
+    w = next;
+  }
+}
+
+template<typename T>
+bool BoundedQueue<T>::closed() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return is_closed;
+}
+
+template<typename T>
+bool BoundedQueue<T>::empty() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return count == 0;
+}
+
+template<typename T>
+size_t BoundedQueue<T>::size() {
+  std::lock_guard<std::mutex> lock(mutex);
+  return count;
+}
+
+#ifdef BOUNDED_QUEUE_COROUTINES
+
+template<typename T>
+class BoundedQueue<T>::pop_awaiter : private pop_waiter {
+public:
+  // Проверка выполняется в await_suspend под той же блокировкой, что и постановка в очередь
+  bool await_ready() const noexcept { return false; }
+
+  bool await_suspend(std::coroutine_handle<> h) {
+    waiter* resume = nullptr;
+    status res;
+    {
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      res = queue.PopLocked(this->value, resume);
+      if (res == status::blocked) {
+        this->handle = h;
+        queue.pop_waiters.PushBack(this);
+      }
+    }
+    // После снятия блокировки сопрограмму уже могли возобновить: this трогать нельзя
+    if (res == status::blocked) {
+      return true;
+    }
+    if (resume) {
+      resume->Resume();
+    }
+    return false;
+  }
+
+  std::optional<T> await_resume() { return std::move(this->value); }
+
+private:
+  friend class BoundedQueue<T>;
+  pop_awaiter(BoundedQueue& queue, void (*post)(void*, std::coroutine_handle<>), void* executor) : queue(queue) {
+    this->post = post;
+    this->executor = executor;
+  }
+
+  BoundedQueue& queue;
+};
+
+template<typename T>
+class BoundedQueue<T>::push_awaiter : private push_waiter {
+public:
+  bool await_ready() const noexcept { return false; }
+
+  bool await_suspend(std::coroutine_handle<> h) {
+    waiter* resume = nullptr;
+    status res;
+    {
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      res = queue.PushLocked(this->value, resume);
+      if (res == status::blocked) {
+        this->handle = h;
+        queue.push_waiters.PushBack(this);
+      }
+    }
+    if (res == status::blocked) {
+      return true;
+    }
+    this->ok = res == status::done;
+    if (resume) {
+      resume->Resume();
+    }
+    return false;
+  }
+
+  bool await_resume() const noexcept { return this->ok; }
+
+private:
+  friend class BoundedQueue<T>;
+  push_awaiter(BoundedQueue& queue, T&& val, void (*post)(void*, std::coroutine_handle<>), void* executor)
+    : queue(queue) {
+    this->value.emplace(std::move(val));
+    this->post = post;
+    this->executor = executor;
+  }
+
+  BoundedQueue& queue;
+};
+
+#endif
+
+#endif
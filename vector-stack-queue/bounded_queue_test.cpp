@@ -0,0 +1,177 @@
+#include "bounded_queue.h"
+
+#include <atomic>
+#include <coroutine>
+#include <cstdlib>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <vector>
+
+// Подсчет выделений памяти, чтобы проверить, что операции без ожидания ее не выделяют
+std::atomic<long long> allocations(0);
+
+void* operator new(std::size_t size) {
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* p = std::malloc(size ? size : 1)) {
+    return p;
+  }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+  std::free(p);
+}
+
+// Сопрограмма, которая запускается сразу и сама освобождает кадр по завершении
+struct Detached {
+  struct promise_type {
+    Detached get_return_object() { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+// Исполнитель: очередь возобновлений, которую разбирают несколько потоков
+class Executor {
+public:
+  void operator()(std::coroutine_handle<> h) {
+    std::lock_guard<std::mutex> lock(mutex);
+    ready.push_back(h);
+    wake.notify_one();
+  }
+
+  void Run(std::atomic<bool>& stop) {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+      wake.wait(lock, [&]() { return !ready.empty() || stop.load(); });
+      if (ready.empty()) {
+        return;
+      }
+      std::coroutine_handle<> h = ready.front();
+      ready.pop_front();
+      lock.unlock();
+      h.resume();
+      lock.lock();
+    }
+  }
+
+  void Wake() {
+    std::lock_guard<std::mutex> lock(mutex);
+    wake.notify_all();
+  }
+
+private:
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::deque<std::coroutine_handle<>> ready;
+};
+
+Detached consumer(BoundedQueue<int>& queue, Executor& executor, std::atomic<long long>& sum, std::atomic<int>& running) {
+  while (auto val = co_await queue.async_pop(executor)) {
+    sum.fetch_add(*val);
+  }
+  running.fetch_sub(1);
+}
+
+Detached producer(BoundedQueue<int>& queue, Executor& executor, int from, int n, std::atomic<int>& running) {
+  for (int i = from; i < from + n; ++i) {
+    co_await queue.async_push(i, executor);
+  }
+  running.fetch_sub(1);
+}
+
+Detached immediate(BoundedQueue<int>& queue, int n, long long& allocated, bool& ok) {
+  long long before = allocations.load();
+  for (int i = 0; i < n; ++i) {
+    ok = co_await queue.async_push(i) && ok;
+    auto val = co_await queue.async_pop();
+    ok = val && *val == i && ok;
+  }
+  allocated = allocations.load() - before;
+}
+
+int main() {
+  setlocale(LC_ALL, "Russian");
+  bool ok = true;
+
+  // Операции, которые выполняются сразу, не приостанавливают сопрограмму и не выделяют память
+  {
+    BoundedQueue<int> queue(4);
+    long long allocated = -1;
+    bool immediate_ok = true;
+    immediate(queue, 10000, allocated, immediate_ok);
+    std::cout << "----------ОГРАНИЧЕННАЯ ОЧЕРЕДЬ----------" << std::endl;
+    std::cout << "Выделений памяти в 20000 операций без ожидания: " << allocated << std::endl;
+    ok = ok && immediate_ok && allocated == 0;
+  }
+
+  // Тысячи сопрограмм-потребителей на двух потоках исполнителя
+  {
+    const int consumers = 2000, producers = 8, per_producer = 20000;
+    BoundedQueue<int> queue(64);
+    Executor executor;
+    std::atomic<long long> sum(0);
+    std::atomic<int> running_consumers(consumers), running_producers(producers);
+    std::atomic<bool> stop(false);
+    for (int i = 0; i < consumers; ++i) {
+      consumer(queue, executor, sum, running_consumers);
+    }
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 2; ++t) {
+      threads.emplace_back([&]() { executor.Run(stop); });
+    }
+    // Производители стартуют в отдельных потоках, а после первого ожидания продолжают на исполнителе
+    std::vector<std::thread> starters;
+    for (int p = 0; p < producers; ++p) {
+      starters.emplace_back([&, p]() { producer(queue, executor, p * per_producer, per_producer, running_producers); });
+    }
+    for (auto& th : starters) {
+      th.join();
+    }
+    while (running_producers.load() > 0) {
+      std::this_thread::yield();
+    }
+    queue.close();
+    while (running_consumers.load() > 0) {
+      std::this_thread::yield();
+    }
+    stop.store(true);
+    executor.Wake();
+    for (auto& th : threads) {
+      th.join();
+    }
+    long long n = static_cast<long long>(producers) * per_producer;
+    std::cout << "Потребителей: " << consumers << ", сумма " << sum.load() << " (ожидается " << n * (n - 1) / 2 << ")"
+              << std::endl;
+    ok = ok && sum.load() == n * (n - 1) / 2;
+  }
+
+  // Обычные блокирующие операции работают вместе с сопрограммами
+  {
+    BoundedQueue<int> queue(8);
+    std::thread producer_thread([&queue]() {
+      for (int i = 1; i <= 100000; ++i) {
+        queue.push(i);
+      }
+      queue.close();
+    });
+    long long sum = 0;
+    int val = 0;
+    while (queue.pop(val)) {
+      sum += val;
+    }
+    producer_thread.join();
+    std::cout << "Блокирующие push/pop: сумма " << sum << " (ожидается " << 100000LL * 100001 / 2 << ")" << std::endl;
+    ok = ok && sum == 100000LL * 100001 / 2 && !queue.try_push(1);
+  }
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,127 @@
+#ifndef DARY_HEAP_H
+#define DARY_HEAP_H
+
+#include <cstddef>
+#include <functional>
+#include <utility>
+#include <vector>
+
+// d-арная куча без синхронизации; основа очередей с приоритетом.
+// Как и в std::priority_queue, на вершине наибольший по Compare элемент.
+// При Arity = 4 дерево вдвое ниже двоичного, а потомки узла лежат рядом в памяти.
+template<typename T, typename Compare = std::less<T>, int Arity = 4>
+class DaryHeap {
+  static_assert(Arity >= 2, "DaryHeap needs at least two children per node");
+
+public:
+  explicit DaryHeap(const Compare& comp = Compare()) : comp(comp) {}
+
+  const T& top() const { return data.front(); }
+  bool empty() const { return data.empty(); }
+  size_t size() const { return data.size(); }
+  void clear() { data.clear(); }
+
+  void push(const T& val) {
+    data.push_back(val);
+    SiftUp(data.size() - 1);
+  }
+
+  void push(T&& val) {
+    data.push_back(std::move(val));
+    SiftUp(data.size() - 1);
+  }
+
+  void pop() {
+    if (data.size() > 1) {
+      data.front() = std::move(data.back());
+    }
+    data.pop_back();
+    SiftDown(0);
+  }
+
+  // Извлечение верхнего элемента с переносом в val
+  void pop(T& val) {
+    val = std::move(data.front());
+    pop();
+  }
+
+  // Вставка набора: если он сравним с кучей по размеру, дешевле перестроить кучу целиком за O(n)
+  template<typename It>
+  void push_bulk(It first, It last) {
+    size_t old_size = data.size();
+    data.insert(data.end(), first, last);
+    size_t added = data.size() - old_size;
+    if (added > old_size / 4 + 8) {
+      for (size_t i = data.size() / Arity + 1; i-- > 0;) {
+        SiftDown(i);
+      }
+    }
+    else {
+      for (size_t i = old_size; i < data.size(); ++i) {
+        SiftUp(i);
+      }
+    }
+  }
+
+  // Извлечение до n верхних элементов в порядке убывания приоритета; возвращает их число
+  size_t pop_bulk(size_t n, std::vector<T>& out) {
+    size_t taken = 0;
+    for (; taken < n && !data.empty(); ++taken) {
+      out.push_back(std::move(data.front()));
+      pop();
+    }
+    return taken;
+  }
+
+  bool operator==(const DaryHeap& obj) const { return data == obj.data; }
+  void swap(DaryHeap& obj) {
+    data.swap(obj.data);
+    std::swap(comp, obj.comp);
+  }
+
+private:
+  void SiftUp(size_t i) {
+    T val = std::move(data[i]);
+    while (i > 0) {
+      size_t parent = (i - 1) / Arity;
+      if (!comp(data[parent], val)) {
+        break;
+      }
+      data[i] = std::move(data[parent]);
+      i = parent;
+    }
+    data[i] = std::move(val);
+  }
+
+  void SiftDown(size_t i) {
+    size_t n = data.size();
+    if (i >= n) {
+      return;
+    }
+    T val = std::move(data[i]);
+    while (true) {
+      size_t first = i * Arity + 1;
+      if (first >= n) {
+        break;
+      }
+      size_t last = first + Arity < n ? first + Arity : n;
+      size_t best = first;
+      for (size_t c = first + 1; c < last; ++c) {
+        if (comp(data[best], data[c])) {
+          best = c;
+        }
+      }
+      if (!comp(val, data[best])) {
+        break;
+      }
+      data[i] = std::move(data[best]);
+      i = best;
+    }
+    data[i] = std::move(val);
+  }
+
+  std::vector<T> data;
+  Compare comp;
+};
+
+#endif
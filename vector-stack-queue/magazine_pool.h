@@ -0,0 +1,212 @@
+#ifndef MAGAZINE_POOL_H
+#define MAGAZINE_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "threadsafe_stack.h"
+
+// Пул объектов (обычно указателей) с магазинами потоков, как в slab-аллокаторе
+// Bonwick и tcache jemalloc. У потока два магазина - текущий и предыдущий - по
+// magazine_size элементов, и почти все acquire/release обходятся без блокировок.
+// Общий стек ThreadsafeStack хранит целые магазины: поток забирает полный
+// или отдает заполненный магазин за один захват блокировки, то есть примерно
+// раз в magazine_size операций. При завершении потока его магазины
+// возвращаются в отдельный список общей части пула: ThreadsafeStack пишет
+// в трассы, а их thread_local к этому моменту могут быть уже удалены.
+template<typename T>
+class MagazinePool {
+public:
+  explicit MagazinePool(const size_t magazine_size = 32);
+  MagazinePool(const MagazinePool&) = delete;
+  MagazinePool& operator=(const MagazinePool&) = delete;
+
+  // false, если элементов нет ни в магазинах потока, ни в общем стеке
+  bool try_acquire(T& val);
+  void release(const T& val) { Release(val); }
+  void release(T&& val) { Release(std::move(val)); }
+  // Возврат магазинов текущего потока в общий стек, чтобы их увидели другие потоки
+  void flush();
+
+  size_t magazine_size() const { return depot_ptr->magazine_size; }
+  // Магазинов в общем стеке и оставшихся от завершившихся потоков
+  ptrdiff_t depot_size() {
+    return depot_ptr->full.size() + static_cast<ptrdiff_t>(depot_ptr->orphan_count.load(std::memory_order_relaxed));
+  }
+  // Обращений к общему стеку
+  long long exchanges() const { return depot_ptr->exchanges.load(std::memory_order_relaxed); }
+  // Общий стек; его счетчики wait/work показывают, сколько стоят обмены магазинами
+  ThreadsafeStack<std::vector<T>>& depot() { return depot_ptr->full; }
+
+private:
+  // Общая часть пула; живет, пока на нее ссылается пул или кэш какого-нибудь потока
+  struct shared_depot {
+    ThreadsafeStack<std::vector<T>> full;
+    // Магазины завершившихся потоков; их забирают, когда общий стек пуст
+    std::mutex orphan_mutex;
+    std::vector<std::vector<T>> orphans;
+    std::atomic<size_t> orphan_count{0};
+    size_t magazine_size;
+    std::atomic<long long> exchanges{0};
+    explicit shared_depot(const size_t magazine_size) : magazine_size(magazine_size) {}
+    bool TryPopOrphan(std::vector<T>& mag);
+  };
+
+  struct cache {
+    std::shared_ptr<shared_depot> owner;
+    std::vector<T> loaded;
+    std::vector<T> previous;
+    explicit cache(std::shared_ptr<shared_depot> owner) : owner(std::move(owner)) {}
+    cache(cache&&) = default;
+    cache& operator=(cache&&) = default;
+    ~cache();
+    void Flush();
+  };
+
+  // Кэши потока для всех пулов, с которыми он работал
+  struct thread_caches {
+    std::vector<cache> caches;
+  };
+
+  cache& Local();
+  template<typename U>
+  void Release(U&& val);
+
+  static thread_local thread_caches tls;
+  std::shared_ptr<shared_depot> depot_ptr;
+};
+
+template<typename T>
+thread_local typename MagazinePool<T>::thread_caches MagazinePool<T>::tls;
+
+template<typename T>
+MagazinePool<T>::MagazinePool(const size_t magazine_size)
+  : depot_ptr(std::make_shared<shared_depot>(std::max<size_t>(magazine_size, 1))) {}
+
+template<typename T>
+void MagazinePool<T>::cache::Flush() {
+  if (!owner) {
+    return;
+  }
+  for (std::vector<T>* mag : { &loaded, &previous }) {
+    if (!mag->empty()) {
+      owner->full.push(std::move(*mag));
+      owner->exchanges.fetch_add(1, std::memory_order_relaxed);
+      *mag = std::vector<T>();
+    }
+  }
+}
+
+// Деструктор вызывается и при завершении потока, поэтому не обращается
+// к ThreadsafeStack и другим объектам с thread_local
+template<typename T>
+MagazinePool<T>::cache::~cache() {
+  if (!owner) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(owner->orphan_mutex);
+  for (std::vector<T>* mag : { &loaded, &previous }) {
+    if (!mag->empty()) {
+      owner->orphans.push_back(std::move(*mag));
+      owner->orphan_count.fetch_add(1, std::memory_order_relaxed);
+      owner->exchanges.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+}
+
+template<typename T>
+bool MagazinePool<T>::shared_depot::TryPopOrphan(std::vector<T>& mag) {
+  if (orphan_count.load(std::memory_order_relaxed) == 0) {
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(orphan_mutex);
+  if (orphans.empty()) {
+    return false;
+  }
+  mag = std::move(orphans.back());
+  orphans.pop_back();
+  orphan_count.fetch_sub(1, std::memory_order_relaxed);
+  return true;
+}
+
+template<typename T>
+typename MagazinePool<T>::cache& MagazinePool<T>::Local() {
+  std::vector<cache>& caches = tls.caches;
+  // Последний использованный пул - в конце списка; пулов у потока обычно единицы
+  if (!caches.empty() && caches.back().owner == depot_ptr) {
+    return caches.back();
+  }
+  for (size_t i = 0; i < caches.size();) {
+    if (caches[i].owner == depot_ptr) {
+      std::swap(caches[i], caches.back());
+      return caches.back();
+    }
+    // Пул уже удален: кэш держит только его общий стек, который больше никому не нужен
+    if (caches[i].owner.use_count() == 1) {
+      caches.erase(caches.begin() + i);
+    }
+    else {
+      ++i;
+    }
+  }
+  caches.emplace_back(depot_ptr);
+  return caches.back();
+}
+
+template<typename T>
+bool MagazinePool<T>::try_acquire(T& val) {
+  cache& c = Local();
+  if (c.loaded.empty()) {
+    if (!c.previous.empty()) {
+      c.loaded.swap(c.previous);
+    }
+    else {
+      // Оба магазина пусты: полный магазин из общего стека, пустой остается предыдущим
+      std::vector<T> mag;
+      if (!depot_ptr->full.try_pop(mag) && !depot_ptr->TryPopOrphan(mag)) {
+        return false;
+      }
+      depot_ptr->exchanges.fetch_add(1, std::memory_order_relaxed);
+      c.previous.swap(c.loaded);
+      c.loaded.swap(mag);
+    }
+  }
+  val = std::move(c.loaded.back());
+  c.loaded.pop_back();
+  return true;
+}
+
+template<typename T>
+template<typename U>
+void MagazinePool<T>::Release(U&& val) {
+  cache& c = Local();
+  size_t size = depot_ptr->magazine_size;
+  if (c.loaded.size() >= size) {
+    if (c.previous.empty()) {
+      c.loaded.swap(c.previous);
+    }
+    else {
+      // Оба магазина полны: предыдущий уходит в общий стек, текущий становится предыдущим
+      depot_ptr->full.push(std::move(c.previous));
+      depot_ptr->exchanges.fetch_add(1, std::memory_order_relaxed);
+      c.previous = std::move(c.loaded);
+      c.loaded = std::vector<T>();
+    }
+  }
+  if (c.loaded.capacity() < size) {
+    c.loaded.reserve(size);
+  }
+  c.loaded.push_back(std::forward<U>(val));
+}
+
+template<typename T>
+void MagazinePool<T>::flush() {
+  Local().Flush();
+}
+
+#endif
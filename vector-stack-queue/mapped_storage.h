@@ -0,0 +1,272 @@
+#ifndef MAPPED_STORAGE_H
+#define MAPPED_STORAGE_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Хранилище для ThreadsafeVector<T, MappedStorage<T>> в отображенном в память файле.
+// В начале файла небольшой заголовок с размером и емкостью, за ним элементы.
+// Открытие существующего файла ничего не копирует: элементы читаются прямо
+// из страничного кэша, и при нехватке памяти ОС сама вытесняет их на диск.
+// reserve/resize увеличивают файл и отображают его заново. Без пути
+// хранилище живет в анонимной памяти (так создаются копии).
+// Синхронизации нет: ее обеспечивает ThreadsafeVector.
+template<typename T>
+class MappedStorage {
+  static_assert(std::is_trivially_copyable<T>::value, "MappedStorage needs a trivially copyable T");
+
+public:
+  MappedStorage() { Map(0); }
+  explicit MappedStorage(const std::string& path);
+  MappedStorage(const MappedStorage& obj);
+  // Перемещенный объект остается пустым анонимным хранилищем
+  MappedStorage(MappedStorage&& obj) : MappedStorage() { swap(obj); }
+  ~MappedStorage();
+  MappedStorage& operator=(const MappedStorage& obj);
+  MappedStorage& operator=(MappedStorage&& obj) noexcept;
+  bool operator==(const MappedStorage& obj) const;
+  bool operator!=(const MappedStorage& obj) const { return !(*this == obj); }
+
+  T& operator[](size_t pos) { return elems[pos]; }
+  const T& operator[](size_t pos) const { return elems[pos]; }
+  T& at(size_t pos);
+  const T& at(size_t pos) const { return const_cast<MappedStorage*>(this)->at(pos); }
+  T& front() { return elems[0]; }
+  T& back() { return elems[head->size - 1]; }
+  bool empty() const { return head->size == 0; }
+  size_t size() const { return head->size; }
+  size_t max_size() const { return (std::numeric_limits<size_t>::max() - data_offset) / sizeof(T); }
+  size_t capacity() const { return head->capacity; }
+
+  void reserve(size_t n);
+  void resize(size_t n);
+  void shrink_to_fit();
+  void clear() { head->size = 0; }
+  void push_back(const T& val);
+  void pop_back() { --head->size; }
+  void swap(MappedStorage& obj) noexcept;
+
+  // Запись измененных страниц на диск (msync)
+  void flush();
+  const std::string& path() const { return file; }
+
+private:
+  struct header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t elem_size;
+    uint64_t size;
+    uint64_t capacity;
+  };
+
+  static constexpr uint64_t file_magic = 0x5254434556534d54ull;  // "TMSVECTR"
+  static constexpr uint32_t file_version = 1;
+  // Элементы начинаются с границы строки кэша или выравнивания T, если оно больше
+  static constexpr size_t data_offset = alignof(T) > 64 ? alignof(T) : 64;
+
+  // Отображение с емкостью capacity; размер и содержимое сохраняются
+  void Map(size_t capacity);
+  void Unmap();
+
+  header* head = nullptr;
+  T* elems = nullptr;
+  size_t mapped = 0;
+  int fd = -1;
+  std::string file;
+};
+
+template<typename T>
+MappedStorage<T>::MappedStorage(const std::string& path) : file(path) {
+  fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+  if (fd < 0) {
+    throw std::system_error(errno, std::generic_category(), "open " + path);
+  }
+  struct stat st;
+  if (::fstat(fd, &st) != 0) {
+    int err = errno;
+    ::close(fd);
+    throw std::system_error(err, std::generic_category(), "fstat " + path);
+  }
+  if (st.st_size == 0) {
+    Map(0);
+    return;
+  }
+  if (static_cast<size_t>(st.st_size) < data_offset) {
+    ::close(fd);
+    throw std::runtime_error(path + ": file is too short for a vector header");
+  }
+  void* p = ::mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (p == MAP_FAILED) {
+    int err = errno;
+    ::close(fd);
+    throw std::system_error(err, std::generic_category(), "mmap " + path);
+  }
+  header* h = static_cast<header*>(p);
+  if (h->magic != file_magic || h->version != file_version || h->elem_size != sizeof(T) || h->size > h->capacity ||
+      data_offset + h->capacity * sizeof(T) > static_cast<size_t>(st.st_size)) {
+    ::munmap(p, st.st_size);
+    ::close(fd);
+    throw std::runtime_error(path + ": not a vector file for this element type");
+  }
+  head = h;
+  elems = reinterpret_cast<T*>(static_cast<char*>(p) + data_offset);
+  mapped = st.st_size;
+}
+
+template<typename T>
+MappedStorage<T>::MappedStorage(const MappedStorage& obj) {
+  Map(obj.size());
+  std::memcpy(static_cast<void*>(elems), obj.elems, obj.size() * sizeof(T));
+  head->size = obj.size();
+}
+
+template<typename T>
+MappedStorage<T>::~MappedStorage() {
+  Unmap();
+  if (fd >= 0) {
+    ::close(fd);
+  }
+}
+
+template<typename T>
+MappedStorage<T>& MappedStorage<T>::operator=(const MappedStorage& obj) {
+  if (this != &obj) {
+    reserve(obj.size());
+    std::memcpy(static_cast<void*>(elems), obj.elems, obj.size() * sizeof(T));
+    head->size = obj.size();
+  }
+  return *this;
+}
+
+template<typename T>
+MappedStorage<T>& MappedStorage<T>::operator=(MappedStorage&& obj) noexcept {
+  swap(obj);
+  return *this;
+}
+
+template<typename T>
+bool MappedStorage<T>::operator==(const MappedStorage& obj) const {
+  return size() == obj.size() && std::equal(elems, elems + size(), obj.elems);
+}
+
+template<typename T>
+T& MappedStorage<T>::at(size_t pos) {
+  if (pos >= head->size) {
+    throw std::out_of_range("MappedStorage::at");
+  }
+  return elems[pos];
+}
+
+template<typename T>
+void MappedStorage<T>::reserve(size_t n) {
+  if (n > head->capacity) {
+    Map(n);
+  }
+}
+
+template<typename T>
+void MappedStorage<T>::resize(size_t n) {
+  if (n > head->capacity) {
+    Map(std::max(n, 2 * head->capacity));
+  }
+  // Как и std::vector, новые элементы инициализируются значением по умолчанию
+  std::fill(elems + std::min<size_t>(n, head->size), elems + n, T());
+  head->size = n;
+}
+
+template<typename T>
+void MappedStorage<T>::shrink_to_fit() {
+  if (head->capacity > head->size) {
+    Map(head->size);
+  }
+}
+
+template<typename T>
+void MappedStorage<T>::push_back(const T& val) {
+  if (head->size == head->capacity) {
+    // val может лежать в этом же хранилище: копия до переотображения
+    T copy = val;
+    Map(std::max<size_t>(2 * head->capacity, 4096 / sizeof(T) + 1));
+    elems[head->size++] = copy;
+    return;
+  }
+  elems[head->size++] = val;
+}
+
+template<typename T>
+void MappedStorage<T>::swap(MappedStorage& obj) noexcept {
+  std::swap(head, obj.head);
+  std::swap(elems, obj.elems);
+  std::swap(mapped, obj.mapped);
+  std::swap(fd, obj.fd);
+  file.swap(obj.file);
+}
+
+template<typename T>
+void MappedStorage<T>::flush() {
+  if (fd >= 0 && ::msync(head, mapped, MS_SYNC) != 0) {
+    throw std::system_error(errno, std::generic_category(), "msync " + file);
+  }
+}
+
+template<typename T>
+void MappedStorage<T>::Map(size_t capacity) {
+  size_t bytes = data_offset + capacity * sizeof(T);
+  size_t size = head ? head->size : 0;
+  void* p;
+  if (fd >= 0) {
+    // Файл и так хранит данные: достаточно изменить его длину и отобразить заново.
+    // Старое отображение снимается только после успеха нового
+    if (::ftruncate(fd, bytes) != 0) {
+      throw std::system_error(errno, std::generic_category(), "ftruncate " + file);
+    }
+    p = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+      throw std::system_error(errno, std::generic_category(), "mmap " + file);
+    }
+  }
+  else {
+    p = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+      throw std::system_error(errno, std::generic_category(), "mmap");
+    }
+    if (head) {
+      std::memcpy(static_cast<char*>(p) + data_offset, elems, std::min(size, capacity) * sizeof(T));
+    }
+  }
+  Unmap();
+  head = static_cast<header*>(p);
+  elems = reinterpret_cast<T*>(static_cast<char*>(p) + data_offset);
+  mapped = bytes;
+  head->magic = file_magic;
+  head->version = file_version;
+  head->elem_size = sizeof(T);
+  head->size = std::min(size, capacity);
+  head->capacity = capacity;
+}
+
+template<typename T>
+void MappedStorage<T>::Unmap() {
+  if (head) {
+    ::munmap(head, mapped);
+    head = nullptr;
+    elems = nullptr;
+    mapped = 0;
+  }
+}
+
+#endif
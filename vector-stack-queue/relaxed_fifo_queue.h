@@ -0,0 +1,170 @@
+#ifndef RELAXED_FIFO_QUEUE_H
+#define RELAXED_FIFO_QUEUE_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+#include <utility>
+
+#include "threadsafe_queue.h"
+#include "common/cache_line.h"
+#include "common/thread_random.h"
+
+// Очередь с ослабленным порядком FIFO: factor * threads очередей ThreadsafeQueue,
+// у каждой своя блокировка. Каждый элемент при вставке получает номер - время
+// вставки по steady_clock - и идет в случайную очередь. Извлечение выбирает
+// из двух случайных непустых очередей ту, что отстала: номер последнего
+// извлеченного из нее элемента меньше. Если обе пусты, элемент забирается
+// из первой непустой при обходе всех очередей. Элементы не теряются, а порядок
+// соблюдается приблизительно: смещение от строгого FIFO в среднем порядка
+// числа очередей.
+// При Measured = true смещение измеряется: номер берется из общего счетчика
+// вставок и сравнивается с общим счетчиком извлечений. Оба счетчика - общие
+// строки кэша для всех потоков, поэтому по умолчанию измерения нет.
+template<typename T, bool Measured = false>
+class RelaxedFifoQueue {
+public:
+  explicit RelaxedFifoQueue(const unsigned threads = std::thread::hardware_concurrency(), const unsigned factor = 2);
+  RelaxedFifoQueue(const RelaxedFifoQueue&) = delete;
+  RelaxedFifoQueue& operator=(const RelaxedFifoQueue&) = delete;
+
+  void push(const T& val);
+  // false, только если все очереди оказались пусты
+  bool try_pop(T& val);
+  // Приблизительные значения: очереди меняются, пока их суммируют
+  bool empty() const { return size() == 0; }
+  ptrdiff_t size() const;
+  size_t shard_count() const { return shards.size(); }
+
+  // Наибольшее и среднее расстояние между номером извлеченного элемента
+  // и его местом в строгом порядке FIFO; без Measured - 0
+  uint64_t max_displacement() const;
+  double mean_displacement() const;
+
+private:
+  struct item {
+    uint64_t ticket;
+    T val;
+  };
+
+  struct shard {
+    ThreadsafeQueue<item> queue;
+    // Копия размера для выбора очереди без блокировки
+    std::atomic<ptrdiff_t> size{0};
+    // Номер последнего извлеченного элемента: оценка снизу для первого в очереди
+    std::atomic<uint64_t> last_ticket{0};
+    // Измерение смещения, только при Measured
+    std::atomic<uint64_t> pops{0};
+    std::atomic<uint64_t> displacement{0};
+    std::atomic<uint64_t> max_displacement{0};
+  };
+
+  shard& Random() { return shards[ThreadRandom() % shards.size()]; }
+  uint64_t Ticket();
+  bool TryPop(shard& s, T& val);
+
+  AlignedArray<shard> shards;
+  // Общие счетчики вставок и извлечений, только при Measured
+  alignas(cache_line_size) std::atomic<uint64_t> pushed{0};
+  alignas(cache_line_size) std::atomic<uint64_t> popped{0};
+};
+
+template<typename T, bool Measured>
+RelaxedFifoQueue<T, Measured>::RelaxedFifoQueue(const unsigned threads, const unsigned factor)
+  : shards(std::max(2u, std::max(threads, 1u) * std::max(factor, 1u))) {}
+
+template<typename T, bool Measured>
+uint64_t RelaxedFifoQueue<T, Measured>::Ticket() {
+  if constexpr (Measured) {
+    return pushed.fetch_add(1, std::memory_order_relaxed);
+  }
+  else {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+}
+
+template<typename T, bool Measured>
+void RelaxedFifoQueue<T, Measured>::push(const T& val) {
+  shard& s = Random();
+  s.queue.push(item{ Ticket(), val });
+  s.size.fetch_add(1, std::memory_order_relaxed);
+}
+
+template<typename T, bool Measured>
+bool RelaxedFifoQueue<T, Measured>::TryPop(shard& s, T& val) {
+  item it;
+  if (!s.queue.try_pop(it)) {
+    return false;
+  }
+  s.size.fetch_sub(1, std::memory_order_relaxed);
+  s.last_ticket.store(it.ticket, std::memory_order_relaxed);
+  if constexpr (Measured) {
+    uint64_t index = popped.fetch_add(1, std::memory_order_relaxed);
+    uint64_t d = it.ticket > index ? it.ticket - index : index - it.ticket;
+    s.pops.fetch_add(1, std::memory_order_relaxed);
+    s.displacement.fetch_add(d, std::memory_order_relaxed);
+    uint64_t max = s.max_displacement.load(std::memory_order_relaxed);
+    while (d > max && !s.max_displacement.compare_exchange_weak(max, d, std::memory_order_relaxed)) {
+    }
+  }
+  val = std::move(it.val);
+  return true;
+}
+
+template<typename T, bool Measured>
+bool RelaxedFifoQueue<T, Measured>::try_pop(T& val) {
+  for (int attempt = 0; attempt < 2; ++attempt) {
+    shard* a = &Random();
+    shard* b = &Random();
+    if (a->size.load(std::memory_order_relaxed) <= 0 ||
+        (b->size.load(std::memory_order_relaxed) > 0 &&
+         b->last_ticket.load(std::memory_order_relaxed) < a->last_ticket.load(std::memory_order_relaxed))) {
+      std::swap(a, b);
+    }
+    if (a->size.load(std::memory_order_relaxed) > 0 && TryPop(*a, val)) {
+      return true;
+    }
+  }
+  // Обе случайные очереди пусты: забираем элемент из любой непустой
+  size_t start = ThreadRandom() % shards.size();
+  for (size_t i = 0; i < shards.size(); ++i) {
+    shard& s = shards[(start + i) % shards.size()];
+    if (s.size.load(std::memory_order_relaxed) > 0 && TryPop(s, val)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+template<typename T, bool Measured>
+ptrdiff_t RelaxedFifoQueue<T, Measured>::size() const {
+  ptrdiff_t res = 0;
+  for (size_t i = 0; i < shards.size(); ++i) {
+    res += shards[i].size.load(std::memory_order_relaxed);
+  }
+  return std::max<ptrdiff_t>(res, 0);
+}
+
+template<typename T, bool Measured>
+uint64_t RelaxedFifoQueue<T, Measured>::max_displacement() const {
+  uint64_t res = 0;
+  for (size_t i = 0; i < shards.size(); ++i) {
+    res = std::max(res, shards[i].max_displacement.load(std::memory_order_relaxed));
+  }
+  return res;
+}
+
+template<typename T, bool Measured>
+double RelaxedFifoQueue<T, Measured>::mean_displacement() const {
+  uint64_t pops = 0, sum = 0;
+  for (size_t i = 0; i < shards.size(); ++i) {
+    pops += shards[i].pops.load(std::memory_order_relaxed);
+    sum += shards[i].displacement.load(std::memory_order_relaxed);
+  }
+  return pops ? sum * 1. / pops : 0;
+}
+
+#endif
@@ -0,0 +1,259 @@
+#ifndef RELAXED_PRIORITY_QUEUE_H
+#define RELAXED_PRIORITY_QUEUE_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "dary_heap.h"
+#include "common/cache_line.h"
+#include "common/thread_random.h"
+#include "instrumentation/lock_trace.h"
+#include "instrumentation/metrics.h"
+#include "trace-replay/trace.h"
+
+// Очередь с ослабленным порядком (MultiQueue, Rihani, Sanders, Dementiev 2015):
+// factor * threads куч, у каждой своя блокировка. Вставка идет в случайную кучу,
+// извлечение берет лучшую из вершин двух случайных куч. Извлекаемый элемент
+// в среднем лишь на O(числа куч) позиций хуже строгого максимума, зато потоки
+// почти не ждут друг друга. Блокировки берутся через try_lock: занятую кучу
+// пропускают и выбирают другую.
+// Ожидание считается от начала операции до захвата той кучи, с которой она
+// работает, вместе с пропущенными занятыми кучами. Общих карт wait/work нет:
+// суммы ведет каждая куча под своей блокировкой.
+template<typename T, typename Compare = std::less<T>>
+class RelaxedPriorityQueue {
+public:
+  explicit RelaxedPriorityQueue(const unsigned threads = std::thread::hardware_concurrency(), const unsigned factor = 2,
+                                const Compare& comp = Compare());
+  RelaxedPriorityQueue(const RelaxedPriorityQueue&) = delete;
+  RelaxedPriorityQueue& operator=(const RelaxedPriorityQueue&) = delete;
+
+  void push(const T& val);
+  // false, только если все кучи оказались пусты
+  bool try_pop(T& val);
+  // Набор элементов в одну случайную кучу под одной блокировкой
+  void push_bulk(const std::vector<T>& vals);
+  // До n элементов из лучшей из двух случайных куч; возвращает их число
+  size_t pop_bulk(const size_t n, std::vector<T>& out);
+  // Приблизительные значения: кучи меняются, пока их суммируют
+  bool empty() const { return size() == 0; }
+  ptrdiff_t size() const;
+  size_t heap_count() const { return heaps.size(); }
+  // Суммарное ожидание блокировок и работа под ними по всем кучам
+  std::chrono::nanoseconds wait_time() const;
+  std::chrono::nanoseconds work_time() const;
+  // Обнуление сумм; только когда операций нет
+  void reset_times();
+
+  metrics::LockStats stats{"RelaxedPriorityQueue"};
+
+private:
+  using clock = std::chrono::steady_clock;
+
+  struct heap {
+    std::mutex mutex;
+    DaryHeap<T, Compare> data;
+    // Копия размера для проверки без блокировки
+    std::atomic<size_t> size{0};
+    // Суммы в нс; меняются под блокировкой кучи, читаются без нее
+    std::atomic<long long> wait{0};
+    std::atomic<long long> work{0};
+    explicit heap(const Compare& comp) : data(comp) {}
+  };
+
+  heap& Random() { return heaps[ThreadRandom() % heaps.size()]; }
+  // Захват лучшей из двух случайных непустых куч; nullptr, если не удалось
+  heap* LockBest(std::unique_lock<std::mutex>& lock);
+  // Конец работы с захваченной кучей h: учет ожидания и работы; вызывается под ее блокировкой
+  void Record(heap& h, const char* op, const clock::time_point time1, const clock::time_point time2);
+
+  AlignedArray<heap> heaps;
+  Compare comp;
+};
+
+template<typename T, typename Compare>
+RelaxedPriorityQueue<T, Compare>::RelaxedPriorityQueue(const unsigned threads, const unsigned factor, const Compare& comp)
+  : heaps(std::max(2u, std::max(threads, 1u) * std::max(factor, 1u)), comp), comp(comp) {}
+
+template<typename T, typename Compare>
+void RelaxedPriorityQueue<T, Compare>::push(const T& val) {
+  trace::Record(trace::Kind::priority_queue, this, trace::Op::add, trace::Key(val));
+  auto time1 = clock::now();
+  while (true) {
+    heap& h = Random();
+    std::unique_lock<std::mutex> lock(h.mutex, std::try_to_lock);
+    if (lock.owns_lock()) {
+      auto time2 = clock::now();
+      h.data.push(val);
+      h.size.store(h.data.size(), std::memory_order_relaxed);
+      Record(h, "push", time1, time2);
+      return;
+    }
+  }
+}
+
+template<typename T, typename Compare>
+void RelaxedPriorityQueue<T, Compare>::push_bulk(const std::vector<T>& vals) {
+  if (trace::Enabled()) {
+    for (const T& val : vals) {
+      trace::Record(trace::Kind::priority_queue, this, trace::Op::add, trace::Key(val));
+    }
+  }
+  auto time1 = clock::now();
+  while (true) {
+    heap& h = Random();
+    std::unique_lock<std::mutex> lock(h.mutex, std::try_to_lock);
+    if (lock.owns_lock()) {
+      auto time2 = clock::now();
+      h.data.push_bulk(vals.begin(), vals.end());
+      h.size.store(h.data.size(), std::memory_order_relaxed);
+      Record(h, "push_bulk", time1, time2);
+      return;
+    }
+  }
+}
+
+template<typename T, typename Compare>
+typename RelaxedPriorityQueue<T, Compare>::heap* RelaxedPriorityQueue<T, Compare>::LockBest(std::unique_lock<std::mutex>& lock) {
+  heap* a = &Random();
+  heap* b = &Random();
+  if (a->size.load(std::memory_order_relaxed) == 0) {
+    std::swap(a, b);
+  }
+  if (a->size.load(std::memory_order_relaxed) == 0) {
+    return nullptr;
+  }
+  std::unique_lock<std::mutex> lock_a(a->mutex, std::try_to_lock);
+  std::unique_lock<std::mutex> lock_b;
+  if (b != a && b->size.load(std::memory_order_relaxed) > 0) {
+    lock_b = std::unique_lock<std::mutex>(b->mutex, std::try_to_lock);
+  }
+  bool use_a = lock_a.owns_lock() && !a->data.empty();
+  bool use_b = lock_b.owns_lock() && !b->data.empty();
+  if (use_a && use_b) {
+    use_a = !comp(a->data.top(), b->data.top());
+    use_b = !use_a;
+  }
+  if (use_a) {
+    lock = std::move(lock_a);
+    return a;
+  }
+  if (use_b) {
+    lock = std::move(lock_b);
+    return b;
+  }
+  return nullptr;
+}
+
+template<typename T, typename Compare>
+bool RelaxedPriorityQueue<T, Compare>::try_pop(T& val) {
+  trace::Record(trace::Kind::priority_queue, this, trace::Op::remove, 0);
+  auto time1 = clock::now();
+  for (size_t attempt = 0; attempt < 2 * heaps.size(); ++attempt) {
+    std::unique_lock<std::mutex> lock;
+    heap* h = LockBest(lock);
+    if (h) {
+      auto time2 = clock::now();
+      h->data.pop(val);
+      h->size.store(h->data.size(), std::memory_order_relaxed);
+      Record(*h, "try_pop", time1, time2);
+      return true;
+    }
+  }
+  // Случайные попытки не нашли элементов: полный обход с ожиданием блокировок
+  for (size_t i = 0; i < heaps.size(); ++i) {
+    heap& h = heaps[i];
+    std::lock_guard<std::mutex> lock(h.mutex);
+    if (!h.data.empty()) {
+      auto time2 = clock::now();
+      h.data.pop(val);
+      h.size.store(h.data.size(), std::memory_order_relaxed);
+      Record(h, "try_pop", time1, time2);
+      return true;
+    }
+  }
+  return false;
+}
+
+template<typename T, typename Compare>
+size_t RelaxedPriorityQueue<T, Compare>::pop_bulk(const size_t n, std::vector<T>& out) {
+  auto time1 = clock::now();
+  for (size_t attempt = 0; attempt < 2 * heaps.size(); ++attempt) {
+    std::unique_lock<std::mutex> lock;
+    heap* h = LockBest(lock);
+    if (h) {
+      auto time2 = clock::now();
+      size_t res = h->data.pop_bulk(n, out);
+      h->size.store(h->data.size(), std::memory_order_relaxed);
+      Record(*h, "pop_bulk", time1, time2);
+      return res;
+    }
+  }
+  for (size_t i = 0; i < heaps.size(); ++i) {
+    heap& h = heaps[i];
+    std::lock_guard<std::mutex> lock(h.mutex);
+    if (!h.data.empty()) {
+      auto time2 = clock::now();
+      size_t res = h.data.pop_bulk(n, out);
+      h.size.store(h.data.size(), std::memory_order_relaxed);
+      Record(h, "pop_bulk", time1, time2);
+      return res;
+    }
+  }
+  return 0;
+}
+
+template<typename T, typename Compare>
+void RelaxedPriorityQueue<T, Compare>::Record(heap& h, const char* op, const clock::time_point time1,
+                                              const clock::time_point time2) {
+  auto time3 = clock::now();
+  h.wait.store(h.wait.load(std::memory_order_relaxed) +
+               std::chrono::duration_cast<std::chrono::nanoseconds>(time2 - time1).count(), std::memory_order_relaxed);
+  h.work.store(h.work.load(std::memory_order_relaxed) +
+               std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2).count(), std::memory_order_relaxed);
+  lock_trace::Record(this, "RelaxedPriorityQueue", op, true, time1, time2, time3);
+  stats.Record(time1, time2, time3);
+}
+
+template<typename T, typename Compare>
+std::chrono::nanoseconds RelaxedPriorityQueue<T, Compare>::wait_time() const {
+  long long res = 0;
+  for (size_t i = 0; i < heaps.size(); ++i) {
+    res += heaps[i].wait.load(std::memory_order_relaxed);
+  }
+  return std::chrono::nanoseconds(res);
+}
+
+template<typename T, typename Compare>
+std::chrono::nanoseconds RelaxedPriorityQueue<T, Compare>::work_time() const {
+  long long res = 0;
+  for (size_t i = 0; i < heaps.size(); ++i) {
+    res += heaps[i].work.load(std::memory_order_relaxed);
+  }
+  return std::chrono::nanoseconds(res);
+}
+
+template<typename T, typename Compare>
+void RelaxedPriorityQueue<T, Compare>::reset_times() {
+  for (size_t i = 0; i < heaps.size(); ++i) {
+    heaps[i].wait.store(0, std::memory_order_relaxed);
+    heaps[i].work.store(0, std::memory_order_relaxed);
+  }
+}
+
+template<typename T, typename Compare>
+ptrdiff_t RelaxedPriorityQueue<T, Compare>::size() const {
+  ptrdiff_t res = 0;
+  for (size_t i = 0; i < heaps.size(); ++i) {
+    res += heaps[i].size.load(std::memory_order_relaxed);
+  }
+  return res;
+}
+
+#endif
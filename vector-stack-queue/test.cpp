@@ -1,8 +1,17 @@
 #include "threadsafe_stack.h"
 #include "threadsafe_queue.h"
 #include "threadsafe_vector.h"
+#if __has_include(<sys/mman.h>)
+#include "mapped_storage.h"
+#endif
+#include "threadsafe_priority_queue.h"
+#include "relaxed_priority_queue.h"
+#include "threadsafe_hash_map.h"
+#include "magazine_pool.h"
+#include "relaxed_fifo_queue.h"
 
 #include <algorithm>
+#include <cstdio>
 #include <iostream>
 #include <iomanip>
 #include <thread>
@@ -45,19 +54,19 @@ void testStack() {
   long long minwait = 0, maxwait = 0, sumwait = 0;
   for (auto t : obj.wait) {
     sumwait += t.second.count();
-    minwait = std::min(minwait, t.second.count());
-    maxwait = std::max(maxwait, t.second.count());
+    minwait = std::min<long long>(minwait, t.second.count());
+    maxwait = std::max<long long>(maxwait, t.second.count());
   }
   double midwait = sumwait / obj.wait.size();
   long long sumwork = 0;
   for (auto t : obj.work) {
     sumwork += t.second.count();
   }
-  std::cout<< "--------------------" <<std::endl;
-  std::cout << "  : " << minwait << " ns" << std::endl;
-  std::cout << "  : " << maxwait << " ns" << std::endl;
-  std::cout << "  : " << midwait << " ns" << std::endl;
-  std::cout << "  : " << sumwork * 1. / all << std::endl;
+  std::cout<< "----------СТЕК----------" <<std::endl;
+  std::cout << "Минимальное время ожидания: " << minwait << " ns" << std::endl;
+  std::cout << "Максимальное время ожидания: " << maxwait << " ns" << std::endl;
+  std::cout << "Среднее время ожидания: " << midwait << " ns" << std::endl;
+  std::cout << "Коэффициент эффективного использования: " << sumwork * 1. / all << std::endl;
   std::cout << std::endl;
 }
 
@@ -100,19 +109,19 @@ void testQueue() {
   long long minwait = 0, maxwait = 0, sumwait = 0;
   for (auto t : obj.wait) {
     sumwait += t.second.count();
-    minwait = std::min(minwait, t.second.count());
-    maxwait = std::max(maxwait, t.second.count());
+    minwait = std::min<long long>(minwait, t.second.count());
+    maxwait = std::max<long long>(maxwait, t.second.count());
   }
   double midwait = sumwait / obj.wait.size();
   long long sumwork = 0;
   for (auto t : obj.work) {
     sumwork += t.second.count();
   }
-  std::cout << "--------------------" << std::endl;
-  std::cout << "  : " << minwait << " ns" << std::endl;
-  std::cout << "  : " << maxwait << " ns" << std::endl;
-  std::cout << "  : " << midwait << " ns" << std::endl;
-  std::cout << "  : " << sumwork * 1. / all << std::endl;
+  std::cout << "----------ОЧЕРЕДЬ----------" << std::endl;
+  std::cout << "Минимальное время ожидания: " << minwait << " ns" << std::endl;
+  std::cout << "Максимальное время ожидания: " << maxwait << " ns" << std::endl;
+  std::cout << "Среднее время ожидания: " << midwait << " ns" << std::endl;
+  std::cout << "Коэффициент эффективного использования: " << sumwork * 1. / all << std::endl;
   std::cout << std::endl;
 }
 
@@ -153,19 +162,275 @@ void testVector() {
   long long minwait = 0, maxwait = 0, sumwait = 0;
   for (auto t : obj.wait) {
     sumwait += t.second.count();
-    minwait = std::min(minwait, t.second.count());
-    maxwait = std::max(maxwait, t.second.count());
+    minwait = std::min<long long>(minwait, t.second.count());
+    maxwait = std::max<long long>(maxwait, t.second.count());
   }
   double midwait = sumwait / obj.wait.size();
   long long sumwork = 0;
   for (auto t : obj.work) {
     sumwork += t.second.count();
   }
-  std::cout << "--------------------" << std::endl;
-  std::cout << "  : " << minwait << " ns" << std::endl;
-  std::cout << "  : " << maxwait << " ns" << std::endl;
-  std::cout << "  : " << midwait << " ns" << std::endl;
-  std::cout << "  : " << sumwork * 1. / all << std::endl;
+  std::cout << "----------ВЕКТОР----------" << std::endl;
+  std::cout << "Минимальное время ожидания: " << minwait << " ns" << std::endl;
+  std::cout << "Максимальное время ожидания: " << maxwait << " ns" << std::endl;
+  std::cout << "Среднее время ожидания: " << midwait << " ns" << std::endl;
+  std::cout << "Коэффициент эффективного использования: " << sumwork * 1. / all << std::endl;
+  std::cout << std::endl;
+}
+
+#if __has_include(<sys/mman.h>)
+// MappedStorage использует POSIX mmap
+struct Record {
+  long long id;
+  double value[7];
+};
+
+void testMappedVector() {
+  const char* path = "mapped_vector.bin";
+  std::remove(path);
+  int n = 1e6;
+  auto start = std::chrono::steady_clock::now();
+  {
+    ThreadsafeVector<Record, MappedStorage<Record>> obj{MappedStorage<Record>(path)};
+    std::thread th1([&obj, n]() {
+      for (int i = 0; i < n; ++i) {
+        obj.push_back(Record{i, {i * 0.5}});
+      }
+    });
+    std::thread th2([&obj, n]() {
+      for (int i = 0; i < n; ++i) {
+        obj.push_back(Record{n + i, {(n + i) * 0.5}});
+      }
+    });
+    th1.join();
+    th2.join();
+    obj.flush();
+  }
+  auto built = std::chrono::steady_clock::now();
+  // Повторное открытие только отображает файл, не читая его
+  ThreadsafeVector<Record, MappedStorage<Record>> obj{MappedStorage<Record>(path)};
+  auto opened = std::chrono::steady_clock::now();
+  long long sum = 0;
+  bool values_ok = true;
+  for (ptrdiff_t i = 0; i < obj.size(); ++i) {
+    Record r = obj[i];
+    sum += r.id;
+    values_ok = values_ok && r.value[0] == r.id * 0.5;
+  }
+  std::cout << "----------ВЕКТОР В ФАЙЛЕ----------" << std::endl;
+  std::cout << "Заполнение " << 2 * n << " записей: "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(built - start).count() << " ms" << std::endl;
+  std::cout << "Повторное открытие: "
+            << std::chrono::duration_cast<std::chrono::microseconds>(opened - built).count() << " us" << std::endl;
+  std::cout << "Размер " << obj.size() << ", емкость " << obj.capacity() << ", данные "
+            << (values_ok && sum == 2LL * n * (2LL * n - 1) / 2 ? "совпадают" : "НЕ СОВПАДАЮТ") << std::endl;
+  std::cout << std::endl;
+  std::remove(path);
+}
+#endif
+
+void pushPriority(ThreadsafePriorityQueue<int, std::greater<int>>& obj, int num) {
+  for (int i = 0; i < num; ++i) {
+    obj.push(num - i);
+  }
+}
+
+void popPriority(ThreadsafePriorityQueue<int, std::greater<int>>& obj, int num) {
+  int val = 0;
+  for (int i = 0; i < num; ++i) {
+    obj.try_pop(val);
+  }
+}
+
+void testPriorityQueue() {
+  ThreadsafePriorityQueue<int, std::greater<int>> obj;
+  int n = 1e6;
+  pushPriority(obj, n);
+  auto start = std::chrono::steady_clock::now();
+  std::thread th1(pushPriority, std::ref(obj), n);
+  std::thread th2(popPriority, std::ref(obj), n);
+  std::thread th3(pushPriority, std::ref(obj), n);
+  std::thread th4(popPriority, std::ref(obj), n);
+  th1.join();
+  th2.join();
+  th3.join();
+  th4.join();
+  auto finish = std::chrono::steady_clock::now();
+  long long all = std::chrono::duration_cast<std::chrono::nanoseconds>(finish - start).count();
+  long long sumwait = 0, sumwork = 0;
+  for (auto t : obj.wait) {
+    sumwait += t.second.count();
+  }
+  for (auto t : obj.work) {
+    sumwork += t.second.count();
+  }
+  // Тот же поток операций через ослабленную очередь
+  RelaxedPriorityQueue<int, std::greater<int>> relaxed(4);
+  for (int i = 0; i < n; ++i) {
+    relaxed.push(n - i);
+  }
+  auto relaxed_start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&relaxed, n, t]() {
+      int val = 0;
+      for (int i = 0; i < n; ++i) {
+        if (t % 2) {
+          relaxed.try_pop(val);
+        }
+        else {
+          relaxed.push(n - i);
+        }
+      }
+    });
+  }
+  for (auto& th : threads) {
+    th.join();
+  }
+  auto relaxed_finish = std::chrono::steady_clock::now();
+  std::cout << "----------ОЧЕРЕДЬ С ПРИОРИТЕТОМ----------" << std::endl;
+  std::cout << "Среднее время ожидания: " << sumwait / obj.wait.size() << " ns" << std::endl;
+  std::cout << "Коэффициент эффективного использования: " << sumwork * 1. / all << std::endl;
+  std::cout << "Строгая очередь: " << all / 1000000 << " ms, размер " << obj.size() << std::endl;
+  std::cout << "Ослабленная очередь: "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(relaxed_finish - relaxed_start).count()
+            << " ms, размер " << relaxed.size() << std::endl;
+  std::cout << std::endl;
+}
+
+void testHashMap() {
+  ThreadsafeHashMap<int, int> obj;
+  int n = 1e6;
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.emplace_back([&obj, n, t]() {
+      for (int i = t; i < n; i += 4) {
+        obj.insert(i, 2 * i);
+      }
+      int val = 0;
+      for (int i = 0; i < n; ++i) {
+        obj.find(i, val);
+      }
+      for (int i = t; i < n; i += 8) {
+        obj.erase(i);
+      }
+    });
+  }
+  for (auto& th : threads) {
+    th.join();
+  }
+  auto finish = std::chrono::steady_clock::now();
+  int val = 0;
+  bool found = obj.find(5, val) && val == 10 && !obj.contains(1);
+  std::cout << "----------ХЕШ-ТАБЛИЦА----------" << std::endl;
+  std::cout << "Полос: " << obj.stripe_count() << ", элементов: " << obj.size() << " (ожидается " << n / 2 << ")"
+            << std::endl;
+  std::cout << "Поиск после удаления " << (found ? "верен" : "НЕВЕРЕН") << std::endl;
+  std::cout << "Время: " << std::chrono::duration_cast<std::chrono::milliseconds>(finish - start).count() << " ms"
+            << std::endl;
+  std::cout << std::endl;
+}
+
+void testMagazinePool() {
+  const int objects = 1024, n = 1e6;
+  std::vector<int> storage(objects);
+  // Пул на одном стеке: каждое получение и возврат объекта захватывают блокировку
+  ThreadsafeStack<int*> stack;
+  MagazinePool<int*> pool(32);
+  for (int i = 0; i < objects; ++i) {
+    stack.push(&storage[i]);
+    pool.release(&storage[i]);
+  }
+  pool.flush();
+  auto work = [n](auto acquire, auto release) {
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+      threads.emplace_back([=]() {
+        int* held[8];
+        for (int i = 0; i < n; i += 8) {
+          int got = 0;
+          while (got < 8 && acquire(held[got])) {
+            ++*held[got++];
+          }
+          while (got > 0) {
+            release(held[--got]);
+          }
+        }
+      });
+    }
+    for (auto& th : threads) {
+      th.join();
+    }
+  };
+  auto start = std::chrono::steady_clock::now();
+  work([&stack](int*& p) { return stack.try_pop(p); }, [&stack](int* p) { stack.push(p); });
+  auto middle = std::chrono::steady_clock::now();
+  long long before = pool.exchanges();
+  work([&pool](int*& p) { return pool.try_acquire(p); }, [&pool](int* p) { pool.release(p); });
+  auto finish = std::chrono::steady_clock::now();
+  std::cout << "----------ПУЛ С МАГАЗИНАМИ----------" << std::endl;
+  std::cout << "Общий стек: " << std::chrono::duration_cast<std::chrono::milliseconds>(middle - start).count()
+            << " ms, захватов блокировки: " << 8LL * n << std::endl;
+  std::cout << "Магазины по " << pool.magazine_size() << ": "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(finish - middle).count()
+            << " ms, захватов блокировки: " << pool.exchanges() - before << std::endl;
+  std::cout << "Магазинов в общем стеке после завершения потоков: " << pool.depot_size() << std::endl;
+  // Магазины завершившихся потоков снова выдаются пулом
+  int returned = 0;
+  for (int* p = nullptr; pool.try_acquire(p);) {
+    ++returned;
+  }
+  std::cout << "Объектов в пуле: " << returned << " (ожидается " << objects << ")" << std::endl;
+  std::cout << std::endl;
+}
+
+void testRelaxedQueue() {
+  int n = 1e6;
+  ThreadsafeQueue<int> strict;
+  RelaxedFifoQueue<int> relaxed(4);
+  auto work = [n](auto push, auto pop) {
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+      threads.emplace_back([=]() {
+        int val = 0;
+        for (int i = 0; i < n; ++i) {
+          if (i % 2) {
+            pop(val);
+          }
+          else {
+            push(i);
+          }
+        }
+      });
+    }
+    for (auto& th : threads) {
+      th.join();
+    }
+  };
+  auto start = std::chrono::steady_clock::now();
+  work([&strict](int v) { strict.push(v); }, [&strict](int& v) { return strict.try_pop(v); });
+  auto middle = std::chrono::steady_clock::now();
+  work([&relaxed](int v) { relaxed.push(v); }, [&relaxed](int& v) { return relaxed.try_pop(v); });
+  auto finish = std::chrono::steady_clock::now();
+  // Порядок: последовательные вставки и извлечения одного потока, с измерением смещения
+  RelaxedFifoQueue<int, true> ordered(4);
+  for (int i = 0; i < n; ++i) {
+    ordered.push(i);
+  }
+  long long sum = 0;
+  int val = 0;
+  while (ordered.try_pop(val)) {
+    sum += val;
+  }
+  std::cout << "----------ОСЛАБЛЕННАЯ ОЧЕРЕДЬ FIFO----------" << std::endl;
+  std::cout << "Строгая очередь: " << std::chrono::duration_cast<std::chrono::milliseconds>(middle - start).count()
+            << " ms" << std::endl;
+  std::cout << "Ослабленная очередь из " << relaxed.shard_count() << " очередей: "
+            << std::chrono::duration_cast<std::chrono::milliseconds>(finish - middle).count() << " ms" << std::endl;
+  std::cout << "Смещение от FIFO: среднее " << ordered.mean_displacement() << ", наибольшее "
+            << ordered.max_displacement() << std::endl;
+  std::cout << "Все элементы извлечены: " << (sum == 1LL * n * (n - 1) / 2 ? "да" : "НЕТ") << std::endl;
   std::cout << std::endl;
 }
 
@@ -175,6 +440,13 @@ int main() {
   testStack();
   testQueue();
   testVector();
+#if __has_include(<sys/mman.h>)
+  testMappedVector();
+#endif
+  testPriorityQueue();
+  testHashMap();
+  testMagazinePool();
+  testRelaxedQueue();
 
   return 0;
 }
\ No newline at end of file
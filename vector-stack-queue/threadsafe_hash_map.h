@@ -0,0 +1,527 @@
+#ifndef THREADSAFE_HASH_MAP_H
+#define THREADSAFE_HASH_MAP_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
+#include <mutex>
+#include <shared_mutex>
+#include <utility>
+
+// MSVC не определяет __SSE2__: на x64 SSE2 есть всегда, на x86 - при /arch:SSE2 и выше
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define THREADSAFE_HASH_MAP_SSE2
+#include <emmintrin.h>
+#endif
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+#include "common/cache_line.h"
+#include "instrumentation/lock_trace.h"
+#include "instrumentation/metrics.h"
+#include "trace-replay/trace.h"
+
+namespace hash_map_detail {
+
+// Управляющие байты: 0..127 - 7 младших бит хеша занятой ячейки
+const int8_t ctrl_empty = -128;
+const int8_t ctrl_deleted = -2;
+const size_t group_size = 16;
+
+// Управляющие байты группы из 16 ячеек; сравниваются с искомым байтом одной SIMD-инструкцией
+struct alignas(group_size) group {
+  int8_t ctrl[group_size];
+
+  // Битовая маска ячеек с управляющим байтом h
+  uint32_t Match(const int8_t h) const {
+#ifdef THREADSAFE_HASH_MAP_SSE2
+    __m128i c = _mm_load_si128(reinterpret_cast<const __m128i*>(ctrl));
+    return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(c, _mm_set1_epi8(h))));
+#else
+    uint32_t res = 0;
+    for (size_t i = 0; i < group_size; ++i) {
+      res |= static_cast<uint32_t>(ctrl[i] == h) << i;
+    }
+    return res;
+#endif
+  }
+
+  uint32_t MatchEmpty() const { return Match(ctrl_empty); }
+
+  // Свободные ячейки - пустые и удаленные; у них и только у них старший бит равен 1
+  uint32_t MatchFree() const {
+#ifdef THREADSAFE_HASH_MAP_SSE2
+    return static_cast<uint32_t>(_mm_movemask_epi8(_mm_load_si128(reinterpret_cast<const __m128i*>(ctrl))));
+#else
+    uint32_t res = 0;
+    for (size_t i = 0; i < group_size; ++i) {
+      res |= static_cast<uint32_t>(ctrl[i] < 0) << i;
+    }
+    return res;
+#endif
+  }
+};
+
+// Номер младшего единичного бита; mask не равна нулю
+inline int LowestBit(const uint32_t mask) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_ctz(mask);
+#elif defined(_MSC_VER)
+  unsigned long index = 0;
+  _BitScanForward(&index, mask);
+  return static_cast<int>(index);
+#else
+  int res = 0;
+  for (uint32_t m = mask; !(m & 1); m >>= 1) {
+    ++res;
+  }
+  return res;
+#endif
+}
+
+// Перемешивание хеша: std::hash<int> в libstdc++ - тождественная функция
+inline uint64_t Mix(uint64_t h) {
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdull;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ull;
+  h ^= h >> 33;
+  return h;
+}
+
+}
+
+// Хеш-таблица с открытой адресацией в стиле Swiss table и блокировками по полосам.
+// Ключ по старшим битам хеша попадает в одну из полос; у каждой полосы своя
+// блокировка (shared_mutex, как у остальных контейнеров) и своя таблица.
+// Внутри таблицы ячейки собраны в группы по 16, управляющие байты группы
+// сравниваются с 7 битами хеша одной инструкцией SSE2, так что поиск обычно
+// читает одну группу и одну ячейку.
+// Рост не останавливает даже свою полосу целиком: при заполнении полоса заводит
+// таблицу вдвое больше, а старую переносит по несколько групп за каждую запись.
+// Пока перенос идет, поиск смотрит в обе таблицы.
+// Общих карт wait/work, как у контейнеров с одной блокировкой, нет: их нечем защитить;
+// lock_trace, metrics и trace подключены так же, как у остальных.
+template<typename K, typename V, typename Hash = std::hash<K>>
+class ThreadsafeHashMap {
+public:
+  // stripes округляется вверх до степени двойки
+  explicit ThreadsafeHashMap(const size_t stripes = 64, const Hash& hash = Hash());
+  ThreadsafeHashMap(const ThreadsafeHashMap&) = delete;
+  ThreadsafeHashMap& operator=(const ThreadsafeHashMap&) = delete;
+
+  // false, если ключ уже есть (значение не меняется)
+  bool insert(const K& key, const V& val);
+  // true, если ключ добавлен, false - если значение заменено
+  bool insert_or_assign(const K& key, const V& val);
+  bool find(const K& key, V& val);
+  bool contains(const K& key);
+  bool erase(const K& key);
+  void clear();
+  // Приблизительные значения: полосы меняются, пока их суммируют
+  bool empty() { return size() == 0; }
+  ptrdiff_t size();
+  size_t stripe_count() const { return stripes.size(); }
+
+  metrics::LockStats stats{"ThreadsafeHashMap"};
+
+private:
+  using value_type = std::pair<K, V>;
+  using group = hash_map_detail::group;
+  using clock = std::chrono::steady_clock;
+
+  // Таблица одной полосы: groups групп управляющих байтов и groups * 16 ячеек
+  struct table {
+    size_t groups = 0;
+    std::unique_ptr<group[]> ctrl;
+    value_type* slots = nullptr;
+    size_t size = 0;
+    size_t deleted = 0;
+
+    table() = default;
+    explicit table(const size_t groups);
+    table(table&& obj) noexcept { swap(obj); }
+    table& operator=(table&& obj) noexcept;
+    ~table();
+
+    void swap(table& obj) noexcept;
+    size_t capacity() const { return groups * hash_map_detail::group_size; }
+    // Свободных ячеек хватает, пока занятые и удаленные не превышают 7/8
+    bool full() const { return (size + deleted + 1) * 8 > capacity() * 7; }
+    // Номер ячейки с ключом key или -1
+    ptrdiff_t Find(const K& key, const uint64_t h) const;
+    // Вставка отсутствующего ключа; таблица не должна быть заполнена
+    value_type* Insert(const uint64_t h, value_type&& val);
+    void Erase(const size_t pos);
+    void Clear();
+    void SetCtrl(const size_t pos, const int8_t c) {
+      ctrl[pos / hash_map_detail::group_size].ctrl[pos % hash_map_detail::group_size] = c;
+    }
+  };
+
+  struct stripe {
+    mutable std::shared_mutex mutex;
+    table current;
+    // Таблица, из которой еще переносятся ключи; пустая, если переноса нет
+    table old;
+    size_t migrated = 0;
+    std::atomic<ptrdiff_t> size{0};
+  };
+
+  // Групп переносится за одну запись в полосу
+  static const size_t migrate_step = 4;
+
+  uint64_t HashOf(const K& key) const { return hash_map_detail::Mix(hash(key)); }
+  stripe& StripeOf(const uint64_t h) { return stripes[(h >> 32) & (stripes.size() - 1)]; }
+  static clock::time_point Stamp(const clock::time_point time0) {
+    return time0 == clock::time_point() ? time0 : clock::now();
+  }
+
+  // Поиск в обеих таблицах полосы
+  static value_type* Find(stripe& s, const K& key, const uint64_t h);
+  // Перенос очередных migrate_step групп из старой таблицы
+  void Migrate(stripe& s);
+  // Новая таблица для полосы, текущая становится старой и переносится постепенно
+  void Grow(stripe& s);
+  static void Publish(stripe& s) { s.size.store(s.current.size + s.old.size, std::memory_order_relaxed); }
+
+  AlignedArray<stripe> stripes;
+  Hash hash;
+};
+
+template<typename K, typename V, typename Hash>
+ThreadsafeHashMap<K, V, Hash>::table::table(const size_t groups)
+  : groups(groups), ctrl(new group[groups]),
+    slots(std::allocator<value_type>().allocate(groups * hash_map_detail::group_size)) {
+  std::memset(static_cast<void*>(ctrl.get()), static_cast<unsigned char>(hash_map_detail::ctrl_empty),
+              groups * sizeof(group));
+}
+
+template<typename K, typename V, typename Hash>
+typename ThreadsafeHashMap<K, V, Hash>::table& ThreadsafeHashMap<K, V, Hash>::table::operator=(table&& obj) noexcept {
+  table tmp(std::move(obj));
+  swap(tmp);
+  return *this;
+}
+
+template<typename K, typename V, typename Hash>
+ThreadsafeHashMap<K, V, Hash>::table::~table() {
+  Clear();
+  if (slots) {
+    std::allocator<value_type>().deallocate(slots, capacity());
+  }
+}
+
+template<typename K, typename V, typename Hash>
+void ThreadsafeHashMap<K, V, Hash>::table::swap(table& obj) noexcept {
+  std::swap(groups, obj.groups);
+  ctrl.swap(obj.ctrl);
+  std::swap(slots, obj.slots);
+  std::swap(size, obj.size);
+  std::swap(deleted, obj.deleted);
+}
+
+template<typename K, typename V, typename Hash>
+ptrdiff_t ThreadsafeHashMap<K, V, Hash>::table::Find(const K& key, const uint64_t h) const {
+  if (groups == 0) {
+    return -1;
+  }
+  const int8_t h2 = static_cast<int8_t>(h & 0x7f);
+  size_t mask = groups - 1;
+  size_t g = (h >> 7) & mask;
+  // Квадратичное пробирование по группам; пустая ячейка в группе завершает поиск
+  for (size_t step = 1; step <= groups; ++step) {
+    const group& grp = ctrl[g];
+    for (uint32_t m = grp.Match(h2); m; m &= m - 1) {
+      size_t pos = g * hash_map_detail::group_size + hash_map_detail::LowestBit(m);
+      if (slots[pos].first == key) {
+        return static_cast<ptrdiff_t>(pos);
+      }
+    }
+    if (grp.MatchEmpty()) {
+      return -1;
+    }
+    g = (g + step) & mask;
+  }
+  return -1;
+}
+
+template<typename K, typename V, typename Hash>
+typename ThreadsafeHashMap<K, V, Hash>::value_type* ThreadsafeHashMap<K, V, Hash>::table::Insert(const uint64_t h,
+                                                                                                  value_type&& val) {
+  size_t mask = groups - 1;
+  size_t g = (h >> 7) & mask;
+  for (size_t step = 1;; ++step) {
+    uint32_t m = ctrl[g].MatchFree();
+    if (m) {
+      size_t pos = g * hash_map_detail::group_size + hash_map_detail::LowestBit(m);
+      if (ctrl[g].ctrl[pos % hash_map_detail::group_size] == hash_map_detail::ctrl_deleted) {
+        --deleted;
+      }
+      value_type* slot = new (slots + pos) value_type(std::move(val));
+      SetCtrl(pos, static_cast<int8_t>(h & 0x7f));
+      ++size;
+      return slot;
+    }
+    g = (g + step) & mask;
+  }
+}
+
+template<typename K, typename V, typename Hash>
+void ThreadsafeHashMap<K, V, Hash>::table::Erase(const size_t pos) {
+  slots[pos].~value_type();
+  --size;
+  // Если в группе есть пустая ячейка, через нее не проходил ни один поиск: метка не нужна
+  if (ctrl[pos / hash_map_detail::group_size].MatchEmpty()) {
+    SetCtrl(pos, hash_map_detail::ctrl_empty);
+  }
+  else {
+    SetCtrl(pos, hash_map_detail::ctrl_deleted);
+    ++deleted;
+  }
+}
+
+template<typename K, typename V, typename Hash>
+void ThreadsafeHashMap<K, V, Hash>::table::Clear() {
+  for (size_t g = 0; g < groups; ++g) {
+    for (uint32_t m = ~ctrl[g].MatchFree() & 0xffff; m; m &= m - 1) {
+      slots[g * hash_map_detail::group_size + hash_map_detail::LowestBit(m)].~value_type();
+    }
+  }
+  if (groups) {
+    std::memset(static_cast<void*>(ctrl.get()), static_cast<unsigned char>(hash_map_detail::ctrl_empty),
+              groups * sizeof(group));
+  }
+  size = 0;
+  deleted = 0;
+}
+
+template<typename K, typename V, typename Hash>
+ThreadsafeHashMap<K, V, Hash>::ThreadsafeHashMap(const size_t stripe_count, const Hash& hash)
+  : stripes([stripe_count]() {
+      size_t n = 1;
+      while (n < stripe_count) {
+        n <<= 1;
+      }
+      return n;
+    }()),
+    hash(hash) {}
+
+template<typename K, typename V, typename Hash>
+typename ThreadsafeHashMap<K, V, Hash>::value_type* ThreadsafeHashMap<K, V, Hash>::Find(stripe& s, const K& key,
+                                                                                         const uint64_t h) {
+  ptrdiff_t pos = s.current.Find(key, h);
+  if (pos >= 0) {
+    return s.current.slots + pos;
+  }
+  pos = s.old.Find(key, h);
+  return pos >= 0 ? s.old.slots + pos : nullptr;
+}
+
+template<typename K, typename V, typename Hash>
+void ThreadsafeHashMap<K, V, Hash>::Migrate(stripe& s) {
+  if (s.old.groups == 0) {
+    return;
+  }
+  size_t last = std::min(s.old.groups, s.migrated + migrate_step);
+  for (; s.migrated < last; ++s.migrated) {
+    for (uint32_t m = ~s.old.ctrl[s.migrated].MatchFree() & 0xffff; m; m &= m - 1) {
+      size_t pos = s.migrated * hash_map_detail::group_size + hash_map_detail::LowestBit(m);
+      value_type& val = s.old.slots[pos];
+      s.current.Insert(HashOf(val.first), std::move(val));
+      val.~value_type();
+      // Через перенесенные группы еще проходят поиски ключей из следующих групп: нужна метка удаления
+      s.old.SetCtrl(pos, hash_map_detail::ctrl_deleted);
+      --s.old.size;
+    }
+  }
+  if (s.migrated == s.old.groups) {
+    s.old = table();
+    s.migrated = 0;
+  }
+}
+
+template<typename K, typename V, typename Hash>
+void ThreadsafeHashMap<K, V, Hash>::Grow(stripe& s) {
+  if (s.current.groups == 0) {
+    s.current = table(1);
+    return;
+  }
+  // Перенос успевает закончиться задолго до следующего заполнения; цикл - на всякий случай
+  while (s.old.groups) {
+    Migrate(s);
+  }
+  // Новая таблица заполнена не больше чем на 7/16: при многих удаленных размер не растет
+  size_t groups = s.current.groups;
+  while ((s.current.size + 1) * 16 > groups * hash_map_detail::group_size * 7) {
+    groups *= 2;
+  }
+  s.old = std::move(s.current);
+  s.current = table(groups);
+  s.migrated = 0;
+  Migrate(s);
+}
+
+template<typename K, typename V, typename Hash>
+bool ThreadsafeHashMap<K, V, Hash>::insert(const K& key, const V& val) {
+  trace::Record(trace::Kind::hash_map, this, trace::Op::add, trace::Key(key));
+  uint64_t h = HashOf(key);
+  stripe& s = StripeOf(h);
+  auto time0 = lock_trace::Begin();
+  std::lock_guard<std::shared_mutex> lock(s.mutex);
+  auto time1 = Stamp(time0);
+  Migrate(s);
+  bool res = !Find(s, key, h);
+  if (res) {
+    if (s.current.full()) {
+      Grow(s);
+    }
+    s.current.Insert(h, value_type(key, val));
+    Publish(s);
+  }
+  auto time2 = Stamp(time0);
+  lock_trace::Record(this, "ThreadsafeHashMap", "insert", true, time0, time1, time2);
+  stats.Record(time0, time1, time2);
+  return res;
+}
+
+template<typename K, typename V, typename Hash>
+bool ThreadsafeHashMap<K, V, Hash>::insert_or_assign(const K& key, const V& val) {
+  trace::Record(trace::Kind::hash_map, this, trace::Op::update, trace::Key(key));
+  uint64_t h = HashOf(key);
+  stripe& s = StripeOf(h);
+  auto time0 = lock_trace::Begin();
+  std::lock_guard<std::shared_mutex> lock(s.mutex);
+  auto time1 = Stamp(time0);
+  Migrate(s);
+  value_type* slot = Find(s, key, h);
+  if (slot) {
+    slot->second = val;
+  }
+  else {
+    if (s.current.full()) {
+      Grow(s);
+    }
+    s.current.Insert(h, value_type(key, val));
+    Publish(s);
+  }
+  auto time2 = Stamp(time0);
+  lock_trace::Record(this, "ThreadsafeHashMap", "insert_or_assign", true, time0, time1, time2);
+  stats.Record(time0, time1, time2);
+  return !slot;
+}
+
+template<typename K, typename V, typename Hash>
+bool ThreadsafeHashMap<K, V, Hash>::find(const K& key, V& val) {
+  trace::Record(trace::Kind::hash_map, this, trace::Op::read, trace::Key(key));
+  uint64_t h = HashOf(key);
+  stripe& s = StripeOf(h);
+  auto time0 = lock_trace::Begin();
+  std::shared_lock<std::shared_mutex> lock(s.mutex);
+  auto time1 = Stamp(time0);
+  value_type* slot = Find(s, key, h);
+  if (slot) {
+    val = slot->second;
+  }
+  auto time2 = Stamp(time0);
+  lock_trace::Record(this, "ThreadsafeHashMap", "find", false, time0, time1, time2);
+  stats.Record(time0, time1, time2);
+  return slot;
+}
+
+template<typename K, typename V, typename Hash>
+bool ThreadsafeHashMap<K, V, Hash>::contains(const K& key) {
+  trace::Record(trace::Kind::hash_map, this, trace::Op::read, trace::Key(key));
+  uint64_t h = HashOf(key);
+  stripe& s = StripeOf(h);
+  auto time0 = lock_trace::Begin();
+  std::shared_lock<std::shared_mutex> lock(s.mutex);
+  auto time1 = Stamp(time0);
+  bool res = Find(s, key, h);
+  auto time2 = Stamp(time0);
+  lock_trace::Record(this, "ThreadsafeHashMap", "contains", false, time0, time1, time2);
+  stats.Record(time0, time1, time2);
+  return res;
+}
+
+template<typename K, typename V, typename Hash>
+bool ThreadsafeHashMap<K, V, Hash>::erase(const K& key) {
+  trace::Record(trace::Kind::hash_map, this, trace::Op::remove, trace::Key(key));
+  uint64_t h = HashOf(key);
+  stripe& s = StripeOf(h);
+  auto time0 = lock_trace::Begin();
+  std::lock_guard<std::shared_mutex> lock(s.mutex);
+  auto time1 = Stamp(time0);
+  Migrate(s);
+  bool res = true;
+  ptrdiff_t pos = s.current.Find(key, h);
+  if (pos >= 0) {
+    s.current.Erase(pos);
+  }
+  else if ((pos = s.old.Find(key, h)) >= 0) {
+    s.old.Erase(pos);
+  }
+  else {
+    res = false;
+  }
+  Publish(s);
+  auto time2 = Stamp(time0);
+  lock_trace::Record(this, "ThreadsafeHashMap", "erase", true, time0, time1, time2);
+  stats.Record(time0, time1, time2);
+  return res;
+}
+
+template<typename K, typename V, typename Hash>
+void ThreadsafeHashMap<K, V, Hash>::clear() {
+  for (size_t i = 0; i < stripes.size(); ++i) {
+    stripe& s = stripes[i];
+    auto time0 = lock_trace::Begin();
+    std::lock_guard<std::shared_mutex> lock(s.mutex);
+    auto time1 = Stamp(time0);
+    s.current.Clear();
+    s.old = table();
+    s.migrated = 0;
+    Publish(s);
+    auto time2 = Stamp(time0);
+    lock_trace::Record(this, "ThreadsafeHashMap", "clear", true, time0, time1, time2);
+    stats.Record(time0, time1, time2, 0);
+  }
+}
+
+template<typename K, typename V, typename Hash>
+ptrdiff_t ThreadsafeHashMap<K, V, Hash>::size() {
+  ptrdiff_t res = 0;
+  for (size_t i = 0; i < stripes.size(); ++i) {
+    res += stripes[i].size.load(std::memory_order_relaxed);
+  }
+  stats.Gauge(res);
+  return res;
+}
+
+// Множество ключей поверх той же таблицы
+template<typename K, typename Hash = std::hash<K>>
+class ThreadsafeHashSet {
+public:
+  explicit ThreadsafeHashSet(const size_t stripes = 64, const Hash& hash = Hash()) : map(stripes, hash) {}
+
+  bool insert(const K& key) { return map.insert(key, none()); }
+  bool contains(const K& key) { return map.contains(key); }
+  bool erase(const K& key) { return map.erase(key); }
+  void clear() { map.clear(); }
+  bool empty() { return map.empty(); }
+  ptrdiff_t size() { return map.size(); }
+  size_t stripe_count() const { return map.stripe_count(); }
+  metrics::LockStats& stats() { return map.stats; }
+
+private:
+  struct none {};
+  ThreadsafeHashMap<K, none, Hash> map;
+};
+
+#endif
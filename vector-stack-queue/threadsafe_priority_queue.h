@@ -0,0 +1,215 @@
+#ifndef THREADSAFE_PRIORITY_QUEUE_H
+#define THREADSAFE_PRIORITY_QUEUE_H
+
+#include <shared_mutex>
+#include <functional>
+#include <map>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "dary_heap.h"
+#include "common/cache_line.h"
+#include "instrumentation/lock_trace.h"
+#include "instrumentation/metrics.h"
+#include "trace-replay/trace.h"
+
+// Очередь с приоритетом под одной блокировкой (строгий порядок извлечения).
+// Для масштабируемого варианта с ослабленным порядком см. relaxed_priority_queue.h
+template<typename T, typename Compare = std::less<T>>
+class ThreadsafePriorityQueue {
+public:
+  ThreadsafePriorityQueue() = default;
+  ThreadsafePriorityQueue(const ThreadsafePriorityQueue& obj);
+  ~ThreadsafePriorityQueue() = default;
+  ThreadsafePriorityQueue operator=(const ThreadsafePriorityQueue& obj);
+  T top();
+  bool empty();
+  ptrdiff_t size();
+  void push(const T& val);
+  void pop();
+  // Проверка и извлечение под одной блокировкой; false, если очередь пуста
+  bool try_pop(T& val);
+  // Набор элементов под одной блокировкой
+  void push_bulk(const std::vector<T>& vals);
+  // До n верхних элементов в порядке приоритета; возвращает их число
+  size_t pop_bulk(const size_t n, std::vector<T>& out);
+  void swap(ThreadsafePriorityQueue& obj);
+
+  alignas(cache_line_size) std::map<std::thread::id, std::chrono::nanoseconds> wait;
+  std::map<std::thread::id, std::chrono::nanoseconds> work;
+  metrics::LockStats stats{"ThreadsafePriorityQueue"};
+
+private:
+  alignas(cache_line_size) DaryHeap<T, Compare> data;
+  alignas(cache_line_size) mutable std::shared_mutex mutex;
+};
+
+template<typename T, typename Compare>
+ThreadsafePriorityQueue<T, Compare>::ThreadsafePriorityQueue(const ThreadsafePriorityQueue<T, Compare>& obj) {
+  std::shared_lock<std::shared_mutex> lock(obj.mutex);
+  data = obj.data;
+}
+
+template<typename T, typename Compare>
+ThreadsafePriorityQueue<T, Compare> ThreadsafePriorityQueue<T, Compare>::operator=(const ThreadsafePriorityQueue<T, Compare>& obj) {
+  auto time1 = std::chrono::steady_clock::now();
+  std::lock_guard<std::shared_mutex> lock(mutex);
+  auto time2 = std::chrono::steady_clock::now();
+  auto th_id = std::this_thread::get_id();
+  wait[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time2 - time1);
+  data = obj.data;
+  auto time3 = std::chrono::steady_clock::now();
+  work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafePriorityQueue", "operator=", true, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
+  return *this;
+}
+
+template<typename T, typename Compare>
+T ThreadsafePriorityQueue<T, Compare>::top() {
+  trace::Record(trace::Kind::priority_queue, this, trace::Op::read, 0);
+  auto time1 = std::chrono::steady_clock::now();
+  std::shared_lock<std::shared_mutex> lock(mutex);
+  auto time2 = std::chrono::steady_clock::now();
+  auto th_id = std::this_thread::get_id();
+  wait[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time2 - time1);
+  T res = data.top();
+  auto time3 = std::chrono::steady_clock::now();
+  work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafePriorityQueue", "top", false, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
+  return res;
+}
+
+template<typename T, typename Compare>
+bool ThreadsafePriorityQueue<T, Compare>::empty() {
+  auto time1 = std::chrono::steady_clock::now();
+  std::shared_lock<std::shared_mutex> lock(mutex);
+  auto time2 = std::chrono::steady_clock::now();
+  auto th_id = std::this_thread::get_id();
+  wait[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time2 - time1);
+  bool res = data.empty();
+  auto time3 = std::chrono::steady_clock::now();
+  work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafePriorityQueue", "empty", false, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
+  return res;
+}
+
+template<typename T, typename Compare>
+ptrdiff_t ThreadsafePriorityQueue<T, Compare>::size() {
+  auto time1 = std::chrono::steady_clock::now();
+  std::shared_lock<std::shared_mutex> lock(mutex);
+  auto time2 = std::chrono::steady_clock::now();
+  auto th_id = std::this_thread::get_id();
+  wait[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time2 - time1);
+  ptrdiff_t res = data.size();
+  auto time3 = std::chrono::steady_clock::now();
+  work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafePriorityQueue", "size", false, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
+  return res;
+}
+
+template<typename T, typename Compare>
+void ThreadsafePriorityQueue<T, Compare>::push(const T& val) {
+  trace::Record(trace::Kind::priority_queue, this, trace::Op::add, trace::Key(val));
+  auto time1 = std::chrono::steady_clock::now();
+  std::lock_guard<std::shared_mutex> lock(mutex);
+  auto time2 = std::chrono::steady_clock::now();
+  auto th_id = std::this_thread::get_id();
+  wait[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time2 - time1);
+  data.push(val);
+  auto time3 = std::chrono::steady_clock::now();
+  work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafePriorityQueue", "push", true, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
+}
+
+template<typename T, typename Compare>
+void ThreadsafePriorityQueue<T, Compare>::pop() {
+  trace::Record(trace::Kind::priority_queue, this, trace::Op::remove, 0);
+  auto time1 = std::chrono::steady_clock::now();
+  std::lock_guard<std::shared_mutex> lock(mutex);
+  auto time2 = std::chrono::steady_clock::now();
+  auto th_id = std::this_thread::get_id();
+  wait[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time2 - time1);
+  data.pop();
+  auto time3 = std::chrono::steady_clock::now();
+  work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafePriorityQueue", "pop", true, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
+}
+
+template<typename T, typename Compare>
+bool ThreadsafePriorityQueue<T, Compare>::try_pop(T& val) {
+  trace::Record(trace::Kind::priority_queue, this, trace::Op::remove, 0);
+  auto time1 = std::chrono::steady_clock::now();
+  std::lock_guard<std::shared_mutex> lock(mutex);
+  auto time2 = std::chrono::steady_clock::now();
+  auto th_id = std::this_thread::get_id();
+  wait[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time2 - time1);
+  bool res = !data.empty();
+  if (res) {
+    data.pop(val);
+  }
+  auto time3 = std::chrono::steady_clock::now();
+  work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafePriorityQueue", "try_pop", true, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
+  return res;
+}
+
+template<typename T, typename Compare>
+void ThreadsafePriorityQueue<T, Compare>::push_bulk(const std::vector<T>& vals) {
+  if (trace::Enabled()) {
+    for (const T& val : vals) {
+      trace::Record(trace::Kind::priority_queue, this, trace::Op::add, trace::Key(val));
+    }
+  }
+  auto time1 = std::chrono::steady_clock::now();
+  std::lock_guard<std::shared_mutex> lock(mutex);
+  auto time2 = std::chrono::steady_clock::now();
+  auto th_id = std::this_thread::get_id();
+  wait[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time2 - time1);
+  data.push_bulk(vals.begin(), vals.end());
+  auto time3 = std::chrono::steady_clock::now();
+  work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafePriorityQueue", "push_bulk", true, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
+}
+
+template<typename T, typename Compare>
+size_t ThreadsafePriorityQueue<T, Compare>::pop_bulk(const size_t n, std::vector<T>& out) {
+  auto time1 = std::chrono::steady_clock::now();
+  std::lock_guard<std::shared_mutex> lock(mutex);
+  auto time2 = std::chrono::steady_clock::now();
+  auto th_id = std::this_thread::get_id();
+  wait[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time2 - time1);
+  size_t res = data.pop_bulk(n, out);
+  auto time3 = std::chrono::steady_clock::now();
+  work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafePriorityQueue", "pop_bulk", true, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
+  return res;
+}
+
+template<typename T, typename Compare>
+void ThreadsafePriorityQueue<T, Compare>::swap(ThreadsafePriorityQueue<T, Compare>& obj) {
+  if (this == &obj) {
+    return;
+  }
+  auto time1 = std::chrono::steady_clock::now();
+  std::scoped_lock lock(mutex, obj.mutex);
+  auto time2 = std::chrono::steady_clock::now();
+  auto th_id = std::this_thread::get_id();
+  wait[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time2 - time1);
+  data.swap(obj.data);
+  auto time3 = std::chrono::steady_clock::now();
+  work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafePriorityQueue", "swap", true, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
+}
+
+#endif
@@ -4,6 +4,15 @@
 
 #include <shared_mutex>
 #include <queue>
+#include <map>
+#include <chrono>
+#include <thread>
+#include <utility>
+
+#include "common/cache_line.h"
+#include "instrumentation/lock_trace.h"
+#include "instrumentation/metrics.h"
+#include "trace-replay/trace.h"
 
 
 template<typename T>
@@ -23,14 +32,19 @@ public:
   ptrdiff_t size();
   void push(const T& val);
   void pop();
+  // Извлечение первого элемента под одной блокировкой; false, если очередь пуста
+  bool try_pop(T& val);
   void swap(const ThreadsafeQueue& obj);
 
-  std::map<std::thread::id, std::chrono::nanoseconds> wait;
+  // Статистика, блокировка и данные разнесены по разным строкам кэша:
+  // захват блокировки не вытесняет строку, которую читают size() и empty()
+  alignas(cache_line_size) std::map<std::thread::id, std::chrono::nanoseconds> wait;
   std::map<std::thread::id, std::chrono::nanoseconds> work;
+  metrics::LockStats stats{"ThreadsafeQueue"};
 
 private:
-  std::queue<T> data;
-  mutable std::shared_mutex mutex;
+  alignas(cache_line_size) std::queue<T> data;
+  alignas(cache_line_size) mutable std::shared_mutex mutex;
 };
 
 template<typename T>
@@ -49,6 +63,8 @@ ThreadsafeQueue<T> ThreadsafeQueue<T>::operator=(const ThreadsafeQueue<T>& obj)
   data = obj.data;
   auto time3 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeQueue", "operator=", true, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
   return *this;
 }
 
@@ -62,6 +78,8 @@ bool ThreadsafeQueue<T>::operator==(const ThreadsafeQueue<T>& obj) {
   bool res = (data == obj.data);
   auto time3 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeQueue", "operator==", false, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
   return res;
 }
 
@@ -75,11 +93,14 @@ bool ThreadsafeQueue<T>::operator!=(const ThreadsafeQueue& obj) {
   bool res = (data != obj.data);
   auto time3 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeQueue", "operator!=", false, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
   return res;
 }
 
 template<typename T>
 T ThreadsafeQueue<T>::front() {
+  trace::Record(trace::Kind::queue, this, trace::Op::read, 0);
   auto time1 = std::chrono::steady_clock::now();
   std::shared_lock<std::shared_mutex> lock(mutex);
   auto time2 = std::chrono::steady_clock::now();
@@ -88,11 +109,14 @@ T ThreadsafeQueue<T>::front() {
   T res = data.front();
   auto time3 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeQueue", "front", false, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
   return res;
 }
 
 template<typename T>
 void ThreadsafeQueue<T>::front(const T& val) {
+  trace::Record(trace::Kind::queue, this, trace::Op::update, trace::Key(val));
   auto time1 = std::chrono::steady_clock::now();
   std::lock_guard<std::shared_mutex> lock(mutex);
   auto time2 = std::chrono::steady_clock::now();
@@ -101,23 +125,29 @@ void ThreadsafeQueue<T>::front(const T& val) {
   data.front() = val;
   auto time3 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeQueue", "front", true, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
 }
 
 template<typename T>
 T ThreadsafeQueue<T>::back() {
+  trace::Record(trace::Kind::queue, this, trace::Op::read, 0);
   auto time1 = std::chrono::steady_clock::now();
-  std::shared_lock<std::mutex> lock(mutex);
+  std::shared_lock<std::shared_mutex> lock(mutex);
   auto time2 = std::chrono::steady_clock::now();
   auto th_id = std::this_thread::get_id();
   wait[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time2 - time1);
   T res = data.back();
   auto time3 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeQueue", "back", false, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
   return res;
 }
 
 template<typename T>
 inline void ThreadsafeQueue<T>::back(const T& val) {
+  trace::Record(trace::Kind::queue, this, trace::Op::update, trace::Key(val));
   auto time1 = std::chrono::steady_clock::now();
   std::lock_guard<std::shared_mutex> lock(mutex);
   auto time2 = std::chrono::steady_clock::now();
@@ -126,6 +156,8 @@ inline void ThreadsafeQueue<T>::back(const T& val) {
   data.back() = val;
   auto time3 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeQueue", "back", true, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
 }
 
 template<typename T>
@@ -138,6 +170,9 @@ bool ThreadsafeQueue<T>::empty() {
   bool res = data.empty();
   auto time3 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeQueue", "empty", false, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
+  return res;
 }
 
 template<typename T>
@@ -150,11 +185,14 @@ ptrdiff_t ThreadsafeQueue<T>::size() {
   ptrdiff_t res = data.size();
   auto time3 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeQueue", "size", false, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
   return res;
 }
 
 template<typename T>
 void ThreadsafeQueue<T>::push(const T& val) {
+  trace::Record(trace::Kind::queue, this, trace::Op::add, trace::Key(val));
   auto time1 = std::chrono::steady_clock::now();
   std::lock_guard<std::shared_mutex> lock(mutex);
   auto time2 = std::chrono::steady_clock::now();
@@ -163,10 +201,13 @@ void ThreadsafeQueue<T>::push(const T& val) {
   data.push(val);
   auto time3 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeQueue", "push", true, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
 }
 
 template<typename T>
 void ThreadsafeQueue<T>::pop() {
+  trace::Record(trace::Kind::queue, this, trace::Op::remove, 0);
   auto time1 = std::chrono::steady_clock::now();
   std::lock_guard<std::shared_mutex> lock(mutex);
   auto time2 = std::chrono::steady_clock::now();
@@ -175,6 +216,28 @@ void ThreadsafeQueue<T>::pop() {
   data.pop();
   auto time3 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeQueue", "pop", true, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
+}
+
+template<typename T>
+bool ThreadsafeQueue<T>::try_pop(T& val) {
+  trace::Record(trace::Kind::queue, this, trace::Op::remove, 0);
+  auto time1 = std::chrono::steady_clock::now();
+  std::lock_guard<std::shared_mutex> lock(mutex);
+  auto time2 = std::chrono::steady_clock::now();
+  auto th_id = std::this_thread::get_id();
+  wait[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time2 - time1);
+  bool res = !data.empty();
+  if (res) {
+    val = std::move(data.front());
+    data.pop();
+  }
+  auto time3 = std::chrono::steady_clock::now();
+  work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeQueue", "try_pop", true, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
+  return res;
 }
 
 template<typename T>
@@ -187,6 +250,8 @@ inline void ThreadsafeQueue<T>::swap(const ThreadsafeQueue& obj) {
   data.swap(obj.data);
   auto time3 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeQueue", "swap", true, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
 }
 
 #endif
\ No newline at end of file
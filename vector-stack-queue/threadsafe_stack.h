@@ -5,6 +5,13 @@
 #include <stack>
 #include <map>
 #include <chrono>
+#include <thread>
+#include <utility>
+
+#include "common/cache_line.h"
+#include "instrumentation/lock_trace.h"
+#include "instrumentation/metrics.h"
+#include "trace-replay/trace.h"
 
 template<typename T>
 class ThreadsafeStack {
@@ -20,15 +27,21 @@ public:
   bool empty();
   ptrdiff_t size();
   void push(const T& val);
+  void push(T&& val);
   void pop();
+  // Извлечение вершины под одной блокировкой; false, если стек пуст
+  bool try_pop(T& val);
   void swap(const ThreadsafeStack& obj);
 
-  std::map<std::thread::id, std::chrono::nanoseconds> wait;
+  // Статистика, блокировка и данные разнесены по разным строкам кэша:
+  // захват блокировки не вытесняет строку, которую читают size() и empty()
+  alignas(cache_line_size) std::map<std::thread::id, std::chrono::nanoseconds> wait;
   std::map<std::thread::id, std::chrono::nanoseconds> work;
+  metrics::LockStats stats{"ThreadsafeStack"};
 
 private:
-  std::stack<T> data;
-  mutable std::shared_mutex mutex;
+  alignas(cache_line_size) std::stack<T> data;
+  alignas(cache_line_size) mutable std::shared_mutex mutex;
 };
 
 template<typename T>
@@ -47,6 +60,8 @@ ThreadsafeStack<T> ThreadsafeStack<T>::operator=(const ThreadsafeStack<T>& obj)
   data = obj.data;
   auto time3 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeStack", "operator=", true, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
   return *this;
 }
 
@@ -60,6 +75,8 @@ bool ThreadsafeStack<T>::operator==(const ThreadsafeStack<T>& obj) {
   bool res = (data == obj.data);
   auto time3 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeStack", "operator==", false, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
   return res;
 }
 
@@ -73,11 +90,14 @@ bool ThreadsafeStack<T>::operator!=(const ThreadsafeStack& obj) {
   bool res = (data != obj.data);
   auto time3 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeStack", "operator!=", false, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
   return res;
 }
 
 template<typename T>
 T ThreadsafeStack<T>::top() {
+  trace::Record(trace::Kind::stack, this, trace::Op::read, 0);
   auto time1 = std::chrono::steady_clock::now();
   std::shared_lock<std::shared_mutex> lock(mutex);
   auto time2 = std::chrono::steady_clock::now();
@@ -86,11 +106,14 @@ T ThreadsafeStack<T>::top() {
   T res = data.top();
   auto time3 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeStack", "top", false, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
   return res;
 }
 
 template<typename T>
 void ThreadsafeStack<T>::top(const T& val) {
+  trace::Record(trace::Kind::stack, this, trace::Op::update, trace::Key(val));
   auto time1 = std::chrono::steady_clock::now();
   std::lock_guard<std::shared_mutex> lock(mutex);
   auto time2 = std::chrono::steady_clock::now();
@@ -99,6 +122,8 @@ void ThreadsafeStack<T>::top(const T& val) {
   data.top() = val;
   auto time3 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeStack", "top", true, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
 }
 
 template<typename T>
@@ -111,6 +136,8 @@ bool ThreadsafeStack<T>::empty() {
   bool res = data.empty();
   auto time3 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeStack", "empty", false, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
   return res;
 }
 
@@ -124,11 +151,14 @@ ptrdiff_t ThreadsafeStack<T>::size() {
   ptrdiff_t res = data.size();
   auto time3 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeStack", "size", false, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
   return res;
 }
 
 template<typename T>
 void ThreadsafeStack<T>::push(const T& val) {
+  trace::Record(trace::Kind::stack, this, trace::Op::add, trace::Key(val));
   auto time1 = std::chrono::steady_clock::now();
   std::lock_guard<std::shared_mutex> lock(mutex);
   auto time2 = std::chrono::steady_clock::now();
@@ -137,10 +167,28 @@ void ThreadsafeStack<T>::push(const T& val) {
   data.push(val);
   auto time3 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeStack", "push", true, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
+}
+
+template<typename T>
+void ThreadsafeStack<T>::push(T&& val) {
+  trace::Record(trace::Kind::stack, this, trace::Op::add, trace::Key(val));
+  auto time1 = std::chrono::steady_clock::now();
+  std::lock_guard<std::shared_mutex> lock(mutex);
+  auto time2 = std::chrono::steady_clock::now();
+  auto th_id = std::this_thread::get_id();
+  wait[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time2 - time1);
+  data.push(std::move(val));
+  auto time3 = std::chrono::steady_clock::now();
+  work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeStack", "push", true, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
 }
 
 template<typename T>
 void ThreadsafeStack<T>::pop() {
+  trace::Record(trace::Kind::stack, this, trace::Op::remove, 0);
   auto time1 = std::chrono::steady_clock::now();
   std::lock_guard<std::shared_mutex> lock(mutex);
   auto time2 = std::chrono::steady_clock::now();
@@ -151,6 +199,28 @@ void ThreadsafeStack<T>::pop() {
   }
   auto time3 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeStack", "pop", true, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
+}
+
+template<typename T>
+bool ThreadsafeStack<T>::try_pop(T& val) {
+  trace::Record(trace::Kind::stack, this, trace::Op::remove, 0);
+  auto time1 = std::chrono::steady_clock::now();
+  std::lock_guard<std::shared_mutex> lock(mutex);
+  auto time2 = std::chrono::steady_clock::now();
+  auto th_id = std::this_thread::get_id();
+  wait[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time2 - time1);
+  bool res = !data.empty();
+  if (res) {
+    val = std::move(data.top());
+    data.pop();
+  }
+  auto time3 = std::chrono::steady_clock::now();
+  work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeStack", "try_pop", true, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
+  return res;
 }
 
 template<typename T>
@@ -163,6 +233,8 @@ void ThreadsafeStack<T>::swap(const ThreadsafeStack& obj) {
   data.swap(obj.data);
   auto time3 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeStack", "swap", true, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
 }
 
 #endif
\ No newline at end of file
@@ -4,13 +4,23 @@
 
 #include <shared_mutex>
 #include <vector>
+#include <map>
+#include <chrono>
+#include <thread>
 
+#include "common/cache_line.h"
+#include "instrumentation/lock_trace.h"
+#include "instrumentation/metrics.h"
+#include "trace-replay/trace.h"
 
-template<typename T>
+
+// Storage - хранилище с интерфейсом std::vector; MappedStorage<T> держит данные в файле
+template<typename T, typename Storage = std::vector<T>>
 class ThreadsafeVector {
 public:
   ThreadsafeVector() = default;
   ThreadsafeVector(ptrdiff_t size);
+  explicit ThreadsafeVector(Storage&& storage);
   ThreadsafeVector(const ThreadsafeVector& obj);
   ~ThreadsafeVector() = default;
   ThreadsafeVector operator=(const ThreadsafeVector& obj);
@@ -34,29 +44,37 @@ public:
   void pop_back();
   void resize(ptrdiff_t size);
   void swap(const ThreadsafeVector& obj);
+  // Сброс данных на диск; только для хранилищ с flush(), например MappedStorage
+  void flush();
 
-  std::map<std::thread::id, std::chrono::nanoseconds> wait;
+  // Статистика, блокировка и данные разнесены по разным строкам кэша:
+  // захват блокировки не вытесняет строку, которую читают size() и empty()
+  alignas(cache_line_size) std::map<std::thread::id, std::chrono::nanoseconds> wait;
   std::map<std::thread::id, std::chrono::nanoseconds> work;
+  metrics::LockStats stats{"ThreadsafeVector"};
 
 private:
-  std::vector<T> data;
-  mutable std::shared_mutex mutex;
+  alignas(cache_line_size) Storage data;
+  alignas(cache_line_size) mutable std::shared_mutex mutex;
 };
 
-template<typename T>
-ThreadsafeVector<T>::ThreadsafeVector(ptrdiff_t size) {
+template<typename T, typename Storage>
+ThreadsafeVector<T, Storage>::ThreadsafeVector(ptrdiff_t size) {
   std::lock_guard<std::shared_mutex> lock(mutex);
   data.resize(size);
 }
 
-template<typename T>
-ThreadsafeVector<T>::ThreadsafeVector(const ThreadsafeVector<T>& obj) {
+template<typename T, typename Storage>
+ThreadsafeVector<T, Storage>::ThreadsafeVector(Storage&& storage) : data(std::move(storage)) {}
+
+template<typename T, typename Storage>
+ThreadsafeVector<T, Storage>::ThreadsafeVector(const ThreadsafeVector<T, Storage>& obj) {
   std::lock_guard<std::shared_mutex> lock(mutex);
   data = obj.data;
 }
 
-template<typename T>
-ThreadsafeVector<T> ThreadsafeVector<T>::operator=(const ThreadsafeVector<T>& obj) {
+template<typename T, typename Storage>
+ThreadsafeVector<T, Storage> ThreadsafeVector<T, Storage>::operator=(const ThreadsafeVector<T, Storage>& obj) {
   auto time1 = std::chrono::steady_clock::now();
   std::lock_guard<std::shared_mutex> lock(mutex);
   auto time2 = std::chrono::steady_clock::now();
@@ -65,11 +83,13 @@ ThreadsafeVector<T> ThreadsafeVector<T>::operator=(const ThreadsafeVector<T>& ob
   data = obj.data;
   auto time3 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeVector", "operator=", true, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
   return *this;
 }
 
-template<typename T>
-bool ThreadsafeVector<T>::operator==(const ThreadsafeVector<T>& obj) {
+template<typename T, typename Storage>
+bool ThreadsafeVector<T, Storage>::operator==(const ThreadsafeVector<T, Storage>& obj) {
   auto time1 = std::chrono::steady_clock::now();
   std::shared_lock<std::shared_mutex> lock(mutex);
   auto time2 = std::chrono::steady_clock::now();
@@ -78,11 +98,13 @@ bool ThreadsafeVector<T>::operator==(const ThreadsafeVector<T>& obj) {
   bool res = (data == obj.data);
   auto time3 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeVector", "operator==", false, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
   return res;
 }
 
-template<typename T>
-bool ThreadsafeVector<T>::operator!=(const ThreadsafeVector<T>& obj) {
+template<typename T, typename Storage>
+bool ThreadsafeVector<T, Storage>::operator!=(const ThreadsafeVector<T, Storage>& obj) {
   auto time1 = std::chrono::steady_clock::now();
   std::shared_lock<std::shared_mutex> lock(mutex);
   auto time2 = std::chrono::steady_clock::now();
@@ -91,11 +113,14 @@ bool ThreadsafeVector<T>::operator!=(const ThreadsafeVector<T>& obj) {
   bool res = (data != obj.data);
   auto time3 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeVector", "operator!=", false, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
   return res;
 }
 
-template<typename T>
-T ThreadsafeVector<T>::at(ptrdiff_t pos) {
+template<typename T, typename Storage>
+T ThreadsafeVector<T, Storage>::at(ptrdiff_t pos) {
+  trace::Record(trace::Kind::vector, this, trace::Op::read, static_cast<int>(pos));
   auto time1 = std::chrono::steady_clock::now();
   std::shared_lock<std::shared_mutex> lock(mutex);
   auto time2 = std::chrono::steady_clock::now();
@@ -104,11 +129,14 @@ T ThreadsafeVector<T>::at(ptrdiff_t pos) {
   T res = data.at(pos);
   auto time3 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeVector", "at", false, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
   return res;
 }
 
-template<typename T>
-void ThreadsafeVector<T>::at(ptrdiff_t pos, const T& val) {
+template<typename T, typename Storage>
+void ThreadsafeVector<T, Storage>::at(ptrdiff_t pos, const T& val) {
+  trace::Record(trace::Kind::vector, this, trace::Op::update, static_cast<int>(pos));
   auto time1 = std::chrono::steady_clock::now();
   std::lock_guard<std::shared_mutex> lock(mutex);
   auto time2 = std::chrono::steady_clock::now();
@@ -117,10 +145,13 @@ void ThreadsafeVector<T>::at(ptrdiff_t pos, const T& val) {
   data.at(pos) = val;
   auto time3 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeVector", "at", true, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
 }
 
-template<typename T>
-T ThreadsafeVector<T>::operator[](ptrdiff_t pos) {
+template<typename T, typename Storage>
+T ThreadsafeVector<T, Storage>::operator[](ptrdiff_t pos) {
+  trace::Record(trace::Kind::vector, this, trace::Op::read, static_cast<int>(pos));
   auto time1 = std::chrono::steady_clock::now();
   std::shared_lock<std::shared_mutex> lock(mutex);
   auto time2 = std::chrono::steady_clock::now();
@@ -129,11 +160,14 @@ T ThreadsafeVector<T>::operator[](ptrdiff_t pos) {
   T res = data[pos];
   auto time3 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeVector", "operator[]", false, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
   return res;
 }
 
-template<typename T>
-T ThreadsafeVector<T>::front() {
+template<typename T, typename Storage>
+T ThreadsafeVector<T, Storage>::front() {
+  trace::Record(trace::Kind::vector, this, trace::Op::read, 0);
   auto time1 = std::chrono::steady_clock::now();
   std::shared_lock<std::shared_mutex> lock(mutex);
   auto time2 = std::chrono::steady_clock::now();
@@ -142,11 +176,14 @@ T ThreadsafeVector<T>::front() {
   T res = data.front();
   auto time3 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeVector", "front", false, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
   return res;
 }
 
-template<typename T>
-void ThreadsafeVector<T>::front(const T& val) {
+template<typename T, typename Storage>
+void ThreadsafeVector<T, Storage>::front(const T& val) {
+  trace::Record(trace::Kind::vector, this, trace::Op::update, 0);
   auto time1 = std::chrono::steady_clock::now();
   std::lock_guard<std::shared_mutex> lock(mutex);
   auto time2 = std::chrono::steady_clock::now();
@@ -155,10 +192,13 @@ void ThreadsafeVector<T>::front(const T& val) {
   data.front() = val;
   auto time3 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeVector", "front", true, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
 }
 
-template<typename T>
-T ThreadsafeVector<T>::back() {
+template<typename T, typename Storage>
+T ThreadsafeVector<T, Storage>::back() {
+  trace::Record(trace::Kind::vector, this, trace::Op::read, 0);
   auto time1 = std::chrono::steady_clock::now();
   std::shared_lock<std::shared_mutex> lock(mutex);
   auto time2 = std::chrono::steady_clock::now();
@@ -167,11 +207,14 @@ T ThreadsafeVector<T>::back() {
   T res = data.back();
   auto time3 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeVector", "back", false, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
   return res;
 }
 
-template<typename T>
-void ThreadsafeVector<T>::back(const T& val) {
+template<typename T, typename Storage>
+void ThreadsafeVector<T, Storage>::back(const T& val) {
+  trace::Record(trace::Kind::vector, this, trace::Op::update, 0);
   auto time1 = std::chrono::steady_clock::now();
   std::lock_guard<std::shared_mutex> lock(mutex);
   auto time2 = std::chrono::steady_clock::now();
@@ -180,10 +223,12 @@ void ThreadsafeVector<T>::back(const T& val) {
   data.back() = val;
   auto time3 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeVector", "back", true, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
 }
 
-template<typename T>
-bool ThreadsafeVector<T>::empty() {
+template<typename T, typename Storage>
+bool ThreadsafeVector<T, Storage>::empty() {
   auto time1 = std::chrono::steady_clock::now();
   std::shared_lock<std::shared_mutex> lock(mutex);
   auto time2 = std::chrono::steady_clock::now();
@@ -192,11 +237,13 @@ bool ThreadsafeVector<T>::empty() {
   bool res = data.empty();
   auto time3 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeVector", "empty", false, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
   return res;
 }
 
-template<typename T>
-ptrdiff_t ThreadsafeVector<T>::size() {
+template<typename T, typename Storage>
+ptrdiff_t ThreadsafeVector<T, Storage>::size() {
   auto time1 = std::chrono::steady_clock::now();
   std::shared_lock<std::shared_mutex> lock(mutex);
   auto time2 = std::chrono::steady_clock::now();
@@ -205,11 +252,13 @@ ptrdiff_t ThreadsafeVector<T>::size() {
   ptrdiff_t res = data.size();
   auto time3 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeVector", "size", false, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
   return res;
 }
 
-template<typename T>
-ptrdiff_t ThreadsafeVector<T>::max_size() {
+template<typename T, typename Storage>
+ptrdiff_t ThreadsafeVector<T, Storage>::max_size() {
   auto time1 = std::chrono::steady_clock::now();
   std::shared_lock<std::shared_mutex> lock(mutex);
   auto time2 = std::chrono::steady_clock::now();
@@ -218,12 +267,14 @@ ptrdiff_t ThreadsafeVector<T>::max_size() {
   ptrdiff_t res = data.max_size();
   auto time3 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeVector", "max_size", false, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
   return res;
 
 }
 
-template<typename T>
-void ThreadsafeVector<T>::reserve(ptrdiff_t size) {
+template<typename T, typename Storage>
+void ThreadsafeVector<T, Storage>::reserve(ptrdiff_t size) {
   auto time1 = std::chrono::steady_clock::now();
   std::lock_guard<std::shared_mutex> lock(mutex);
   auto time2 = std::chrono::steady_clock::now();
@@ -232,10 +283,12 @@ void ThreadsafeVector<T>::reserve(ptrdiff_t size) {
   data.reserve(size);
   auto time3 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeVector", "reserve", true, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
 }
 
-template<typename T>
-ptrdiff_t ThreadsafeVector<T>::capacity() {
+template<typename T, typename Storage>
+ptrdiff_t ThreadsafeVector<T, Storage>::capacity() {
   auto time1 = std::chrono::steady_clock::now();
   std::shared_lock<std::shared_mutex> lock(mutex);
   auto time2 = std::chrono::steady_clock::now();
@@ -244,23 +297,27 @@ ptrdiff_t ThreadsafeVector<T>::capacity() {
   ptrdiff_t res = data.capacity();
   auto time3 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeVector", "capacity", false, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
   return res;
 }
 
-template<typename T>
-void ThreadsafeVector<T>::shrink_to_fit() {
+template<typename T, typename Storage>
+void ThreadsafeVector<T, Storage>::shrink_to_fit() {
   auto time1 = std::chrono::steady_clock::now();
   std::lock_guard<std::shared_mutex> lock(mutex);
   auto time2 = std::chrono::steady_clock::now();
   auto th_id = std::this_thread::get_id();
   wait[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time2 - time1);
-  data.srink_to_fit();
+  data.shrink_to_fit();
   auto time3 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeVector", "shrink_to_fit", true, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
 }
 
-template<typename T>
-void ThreadsafeVector<T>::clear() {
+template<typename T, typename Storage>
+void ThreadsafeVector<T, Storage>::clear() {
   auto time1 = std::chrono::steady_clock::now();
   std::lock_guard<std::shared_mutex> lock(mutex);
   auto time2 = std::chrono::steady_clock::now();
@@ -269,10 +326,13 @@ void ThreadsafeVector<T>::clear() {
   data.clear();
   auto time3 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeVector", "clear", true, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
 }
 
-template<typename T>
-void ThreadsafeVector<T>::push_back(const T& val) {
+template<typename T, typename Storage>
+void ThreadsafeVector<T, Storage>::push_back(const T& val) {
+  trace::Record(trace::Kind::vector, this, trace::Op::add, trace::Key(val));
   auto time1 = std::chrono::steady_clock::now();
   std::lock_guard<std::shared_mutex> lock(mutex);
   auto time2 = std::chrono::steady_clock::now();
@@ -281,10 +341,13 @@ void ThreadsafeVector<T>::push_back(const T& val) {
   data.push_back(val);
   auto time3 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeVector", "push_back", true, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
 }
 
-template<typename T>
-void ThreadsafeVector<T>::pop_back() {
+template<typename T, typename Storage>
+void ThreadsafeVector<T, Storage>::pop_back() {
+  trace::Record(trace::Kind::vector, this, trace::Op::remove, 0);
   auto time1 = std::chrono::steady_clock::now();
   std::lock_guard<std::shared_mutex> lock(mutex);
   auto time2 = std::chrono::steady_clock::now();
@@ -293,10 +356,12 @@ void ThreadsafeVector<T>::pop_back() {
   data.pop_back();
   auto time3 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeVector", "pop_back", true, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
 }
 
-template<typename T>
-void ThreadsafeVector<T>::resize(ptrdiff_t size) {
+template<typename T, typename Storage>
+void ThreadsafeVector<T, Storage>::resize(ptrdiff_t size) {
   auto time1 = std::chrono::steady_clock::now();
   std::lock_guard<std::shared_mutex> lock(mutex);
   auto time2 = std::chrono::steady_clock::now();
@@ -305,10 +370,12 @@ void ThreadsafeVector<T>::resize(ptrdiff_t size) {
   data.resize(size);
   auto time3 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeVector", "resize", true, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
 }
 
-template<typename T>
-void ThreadsafeVector<T>::swap(const ThreadsafeVector& obj) {
+template<typename T, typename Storage>
+void ThreadsafeVector<T, Storage>::swap(const ThreadsafeVector& obj) {
   auto time1 = std::chrono::steady_clock::now();
   std::lock_guard<std::shared_mutex> lock(mutex);
   auto time2 = std::chrono::steady_clock::now();
@@ -317,6 +384,22 @@ void ThreadsafeVector<T>::swap(const ThreadsafeVector& obj) {
   data.swap(obj.data);
   auto time3 = std::chrono::steady_clock::now();
   work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeVector", "swap", true, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
+}
+
+template<typename T, typename Storage>
+void ThreadsafeVector<T, Storage>::flush() {
+  auto time1 = std::chrono::steady_clock::now();
+  std::shared_lock<std::shared_mutex> lock(mutex);
+  auto time2 = std::chrono::steady_clock::now();
+  auto th_id = std::this_thread::get_id();
+  wait[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time2 - time1);
+  data.flush();
+  auto time3 = std::chrono::steady_clock::now();
+  work[th_id] += std::chrono::duration_cast<std::chrono::nanoseconds>(time3 - time2);
+  lock_trace::Record(this, "ThreadsafeVector", "flush", false, time1, time2, time3);
+  stats.Record(time1, time2, time3, data.size());
 }
 
 #endif
\ No newline at end of file
@@ -0,0 +1,134 @@
+#ifndef CHASE_LEV_DEQUE_H
+#define CHASE_LEV_DEQUE_H
+
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+#include "common/cache_line.h"
+
+// Дек Чейза-Лева (Chase, Lev 2005; модель памяти C11 по Le et al. 2013,
+// барьеры заменены операциями seq_cst над top и bottom).
+// Владелец кладет и забирает элементы снизу без блокировок, остальные потоки
+// крадут сверху через CAS. Массив растет вдвое при заполнении; старые массивы
+// хранятся до уничтожения дека, потому что их еще могут читать воры.
+// Элементы копируются побайтно, поэтому T должен быть тривиально копируемым
+// (обычно это указатель на задачу).
+template<typename T>
+class ChaseLevDeque {
+  static_assert(std::is_trivially_copyable<T>::value, "ChaseLevDeque stores trivially copyable values");
+
+public:
+  explicit ChaseLevDeque(const int64_t capacity = 256);
+  ~ChaseLevDeque();
+  ChaseLevDeque(const ChaseLevDeque&) = delete;
+  ChaseLevDeque& operator=(const ChaseLevDeque&) = delete;
+
+  // Только владелец
+  void Push(const T val);
+  bool Pop(T& val);
+  // Любой поток; false, если дек пуст или элемент перехватили
+  bool Steal(T& val);
+  // Приблизительный размер
+  int64_t Size() const;
+
+private:
+  struct array {
+    int64_t size;
+    std::atomic<T>* items;
+    explicit array(int64_t n) : size(n), items(new std::atomic<T>[n]) {}
+    ~array() { delete[] items; }
+    T Get(const int64_t i) const { return items[i & (size - 1)].load(std::memory_order_relaxed); }
+    void Put(const int64_t i, const T val) { items[i & (size - 1)].store(val, std::memory_order_relaxed); }
+  };
+
+  array* Grow(array* a, const int64_t bottom, const int64_t top);
+
+  alignas(cache_line_size) std::atomic<int64_t> top{0};
+  alignas(cache_line_size) std::atomic<int64_t> bottom{0};
+  std::atomic<array*> buffer;
+  std::vector<array*> retired;
+};
+
+template<typename T>
+ChaseLevDeque<T>::ChaseLevDeque(const int64_t capacity) {
+  int64_t size = 1;
+  while (size < capacity) {
+    size *= 2;
+  }
+  buffer.store(new array(size), std::memory_order_relaxed);
+}
+
+template<typename T>
+ChaseLevDeque<T>::~ChaseLevDeque() {
+  delete buffer.load(std::memory_order_relaxed);
+  for (array* a : retired) {
+    delete a;
+  }
+}
+
+template<typename T>
+typename ChaseLevDeque<T>::array* ChaseLevDeque<T>::Grow(array* a, const int64_t b, const int64_t t) {
+  array* grown = new array(a->size * 2);
+  for (int64_t i = t; i < b; ++i) {
+    grown->Put(i, a->Get(i));
+  }
+  retired.push_back(a);
+  buffer.store(grown, std::memory_order_release);
+  return grown;
+}
+
+template<typename T>
+void ChaseLevDeque<T>::Push(const T val) {
+  int64_t b = bottom.load(std::memory_order_relaxed);
+  int64_t t = top.load(std::memory_order_acquire);
+  array* a = buffer.load(std::memory_order_relaxed);
+  if (b - t > a->size - 1) {
+    a = Grow(a, b, t);
+  }
+  a->Put(b, val);
+  bottom.store(b + 1, std::memory_order_release);
+}
+
+template<typename T>
+bool ChaseLevDeque<T>::Pop(T& val) {
+  int64_t b = bottom.load(std::memory_order_relaxed) - 1;
+  array* a = buffer.load(std::memory_order_relaxed);
+  // Уменьшение bottom должно стать видимым ворам раньше чтения top
+  bottom.store(b, std::memory_order_seq_cst);
+  int64_t t = top.load(std::memory_order_seq_cst);
+  if (t > b) {
+    bottom.store(b + 1, std::memory_order_relaxed);
+    return false;
+  }
+  val = a->Get(b);
+  if (t == b) {
+    // Последний элемент: соревнование с ворами
+    bool won = top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+    bottom.store(b + 1, std::memory_order_relaxed);
+    return won;
+  }
+  return true;
+}
+
+template<typename T>
+bool ChaseLevDeque<T>::Steal(T& val) {
+  int64_t t = top.load(std::memory_order_seq_cst);
+  int64_t b = bottom.load(std::memory_order_seq_cst);
+  if (t >= b) {
+    return false;
+  }
+  array* a = buffer.load(std::memory_order_acquire);
+  val = a->Get(t);
+  return top.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+}
+
+template<typename T>
+int64_t ChaseLevDeque<T>::Size() const {
+  int64_t b = bottom.load(std::memory_order_relaxed);
+  int64_t t = top.load(std::memory_order_relaxed);
+  return b > t ? b - t : 0;
+}
+
+#endif
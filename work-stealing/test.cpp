@@ -0,0 +1,113 @@
+#include "chase_lev_deque.h"
+#include "thread_pool.h"
+
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+const int threads_count = 4;
+
+bool testDeque() {
+  const int n = 200000;
+  ChaseLevDeque<int> deque(16);
+  std::vector<std::atomic<int>> taken(n);
+  std::atomic<bool> done(false);
+  std::vector<std::thread> thieves;
+  for (int i = 0; i < threads_count - 1; ++i) {
+    thieves.emplace_back([&]() {
+      int val = 0;
+      while (!done.load() || deque.Size() > 0) {
+        if (deque.Steal(val)) {
+          taken[val].fetch_add(1);
+        }
+      }
+    });
+  }
+  int val = 0;
+  for (int i = 0; i < n; ++i) {
+    deque.Push(i);
+    if (i % 3 == 0 && deque.Pop(val)) {
+      taken[val].fetch_add(1);
+    }
+  }
+  while (deque.Pop(val)) {
+    taken[val].fetch_add(1);
+  }
+  done.store(true);
+  for (auto& th : thieves) {
+    th.join();
+  }
+  int once = 0;
+  for (auto& t : taken) {
+    once += t.load() == 1;
+  }
+  std::cout << "----------ДЕК ЧЕЙЗА-ЛЕВА----------" << std::endl;
+  std::cout << "Элементов, взятых ровно один раз: " << once << " из " << n << std::endl << std::endl;
+  return once == n;
+}
+
+bool testPool() {
+  ThreadPool pool(threads_count);
+  const int n = 20000;
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::future<long long>> futures;
+  for (int i = 0; i < n; ++i) {
+    futures.push_back(pool.Submit([i]() { return static_cast<long long>(i) * i; }));
+  }
+  long long sum = 0;
+  for (auto& f : futures) {
+    sum += f.get();
+  }
+  auto t1 = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+  long long expected = 0;
+  for (long long i = 0; i < n; ++i) {
+    expected += i * i;
+  }
+
+  // Вложенный ParallelFor: внешние куски порождают внутренние, простаивающие потоки их крадут
+  const int rows = 200, cols = 2000;
+  std::vector<long long> row_sums(rows);
+  start = std::chrono::steady_clock::now();
+  pool.ParallelFor(0, rows, [&](int r) {
+    std::vector<long long> cells(cols);
+    pool.ParallelFor(0, cols, [&](int c) { cells[c] = static_cast<long long>(r) * c; }, 64);
+    for (long long v : cells) {
+      row_sums[r] += v;
+    }
+  });
+  auto t2 = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count();
+  bool rows_ok = true;
+  for (int r = 0; r < rows; ++r) {
+    rows_ok = rows_ok && row_sums[r] == static_cast<long long>(r) * cols * (cols - 1) / 2;
+  }
+
+  bool thrown = false;
+  try {
+    pool.ParallelFor(0, 1000, [](int i) {
+      if (i == 777) {
+        throw std::runtime_error("body failed");
+      }
+    });
+  }
+  catch (const std::runtime_error&) {
+    thrown = true;
+  }
+
+  std::cout << "----------ПУЛ ПОТОКОВ----------" << std::endl;
+  std::cout << "Потоков: " << pool.Size() << std::endl;
+  std::cout << "Submit: " << n << " задач за " << t1 << " ms, сумма " << (sum == expected ? "верная" : "НЕВЕРНАЯ") << std::endl;
+  std::cout << "Вложенный ParallelFor: " << t2 << " ms, суммы строк " << (rows_ok ? "верные" : "НЕВЕРНЫЕ") << std::endl;
+  std::cout << "Исключение из тела цикла " << (thrown ? "передано" : "ПОТЕРЯНО") << std::endl;
+  std::cout << "Украдено задач: " << pool.Steals() << std::endl << std::endl;
+  return sum == expected && rows_ok && thrown;
+}
+
+int main() {
+  setlocale(LC_ALL, "Russian");
+  bool ok = testDeque();
+  ok = testPool() && ok;
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,114 @@
+#include "thread_pool.h"
+
+#include <random>
+
+namespace {
+
+// Пул и номер рабочего потока, в котором выполняется код
+thread_local ThreadPool* current_pool = nullptr;
+thread_local unsigned current_index = 0;
+
+}
+
+ThreadPool::ThreadPool(unsigned threads) {
+  threads = std::max(threads, 1u);
+  for (unsigned i = 0; i < threads; ++i) {
+    workers.push_back(std::make_unique<worker>());
+  }
+  for (unsigned i = 0; i < threads; ++i) {
+    workers[i]->thread = std::thread(&ThreadPool::WorkerLoop, this, i);
+  }
+}
+
+ThreadPool::~ThreadPool() {
+  {
+    std::lock_guard<std::mutex> lock(park_mutex);
+    stop = true;
+  }
+  park.notify_all();
+  for (auto& w : workers) {
+    w->thread.join();
+  }
+}
+
+void ThreadPool::Schedule(task* t) {
+  if (current_pool == this) {
+    workers[current_index]->deque.Push(t);
+  }
+  else {
+    std::lock_guard<std::mutex> lock(injection_mutex);
+    injection.push_back(t);
+  }
+  queued.fetch_add(1, std::memory_order_seq_cst);
+  // Спящий поток увеличивает sleepers до проверки queued, поэтому будильник не теряется
+  if (sleepers.load(std::memory_order_seq_cst) > 0) {
+    { std::lock_guard<std::mutex> lock(park_mutex); }
+    park.notify_one();
+  }
+}
+
+ThreadPool::task* ThreadPool::Take() {
+  task* t = nullptr;
+  if (current_pool == this && workers[current_index]->deque.Pop(t)) {
+    return t;
+  }
+  {
+    std::lock_guard<std::mutex> lock(injection_mutex);
+    if (!injection.empty()) {
+      t = injection.front();
+      injection.pop_front();
+      return t;
+    }
+  }
+  thread_local std::minstd_rand random(std::random_device{}());
+  size_t n = workers.size();
+  size_t start = random() % n;
+  for (size_t i = 0; i < n; ++i) {
+    size_t victim = (start + i) % n;
+    if (current_pool == this && victim == current_index) {
+      continue;
+    }
+    if (workers[victim]->deque.Steal(t)) {
+      steals.fetch_add(1, std::memory_order_relaxed);
+      return t;
+    }
+  }
+  return nullptr;
+}
+
+bool ThreadPool::RunOne() {
+  task* t = Take();
+  if (!t) {
+    return false;
+  }
+  queued.fetch_sub(1, std::memory_order_relaxed);
+  t->Run();
+  delete t;
+  return true;
+}
+
+void ThreadPool::WorkerLoop(const unsigned index) {
+  current_pool = this;
+  current_index = index;
+  while (true) {
+    if (RunOne()) {
+      continue;
+    }
+    // Несколько попыток перед сном: задачи часто появляются сразу
+    bool found = false;
+    for (int i = 0; i < 64 && !found; ++i) {
+      std::this_thread::yield();
+      found = queued.load(std::memory_order_relaxed) > 0 && RunOne();
+    }
+    if (found) {
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(park_mutex);
+    sleepers.fetch_add(1, std::memory_order_seq_cst);
+    park.wait(lock, [this]() { return stop || queued.load(std::memory_order_seq_cst) > 0; });
+    sleepers.fetch_sub(1, std::memory_order_relaxed);
+    if (stop && queued.load(std::memory_order_seq_cst) == 0) {
+      return;
+    }
+  }
+}
@@ -0,0 +1,138 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "chase_lev_deque.h"
+
+// Пул потоков с перехватом работы. У каждого рабочего потока свой дек
+// Чейза-Лева: задачи, созданные внутри пула, кладутся в дек создателя и
+// забираются им без блокировок, простаивающие потоки крадут их сверху.
+// Задачи извне пула попадают в общую очередь. Поток, не нашедший работы,
+// засыпает на условной переменной и будится при появлении новых задач.
+class ThreadPool {
+public:
+  explicit ThreadPool(unsigned threads = std::thread::hardware_concurrency());
+  // Дожидается выполнения всех поставленных задач
+  ~ThreadPool();
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  template<typename Func>
+  std::future<std::invoke_result_t<std::decay_t<Func>>> Submit(Func&& func);
+
+  // body(i) для всех i из [begin, end) кусками по grain (0 - автоматически).
+  // Вызывающий поток выполняет задачи пула, пока ждет, поэтому вызов можно
+  // вкладывать в задачи пула. Первое исключение из body пробрасывается
+  // после завершения всех кусков.
+  template<typename Body>
+  void ParallelFor(const int begin, const int end, Body body, int grain = 0);
+
+  unsigned Size() const { return static_cast<unsigned>(workers.size()); }
+  // Число задач, украденных у других потоков
+  uint64_t Steals() const { return steals.load(std::memory_order_relaxed); }
+
+private:
+  struct task {
+    virtual ~task() = default;
+    virtual void Run() = 0;
+  };
+
+  template<typename Func>
+  struct task_impl : task {
+    Func func;
+    explicit task_impl(Func&& f) : func(std::move(f)) {}
+    void Run() override { func(); }
+  };
+
+  struct worker {
+    ChaseLevDeque<task*> deque;
+    std::thread thread;
+  };
+
+  void Schedule(task* t);
+  // Поиск задачи: свой дек, общая очередь, деки других потоков
+  task* Take();
+  // Выполнение одной задачи; false, если задач нет
+  bool RunOne();
+  void WorkerLoop(const unsigned index);
+
+  std::vector<std::unique_ptr<worker>> workers;
+  std::mutex injection_mutex;
+  std::deque<task*> injection;
+  // Задачи, поставленные, но еще не взятые на выполнение
+  alignas(cache_line_size) std::atomic<int64_t> queued{0};
+  alignas(cache_line_size) std::atomic<int> sleepers{0};
+  std::atomic<uint64_t> steals{0};
+  std::mutex park_mutex;
+  std::condition_variable park;
+  bool stop = false;
+};
+
+template<typename Func>
+std::future<std::invoke_result_t<std::decay_t<Func>>> ThreadPool::Submit(Func&& func) {
+  using R = std::invoke_result_t<std::decay_t<Func>>;
+  std::packaged_task<R()> job(std::forward<Func>(func));
+  std::future<R> res = job.get_future();
+  Schedule(new task_impl<std::packaged_task<R()>>(std::move(job)));
+  return res;
+}
+
+template<typename Body>
+void ThreadPool::ParallelFor(const int begin, const int end, Body body, int grain) {
+  if (begin >= end) {
+    return;
+  }
+  int n = end - begin;
+  if (grain <= 0) {
+    // Несколько кусков на поток, чтобы было что красть при неравной нагрузке
+    grain = std::max(1, n / (static_cast<int>(workers.size()) * 4 + 1));
+  }
+  int chunks = (n - 1) / grain + 1;
+  std::atomic<int> remaining(chunks);
+  std::mutex error_mutex;
+  std::exception_ptr error;
+  auto run = [&body, &remaining, &error_mutex, &error](const int lo, const int hi) {
+    try {
+      for (int i = lo; i < hi; ++i) {
+        body(i);
+      }
+    }
+    catch (...) {
+      std::lock_guard<std::mutex> lock(error_mutex);
+      if (!error) {
+        error = std::current_exception();
+      }
+    }
+    remaining.fetch_sub(1, std::memory_order_release);
+  };
+  // Первый кусок выполняется вызывающим потоком
+  for (int c = 1; c < chunks; ++c) {
+    int lo = begin + c * grain;
+    int hi = lo + std::min(grain, end - lo);
+    auto chunk = [&run, lo, hi]() { run(lo, hi); };
+    Schedule(new task_impl<decltype(chunk)>(std::move(chunk)));
+  }
+  run(begin, begin + std::min(grain, n));
+  while (remaining.load(std::memory_order_acquire) > 0) {
+    if (!RunOne()) {
+      std::this_thread::yield();
+    }
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
+
+#endif